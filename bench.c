@@ -0,0 +1,678 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		bench.c
+ *
+ * @brief 		Microbenchmarks for the EM API serialization library
+ *
+ * @details 	Each benchmark is run for a number of samples. Each sample
+ *              times a batch of operations so that the clock overhead is
+ *              amortized. Results are reported as percentiles of ns/op over
+ *              all samples along with cycles/op and throughput.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* printf()
+ */
+#include <stdio.h>
+
+/* malloc(), qsort(), atoi()
+ */
+#include <stdlib.h>
+
+/* memset(), strstr()
+ */
+#include <string.h>
+
+/* getopt()
+ */
+#include <unistd.h>
+
+/* clock_gettime()
+ */
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+#define BENCH_SAMPLES 				101 	//!< Default number of timed samples per benchmark
+#define BENCH_ITERS 				2000 	//!< Default number of operations per sample
+
+/* ENUMERATIONS ==============================================================*/
+
+/**
+ * Output formats
+ */
+enum _BNFM
+{
+	BNFM_TEXT 	= 0,
+	BNFM_CSV	= 1,
+	BNFM_JSON	= 2,
+	BNFM_MAX
+};
+
+/* STRUCTS ===================================================================*/
+
+/**
+ * State shared by all benchmarks
+ */
+struct bench_ctx
+{
+	struct emapi_msg *msg;			//!< Source / destination message
+	struct emapi_buf *buf;			//!< Serialized message
+	struct emapi_hdr hdr;			//!< Scratch header
+	struct emapi_hdr hdrs[EMLN_DEV_NUM];	//!< Scratch headers for batch decode
+	struct emapi_hdr_soa soa;		//!< Scratch structure of arrays for batch decode
+	unsigned num;					//!< Number of entries for list benchmarks
+	unsigned len;					//!< Serialized payload length
+};
+
+/**
+ * Benchmark function. Runs iters operations and returns the bytes processed
+ * by a single operation
+ */
+typedef unsigned (*bench_fn)(struct bench_ctx *c, unsigned iters);
+
+/**
+ * Benchmark definition
+ */
+struct bench
+{
+	const char *name;				//!< Name reported in the output
+	bench_fn fn;					//!< Function to time
+	unsigned num;					//!< Number of list entries
+	unsigned name_len;				//!< Length of each device name including NUL
+};
+
+/**
+ * Benchmark results
+ */
+struct bench_res
+{
+	double min;						//!< Fastest sample in ns/op
+	double p50;						//!< Median sample in ns/op
+	double p90;						//!< 90th percentile sample in ns/op
+	double p99;						//!< 99th percentile sample in ns/op
+	double mean;					//!< Mean of all samples in ns/op
+	double cycles;					//!< Median cycles/op
+	double mbps;					//!< Throughput at the median in MB/s
+	double mops;					//!< Operations per second at the median in millions
+	unsigned bytes;					//!< Bytes processed by one operation
+};
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+/**
+ * Sink to keep the compiler from discarding results
+ */
+volatile unsigned long sink;
+
+/* PROTOTYPES ================================================================*/
+
+/* FUNCTIONS =================================================================*/
+
+static inline unsigned long long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline unsigned long long now_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static unsigned b_hdr_ser(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		c->hdr.tag = i;
+		emapi_serialize(c->buf->hdr, &c->hdr, EMOB_HDR, NULL);
+		sink += c->buf->hdr[1];
+	}
+	return EMLN_HDR;
+}
+
+static unsigned b_hdr_deser(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		c->buf->hdr[1] = i;
+		emapi_deserialize(&c->hdr, c->buf->hdr, EMOB_HDR, NULL);
+		sink += c->hdr.tag;
+	}
+	return EMLN_HDR;
+}
+
+static unsigned b_hdr_enc(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		c->hdr.tag = i;
+		emapi_enc_hdr(c->buf->hdr, &c->hdr);
+		sink += c->buf->hdr[1];
+	}
+	return EMLN_HDR;
+}
+
+static unsigned b_hdr_dec(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		c->buf->hdr[1] = i;
+		emapi_dec_hdr(&c->hdr, c->buf->hdr);
+		sink += c->hdr.tag;
+	}
+	return EMLN_HDR;
+}
+
+static unsigned b_hdr_deser_loop(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i, j;
+	for ( i = 0 ; i < iters ; i++ )
+		for ( j = 0 ; j < c->num ; j++ )
+		{
+			emapi_deserialize(&c->hdrs[j], &c->buf->payload[j * EMLN_HDR], EMOB_HDR, NULL);
+			sink += c->hdrs[j].len;
+		}
+	return c->num * EMLN_HDR;
+}
+
+static unsigned b_hdr_deser_batch(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		emapi_deserialize_hdrs(&c->soa, c->buf->payload, c->num);
+		sink += c->soa.len[c->num - 1];
+	}
+	return c->num * EMLN_HDR;
+}
+
+static unsigned b_listdev_ser(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+		sink += emapi_serialize(c->buf->payload, c->msg->obj.dev, EMOB_LIST_DEV, &c->num);
+	return c->len;
+}
+
+static unsigned b_listdev_ser_single(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i, j, k;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		k = 0;
+		for ( j = 0 ; j < c->num ; j++ )
+			k += emapi_serialize(&c->buf->payload[k], &c->msg->obj.dev[j], EMOB_LIST_DEV, NULL);
+		sink += k;
+	}
+	return c->len;
+}
+
+static unsigned b_listdev_rsp(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+		sink += emapi_serialize_listdev(c->buf, c->msg, c->num, c->num);
+	return EMLN_HDR + c->len;
+}
+
+static unsigned b_listdev_deser(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+		sink += emapi_deserialize(c->msg->obj.dev, c->buf->payload, EMOB_LIST_DEV, &c->num);
+	return c->len;
+}
+
+static unsigned b_listdev_dec(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i, j, k;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		k = 0;
+		for ( j = 0 ; j < c->num ; j++ )
+			k += emapi_dec_dev(&c->msg->obj.dev[j], &c->buf->payload[k], EMVER_V0);
+		sink += k;
+	}
+	return c->len;
+}
+
+static unsigned b_listdev_view(struct bench_ctx *c, unsigned iters)
+{
+	struct emapi_dev_view v;
+	struct emapi_dev_ref d;
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		emapi_dev_view_init(&v, c->buf->payload, c->len, c->num);
+		while (emapi_dev_next(&v, &d) == 1)
+			sink += d.len;
+	}
+	return c->len;
+}
+
+static unsigned b_fill_hdr(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+		sink += emapi_fill_hdr(&c->hdr, EMMT_REQ, i, 0, EMOP_LIST_DEV, 0, 1, i);
+	return sizeof(struct emapi_hdr);
+}
+
+static unsigned b_fill_conn(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		emapi_fill_conn(c->msg, i & 0xFF, i);
+		sink += c->msg->hdr.a;
+	}
+	return sizeof(struct emapi_hdr);
+}
+
+static unsigned b_fill_disconn(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		emapi_fill_disconn(c->msg, i & 0xFF, i & 1);
+		sink += c->msg->hdr.a;
+	}
+	return sizeof(struct emapi_hdr);
+}
+
+static unsigned b_fill_listdev(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		emapi_fill_listdev(c->msg, i & 0xFF, i);
+		sink += c->msg->hdr.a;
+	}
+	return sizeof(struct emapi_hdr);
+}
+
+static unsigned b_sfill_conn_ser(struct bench_ctx *c, unsigned iters)
+{
+	struct emapi_smsg m;
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		emapi_sfill_conn(&m, i & 0xFF, i);
+		sink += emapi_serialize_smsg(c->buf->hdr, &m);
+	}
+	return EMLN_HDR;
+}
+
+static unsigned b_pool_msg(struct bench_ctx *c, unsigned iters)
+{
+	void *p;
+	unsigned i;
+	(void) c;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		p = emapi_pool_alloc(sizeof(struct emapi_msg));
+		sink += (unsigned long) p;
+		emapi_pool_free(p);
+	}
+	return 0;
+}
+
+static unsigned b_malloc_msg(struct bench_ctx *c, unsigned iters)
+{
+	void *p;
+	unsigned i;
+	(void) c;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		p = malloc(sizeof(struct emapi_msg));
+		sink += (unsigned long) p;
+		free(p);
+	}
+	return 0;
+}
+
+static unsigned b_stats_record(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	(void) c;
+	for ( i = 0 ; i < iters ; i++ )
+		emapi_stats_record(EMSK_CLIENT, i & 3, EMRC_SUCCESS, 1000 + (i & 0xFFF));
+	return 0;
+}
+
+static unsigned b_capture(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+		emapi_capture(EMSK_SERVER, i, EMCD_RX, c->buf->hdr, c->buf->payload, 52);
+	return EMLN_HDR + 52;
+}
+
+static unsigned b_fmt_hdr(struct bench_ctx *c, unsigned iters)
+{
+	char out[256];
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		c->hdr.tag = i;
+		sink += emapi_fmt(out, sizeof(out), &c->hdr, EMOB_HDR, 0);
+	}
+	return sizeof(struct emapi_hdr);
+}
+
+static unsigned b_fmt_hdr_json(struct bench_ctx *c, unsigned iters)
+{
+	char out[256];
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		c->hdr.tag = i;
+		sink += emapi_fmt(out, sizeof(out), &c->hdr, EMOB_HDR, EMFM_JSON);
+	}
+	return sizeof(struct emapi_hdr);
+}
+
+/**
+ * Same text as b_fmt_hdr() written with snprintf() for comparison
+ */
+static unsigned b_snprintf_hdr(struct bench_ctx *c, unsigned iters)
+{
+	struct emapi_hdr *h = &c->hdr;
+	char out[256];
+	unsigned i;
+	for ( i = 0 ; i < iters ; i++ )
+	{
+		h->tag = i;
+		sink += snprintf(out, sizeof(out), "type=%s ver=%u tag=0x%02x rc=%s opcode=%s a=0x%04x len=%u b=0x%08x",
+			emmt(h->type), h->ver, h->tag, emrc(h->rc), emop(h->opcode), h->a, h->len, h->b);
+	}
+	return sizeof(struct emapi_hdr);
+}
+
+static unsigned b_fmt_listdev_json(struct bench_ctx *c, unsigned iters)
+{
+	struct emapi_frame f;
+	char out[4096];
+	unsigned i;
+
+	f.hdr = c->hdr;
+	f.hdr.a = c->num;
+	f.hdr.len = c->len;
+	f.buf = c->buf->hdr;
+	f.payload = c->buf->payload;
+	f.len = EMLN_HDR + c->len;
+	for ( i = 0 ; i < iters ; i++ )
+		sink += emapi_fmt_frame(out, sizeof(out), &f, EMFM_JSON);
+	return EMLN_HDR + c->len;
+}
+
+static unsigned b_strings(struct bench_ctx *c, unsigned iters)
+{
+	unsigned i;
+	(void) c;
+	for ( i = 0 ; i < iters ; i++ )
+		sink += (unsigned long) emop(i % EMOP_MAX) + (unsigned long) emrc(i % EMRC_MAX)
+		      + (unsigned long) emmt(i % EMMT_MAX) + (unsigned long) emob(i % EMOB_MAX);
+	return 0;
+}
+
+/**
+ * List of all benchmarks
+ */
+static struct bench benches[] = {
+	{ "hdr_serialize",				b_hdr_ser,				0, 	0 },
+	{ "hdr_deserialize",			b_hdr_deser,			0, 	0 },
+	{ "hdr_encode_inline",			b_hdr_enc,				0, 	0 },
+	{ "hdr_decode_inline",			b_hdr_dec,				0, 	0 },
+	{ "hdr_deserialize_loop_64",	b_hdr_deser_loop,		64, 0 },
+	{ "hdr_deserialize_batch_64",	b_hdr_deser_batch,		64, 0 },
+	{ "listdev_serialize_1_short",	b_listdev_ser,			1, 	8 },
+	{ "listdev_serialize_1_max",	b_listdev_ser,			1, 	EMLN_DEV_NAME },
+	{ "listdev_serialize_16_short",	b_listdev_ser,			16, 8 },
+	{ "listdev_serialize_16_max",	b_listdev_ser,			16, EMLN_DEV_NAME },
+	{ "listdev_serialize_64_short",	b_listdev_ser,			64, 8 },
+	{ "listdev_serialize_64_max",	b_listdev_ser,			64, EMLN_DEV_NAME },
+	{ "listdev_single_64_short",	b_listdev_ser_single,	64, 8 },
+	{ "listdev_single_64_max",		b_listdev_ser_single,	64, EMLN_DEV_NAME },
+	{ "listdev_response_64_short",	b_listdev_rsp,			64, 8 },
+	{ "listdev_deserialize_1_short",b_listdev_deser,		1, 	8 },
+	{ "listdev_deserialize_1_max",	b_listdev_deser,		1, 	EMLN_DEV_NAME },
+	{ "listdev_deserialize_16_short",b_listdev_deser,		16, 8 },
+	{ "listdev_deserialize_16_max",	b_listdev_deser,		16, EMLN_DEV_NAME },
+	{ "listdev_deserialize_64_short",b_listdev_deser,		64, 8 },
+	{ "listdev_deserialize_64_max",	b_listdev_deser,		64, EMLN_DEV_NAME },
+	{ "listdev_decode_inline_64_short",b_listdev_dec,		64, 8 },
+	{ "listdev_view_64_short",		b_listdev_view,			64, 8 },
+	{ "listdev_view_64_max",		b_listdev_view,			64, EMLN_DEV_NAME },
+	{ "fill_hdr",					b_fill_hdr,				0, 	0 },
+	{ "fill_conn",					b_fill_conn,			0, 	0 },
+	{ "fill_disconn",				b_fill_disconn,			0, 	0 },
+	{ "fill_listdev",				b_fill_listdev,			0, 	0 },
+	{ "sfill_conn_serialize",		b_sfill_conn_ser,		0, 	0 },
+	{ "pool_alloc_free_msg",		b_pool_msg,				0, 	0 },
+	{ "malloc_free_msg",			b_malloc_msg,			0, 	0 },
+	{ "stats_record",				b_stats_record,			0, 	0 },
+	{ "capture_frame",				b_capture,				0, 	0 },
+	{ "fmt_hdr",					b_fmt_hdr,				0, 	0 },
+	{ "fmt_hdr_json",				b_fmt_hdr_json,			0, 	0 },
+	{ "snprintf_hdr",				b_snprintf_hdr,			0, 	0 },
+	{ "fmt_listdev_json_16_short",	b_fmt_listdev_json,		16, 8 },
+	{ "strings",					b_strings,				0, 	0 },
+	{ NULL, NULL, 0, 0 }
+};
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Prepare the shared state for a benchmark
+ */
+static void bench_prep(struct bench_ctx *c, struct bench *b)
+{
+	unsigned i;
+
+	memset(c->msg, 0, sizeof(*c->msg));
+	memset(c->buf, 0, sizeof(*c->buf));
+	emapi_fill_hdr(&c->hdr, EMMT_RSP, 0x42, 0, EMOP_LIST_DEV, 0x100, 0x23, 0x12345678);
+	emapi_serialize(c->buf->hdr, &c->hdr, EMOB_HDR, NULL);
+
+	c->num = b->num;
+	for ( i = 0 ; i < b->num ; i++ )
+	{
+		if (b->name_len == 0)
+			continue;
+		c->msg->obj.dev[i].id = i;
+		c->msg->obj.dev[i].len = b->name_len;
+		memset(c->msg->obj.dev[i].name, 'a' + (i % 26), b->name_len - 1);
+	}
+	c->len = 0;
+	if (b->num > 0 && b->name_len == 0)
+		for ( i = 0 ; i < b->num ; i++ )
+			emapi_serialize(&c->buf->payload[i * EMLN_HDR], &c->hdr, EMOB_HDR, NULL);
+	else if (b->num > 0)
+		c->len = emapi_serialize(c->buf->payload, c->msg->obj.dev, EMOB_LIST_DEV, &c->num);
+}
+
+/**
+ * Run a single benchmark and compute its statistics
+ */
+static void bench_run(struct bench_ctx *c, struct bench *b, struct bench_res *r, unsigned samples, unsigned iters)
+{
+	unsigned long long t0, t1, c0, c1;
+	double *ns, *cyc, sum;
+	unsigned i;
+
+	ns = (double*) malloc(samples * sizeof(double));
+	cyc = (double*) malloc(samples * sizeof(double));
+
+	bench_prep(c, b);
+
+	// Warm up caches and branch predictors
+	r->bytes = b->fn(c, iters);
+
+	sum = 0;
+	for ( i = 0 ; i < samples ; i++ )
+	{
+		t0 = now_ns();
+		c0 = now_cycles();
+		b->fn(c, iters);
+		c1 = now_cycles();
+		t1 = now_ns();
+		ns[i] = (double) (t1 - t0) / iters;
+		cyc[i] = (double) (c1 - c0) / iters;
+		sum += ns[i];
+	}
+
+	qsort(ns, samples, sizeof(double), cmp_double);
+	qsort(cyc, samples, sizeof(double), cmp_double);
+
+	r->min 		= ns[0];
+	r->p50 		= ns[samples / 2];
+	r->p90 		= ns[(samples * 90) / 100];
+	r->p99 		= ns[(samples * 99) / 100];
+	r->mean 	= sum / samples;
+	r->cycles 	= cyc[samples / 2];
+	r->mops 	= r->p50 > 0 ? 1000.0 / r->p50 : 0;
+	r->mbps 	= r->p50 > 0 ? (r->bytes * 1000.0) / r->p50 : 0;
+
+	free(ns);
+	free(cyc);
+}
+
+static void bench_prnt(struct bench *b, struct bench_res *r, unsigned fmt, int first)
+{
+	switch (fmt)
+	{
+		case BNFM_CSV:
+			if (first)
+				printf("name,bytes,min_ns,p50_ns,p90_ns,p99_ns,mean_ns,cycles,mops,mbps\n");
+			printf("%s,%u,%.2f,%.2f,%.2f,%.2f,%.2f,%.1f,%.2f,%.1f\n", b->name, r->bytes,
+				r->min, r->p50, r->p90, r->p99, r->mean, r->cycles, r->mops, r->mbps);
+			break;
+
+		case BNFM_JSON:
+			printf("{\"name\":\"%s\",\"bytes\":%u,\"min_ns\":%.2f,\"p50_ns\":%.2f,\"p90_ns\":%.2f,"
+				"\"p99_ns\":%.2f,\"mean_ns\":%.2f,\"cycles\":%.1f,\"mops\":%.2f,\"mbps\":%.1f}\n",
+				b->name, r->bytes, r->min, r->p50, r->p90, r->p99, r->mean, r->cycles, r->mops, r->mbps);
+			break;
+
+		default:
+			if (first)
+				printf("%-32s %6s %9s %9s %9s %9s %9s %9s\n",
+					"benchmark", "bytes", "p50 ns", "p90 ns", "p99 ns", "cycles", "Mops/s", "MB/s");
+			printf("%-32s %6u %9.2f %9.2f %9.2f %9.1f %9.2f %9.1f\n", b->name, r->bytes,
+				r->p50, r->p90, r->p99, r->cycles, r->mops, r->mbps);
+			break;
+	}
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-f text|csv|json] [-s samples] [-n iters] [-l] [filter]\n", prog);
+	printf("  -f  Output format (default text)\n");
+	printf("  -s  Number of timed samples per benchmark (default %d)\n", BENCH_SAMPLES);
+	printf("  -n  Number of operations per sample (default %d)\n", BENCH_ITERS);
+	printf("  -l  List benchmarks and exit\n");
+	printf("  filter  Only run benchmarks whose name contains this string\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_ctx ctx;
+	struct bench_res res;
+	struct bench *b;
+	unsigned fmt, samples, iters;
+	const char *filter;
+	int opt, first;
+
+	fmt = BNFM_TEXT;
+	samples = BENCH_SAMPLES;
+	iters = BENCH_ITERS;
+	filter = NULL;
+
+	while ( (opt = getopt(argc, argv, "f:s:n:lh")) != -1 )
+	{
+		switch (opt)
+		{
+			case 'f':
+				if 		(!strcmp(optarg, "csv"))	fmt = BNFM_CSV;
+				else if (!strcmp(optarg, "json"))	fmt = BNFM_JSON;
+				else 								fmt = BNFM_TEXT;
+				break;
+			case 's': samples = atoi(optarg); 		break;
+			case 'n': iters = atoi(optarg); 		break;
+			case 'l':
+				for ( b = benches ; b->name != NULL ; b++ )
+					printf("%s\n", b->name);
+				return 0;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (optind < argc)
+		filter = argv[optind];
+	if (samples == 0) 	samples = 1;
+	if (iters == 0) 	iters = 1;
+
+	ctx.msg = (struct emapi_msg*) malloc(sizeof(struct emapi_msg));
+	ctx.buf = (struct emapi_buf*) malloc(sizeof(struct emapi_buf));
+	ctx.soa.type 	= (__u8*) malloc(EMLN_DEV_NUM);
+	ctx.soa.ver 	= (__u8*) malloc(EMLN_DEV_NUM);
+	ctx.soa.tag 	= (__u8*) malloc(EMLN_DEV_NUM);
+	ctx.soa.rc 		= (__u8*) malloc(EMLN_DEV_NUM);
+	ctx.soa.opcode 	= (__u8*) malloc(EMLN_DEV_NUM);
+	ctx.soa.a 		= (__u16*) malloc(EMLN_DEV_NUM * sizeof(__u16));
+	ctx.soa.len 	= (__u16*) malloc(EMLN_DEV_NUM * sizeof(__u16));
+	ctx.soa.b 		= (__u32*) malloc(EMLN_DEV_NUM * sizeof(__u32));
+	emapi_capture_init(4096, 0);
+
+	first = 1;
+	for ( b = benches ; b->name != NULL ; b++ )
+	{
+		if (filter != NULL && strstr(b->name, filter) == NULL)
+			continue;
+		bench_run(&ctx, b, &res, samples, iters);
+		bench_prnt(b, &res, fmt, first);
+		first = 0;
+	}
+
+	free(ctx.msg);
+	free(ctx.buf);
+	free(ctx.soa.type);
+	free(ctx.soa.ver);
+	free(ctx.soa.tag);
+	free(ctx.soa.rc);
+	free(ctx.soa.opcode);
+	free(ctx.soa.a);
+	free(ctx.soa.len);
+	free(ctx.soa.b);
+	emapi_capture_free();
+	return 0;
+}
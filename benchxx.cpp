@@ -0,0 +1,464 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		benchxx.cpp
+ *
+ * @brief 		Microbenchmarks of the C++ bindings against the C API
+ *
+ * @details 	Each C++ benchmark is paired with one that does the same work
+ *              through the C functions, so the two rows of a pair should
+ *              report the same time. Before timing, the bytes and objects
+ *              produced by both paths are compared and the program exits
+ *              with an error if they differ.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* printf()
+ */
+#include <cstdio>
+
+/* std::sort()
+ */
+#include <algorithm>
+
+/* std::vector
+ */
+#include <vector>
+
+/* memset(), memcmp(), strstr()
+ */
+#include <cstring>
+
+/* getopt()
+ */
+#include <unistd.h>
+
+/* clock_gettime()
+ */
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "emapi.hpp"
+
+/* MACROS ====================================================================*/
+
+#define BENCH_SAMPLES 				101 	//!< Default number of timed samples per benchmark
+#define BENCH_ITERS 				2000 	//!< Default number of operations per sample
+
+/* STRUCTS ===================================================================*/
+
+/**
+ * State shared by all benchmarks
+ */
+struct bench_ctx
+{
+	emapi_msg *msg;					//!< Source / destination message
+	emapi_buf *buf;					//!< Serialized message
+	emapi_hdr hdr;					//!< Scratch header
+	emapi_conn_ent ent;				//!< Scratch connect entry
+	unsigned num;					//!< Number of entries for list benchmarks
+	unsigned len;					//!< Serialized payload length
+};
+
+/**
+ * Benchmark function. Runs iters operations and returns the bytes processed
+ * by a single operation
+ */
+typedef unsigned (*bench_fn)(bench_ctx *c, unsigned iters);
+
+/**
+ * Benchmark definition
+ */
+struct bench
+{
+	const char *name;				//!< Name reported in the output
+	bench_fn fn;					//!< Function to time
+	unsigned num;					//!< Number of list entries
+	unsigned name_len;				//!< Length of each device name including NUL
+};
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+/**
+ * Sink to keep the compiler from discarding results
+ */
+volatile unsigned long sink;
+
+/**
+ * Header built at compile time
+ */
+static constexpr auto bxx_req = emapi::header().type(EMMT_REQ).tag(0x42).opcode(EMOP_CONN_DEV).a(3).b(7);
+static constexpr auto bxx_wire = bxx_req.wire();
+static_assert(bxx_wire[0] == EMMT_REQ && bxx_wire[3] == EMOP_CONN_DEV && bxx_wire[8] == 7,
+	"constexpr header does not match the wire format");
+
+/* FUNCTIONS =================================================================*/
+
+static inline unsigned long long now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline unsigned long long now_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static unsigned b_hdr_enc_c(bench_ctx *c, unsigned iters)
+{
+	for (unsigned i = 0 ; i < iters ; i++)
+	{
+		c->hdr.tag = i;
+		emapi_enc_hdr(c->buf->hdr, &c->hdr);
+		sink = sink + c->buf->hdr[1];
+	}
+	return EMLN_HDR;
+}
+
+static unsigned b_hdr_enc_xx(bench_ctx *c, unsigned iters)
+{
+	for (unsigned i = 0 ; i < iters ; i++)
+	{
+		c->hdr.tag = i;
+		emapi::encode(c->buf->hdr, c->hdr);
+		sink = sink + c->buf->hdr[1];
+	}
+	return EMLN_HDR;
+}
+
+static unsigned b_hdr_dec_c(bench_ctx *c, unsigned iters)
+{
+	for (unsigned i = 0 ; i < iters ; i++)
+	{
+		c->buf->hdr[1] = i;
+		emapi_dec_hdr(&c->hdr, c->buf->hdr);
+		sink = sink + c->hdr.tag;
+	}
+	return EMLN_HDR;
+}
+
+static unsigned b_hdr_dec_xx(bench_ctx *c, unsigned iters)
+{
+	for (unsigned i = 0 ; i < iters ; i++)
+	{
+		c->buf->hdr[1] = i;
+		emapi::decode(c->buf->hdr, c->hdr);
+		sink = sink + c->hdr.tag;
+	}
+	return EMLN_HDR;
+}
+
+static unsigned b_hdr_const_c(bench_ctx *c, unsigned iters)
+{
+	emapi_hdr h;
+	for (unsigned i = 0 ; i < iters ; i++)
+	{
+		emapi_fill_hdr(&h, EMMT_REQ, 0x42, 0, EMOP_CONN_DEV, 0, 3, 7);
+		emapi_enc_hdr(c->buf->hdr, &h);
+		sink = sink + c->buf->hdr[i & 7];
+	}
+	return EMLN_HDR;
+}
+
+static unsigned b_hdr_const_xx(bench_ctx *c, unsigned iters)
+{
+	for (unsigned i = 0 ; i < iters ; i++)
+	{
+		memcpy(c->buf->hdr, bxx_wire.data(), EMLN_HDR);
+		sink = sink + c->buf->hdr[i & 7];
+	}
+	return EMLN_HDR;
+}
+
+static unsigned b_conn_enc_c(bench_ctx *c, unsigned iters)
+{
+	for (unsigned i = 0 ; i < iters ; i++)
+	{
+		c->ent.dev = i;
+		emapi_enc_conn_ent(c->buf->payload, &c->ent, EMVER_V2);
+		sink = sink + c->buf->payload[4];
+	}
+	return EMLN_CONN_ENT;
+}
+
+static unsigned b_conn_enc_xx(bench_ctx *c, unsigned iters)
+{
+	for (unsigned i = 0 ; i < iters ; i++)
+	{
+		c->ent.dev = i;
+		emapi::encode(c->buf->payload, c->ent, EMVER_V2);
+		sink = sink + c->buf->payload[4];
+	}
+	return EMLN_CONN_ENT;
+}
+
+static unsigned b_listdev_dec_c(bench_ctx *c, unsigned iters)
+{
+	for (unsigned i = 0 ; i < iters ; i++)
+	{
+		unsigned k = 0;
+		for (unsigned j = 0 ; j < c->num ; j++)
+			k += emapi_dec_dev(&c->msg->obj.dev[j], &c->buf->payload[k], EMVER_V0);
+		sink = sink + k;
+	}
+	return c->len;
+}
+
+static unsigned b_listdev_dec_xx(bench_ctx *c, unsigned iters)
+{
+	for (unsigned i = 0 ; i < iters ; i++)
+	{
+		emapi::cbytes p(c->buf->payload, c->len);
+		unsigned k = 0;
+		for (unsigned j = 0 ; j < c->num ; j++)
+			k += emapi::decode(p.subspan(k), c->msg->obj.dev[j]);
+		sink = sink + k;
+	}
+	return c->len;
+}
+
+static unsigned b_listdev_view_c(bench_ctx *c, unsigned iters)
+{
+	emapi_dev_view v;
+	emapi_dev_ref d;
+	for (unsigned i = 0 ; i < iters ; i++)
+	{
+		emapi_dev_view_init(&v, c->buf->payload, c->len, c->num);
+		while (emapi_dev_next(&v, &d) == 1)
+			sink = sink + d.len;
+	}
+	return c->len;
+}
+
+static unsigned b_listdev_range_xx(bench_ctx *c, unsigned iters)
+{
+	for (unsigned i = 0 ; i < iters ; i++)
+		for (const emapi_dev_ref &d : emapi::dev_range({c->buf->payload, c->len}, c->num))
+			sink = sink + d.len;
+	return c->len;
+}
+
+static struct bench benches[] =
+{
+	{ "hdr_encode_c",				b_hdr_enc_c,			0, 	0 },
+	{ "hdr_encode_cxx",				b_hdr_enc_xx,			0, 	0 },
+	{ "hdr_decode_c",				b_hdr_dec_c,			0, 	0 },
+	{ "hdr_decode_cxx",				b_hdr_dec_xx,			0, 	0 },
+	{ "hdr_fill_encode_c",			b_hdr_const_c,			0, 	0 },
+	{ "hdr_constexpr_cxx",			b_hdr_const_xx,			0, 	0 },
+	{ "conn_ent_encode_c",			b_conn_enc_c,			0, 	0 },
+	{ "conn_ent_encode_cxx",		b_conn_enc_xx,			0, 	0 },
+	{ "listdev_decode_c_64_short",	b_listdev_dec_c,		64, 8 },
+	{ "listdev_decode_cxx_64_short",b_listdev_dec_xx,		64, 8 },
+	{ "listdev_view_c_64_short",	b_listdev_view_c,		64, 8 },
+	{ "listdev_range_cxx_64_short",	b_listdev_range_xx,		64, 8 },
+	{ NULL, NULL, 0, 0 }
+};
+
+/**
+ * Prepare the shared state for a benchmark
+ */
+static void bench_prep(bench_ctx *c, bench *b)
+{
+	memset(c->msg, 0, sizeof(*c->msg));
+	memset(c->buf, 0, sizeof(*c->buf));
+	emapi_fill_hdr(&c->hdr, EMMT_RSP, 0x42, 0, EMOP_LIST_DEV, 0x100, 0x23, 0x12345678);
+	emapi_enc_hdr(c->buf->hdr, &c->hdr);
+	c->ent = { 0x0123, 0, 0, 0 };
+
+	c->num = b->num;
+	for (unsigned i = 0 ; i < b->num ; i++)
+	{
+		c->msg->obj.dev[i].id = i;
+		c->msg->obj.dev[i].len = b->name_len;
+		memset(c->msg->obj.dev[i].name, 'a' + (i % 26), b->name_len - 1);
+	}
+	c->len = 0;
+	if (b->num > 0)
+		c->len = emapi_serialize(c->buf->payload, c->msg->obj.dev, EMOB_LIST_DEV, &c->num);
+}
+
+/**
+ * Check that the C++ bindings produce the same results as the C API
+ *
+ * @return 	0 on success, the number of mismatches otherwise
+ */
+static int bench_check(bench_ctx *c)
+{
+	__u8 a[EMLN_HDR], b[EMLN_HDR];
+	emapi_hdr h, g;
+	emapi_dev d;
+	emapi_hello o, p;
+	__u8 w[EMLN_HELLO], x[EMLN_HELLO];
+	__u8 big[300];
+	unsigned k;
+	int rv;
+
+	rv = 0;
+
+	// Headers, including the constexpr builder
+	emapi_fill_hdr(&h, EMMT_REQ, 0x42, 0, EMOP_CONN_DEV, 0, 3, 7);
+	emapi_enc_hdr(a, &h);
+	if (emapi::encode(b, h) != EMLN_HDR || memcmp(a, b, EMLN_HDR) || memcmp(a, bxx_wire.data(), EMLN_HDR))
+		rv++;
+	h.ver = EMVER_V2;
+	h.a = 0x1234;
+	emapi_enc_hdr(a, &h);
+	if (memcmp(a, emapi::header(h).wire().data(), EMLN_HDR))
+		rv++;
+	g = emapi::decode<emapi_hdr>(a);
+	if (g.a != 0x1234 || g.ver != EMVER_V2 || emapi::decode(emapi::cbytes(a, EMLN_HDR - 1), g) != 0)
+		rv++;
+
+	// Hello
+	emapi_hello_init(&o, NULL);
+	emapi_enc_hello(w, &o);
+	if (emapi::encode(x, o) != EMLN_HELLO || memcmp(w, x, EMLN_HELLO))
+		rv++;
+	if (emapi::decode(x, p) != EMLN_HELLO || p.ver != o.ver || p.caps != o.caps || p.max_msg != o.max_msg
+		|| memcmp(p.ops, o.ops, sizeof(o.ops)))
+		rv++;
+
+	// List Devices entries and the range adapter
+	bench prep = { "check", NULL, 16, 8 };
+	bench_prep(c, &prep);
+	k = 0;
+	for (const emapi_dev_ref &r : emapi::dev_range({c->buf->payload, c->len}, c->num))
+	{
+		k += emapi::decode(emapi::cbytes(c->buf->payload, c->len).subspan(k), d);
+		if (r.id != d.id || r.len != d.len || memcmp(r.name, d.name, d.len))
+			rv++;
+	}
+	if (k != c->len)
+		rv++;
+	if (emapi::encode(emapi::bytes(a, 4), d) != 0)
+		rv++;
+
+	// A name longer than emapi_dev.name is rejected before it is copied
+	memset(big, 'x', sizeof(big));
+	big[1] = 255;
+	if (emapi::codec<emapi_dev>::need(big, sizeof(big), EMVER_V0) != 0)
+		rv++;
+	if (emapi::decode(emapi::cbytes(big, sizeof(big)), d) != 0)
+		rv++;
+	d.len = EMLN_DEV_NAME + 1;
+	if (emapi::encode(emapi::bytes(big, sizeof(big)), d) != 0 || big[0] != 'x')
+		rv++;
+
+	return rv;
+}
+
+/**
+ * Run a single benchmark and print its statistics
+ */
+static void bench_run(bench_ctx *c, bench *b, unsigned samples, unsigned iters, int first)
+{
+	std::vector<double> ns(samples), cyc(samples);
+	unsigned long long t0, t1, c0, c1;
+	unsigned bytes;
+	double p50;
+
+	bench_prep(c, b);
+
+	// Warm up caches and branch predictors
+	bytes = b->fn(c, iters);
+
+	for (unsigned i = 0 ; i < samples ; i++)
+	{
+		t0 = now_ns();
+		c0 = now_cycles();
+		b->fn(c, iters);
+		c1 = now_cycles();
+		t1 = now_ns();
+		ns[i] = (double) (t1 - t0) / iters;
+		cyc[i] = (double) (c1 - c0) / iters;
+	}
+	std::sort(ns.begin(), ns.end());
+	std::sort(cyc.begin(), cyc.end());
+	p50 = ns[samples / 2];
+
+	if (first)
+		printf("%-32s %6s %9s %9s %9s %9s %9s %9s\n",
+			"benchmark", "bytes", "p50 ns", "p90 ns", "p99 ns", "cycles", "Mops/s", "MB/s");
+	printf("%-32s %6u %9.2f %9.2f %9.2f %9.1f %9.2f %9.1f\n", b->name, bytes,
+		p50, ns[(samples * 90) / 100], ns[(samples * 99) / 100], cyc[samples / 2],
+		p50 > 0 ? 1000.0 / p50 : 0, p50 > 0 ? (bytes * 1000.0) / p50 : 0);
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-s samples] [-n iters] [-l] [filter]\n", prog);
+	printf("  -s  Number of timed samples per benchmark (default %d)\n", BENCH_SAMPLES);
+	printf("  -n  Number of operations per sample (default %d)\n", BENCH_ITERS);
+	printf("  -l  List benchmarks and exit\n");
+	printf("  filter  Only run benchmarks whose name contains this string\n");
+}
+
+int main(int argc, char **argv)
+{
+	bench_ctx ctx;
+	bench *b;
+	unsigned samples, iters;
+	const char *filter;
+	int opt, first;
+
+	samples = BENCH_SAMPLES;
+	iters = BENCH_ITERS;
+	filter = NULL;
+
+	while ( (opt = getopt(argc, argv, "s:n:lh")) != -1 )
+	{
+		switch (opt)
+		{
+			case 's': samples = atoi(optarg); 		break;
+			case 'n': iters = atoi(optarg); 		break;
+			case 'l':
+				for ( b = benches ; b->name != NULL ; b++ )
+					printf("%s\n", b->name);
+				return 0;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (optind < argc)
+		filter = argv[optind];
+	if (samples == 0) 	samples = 1;
+	if (iters == 0) 	iters = 1;
+
+	ctx.msg = new emapi_msg;
+	ctx.buf = new emapi_buf;
+
+	if (bench_check(&ctx))
+	{
+		fprintf(stderr, "ERR: C++ bindings do not match the C API\n");
+		return 1;
+	}
+
+	first = 1;
+	for ( b = benches ; b->name != NULL ; b++ )
+	{
+		if (filter != NULL && strstr(b->name, filter) == NULL)
+			continue;
+		bench_run(&ctx, b, samples, iters, first);
+		first = 0;
+	}
+
+	delete ctx.msg;
+	delete ctx.buf;
+	return 0;
+}
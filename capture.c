@@ -0,0 +1,394 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		capture.c
+ *
+ * @brief 		Code file for the EM API capture ring and capture files
+ *
+ * @details 	Frames sent and received by the server and client are copied
+ *              into a fixed number of fixed size slots. A writer claims a
+ *              slot with a single atomic increment and marks it with a
+ *              sequence number while it copies, so writers never wait on
+ *              each other or on a dump. A dump copies each slot out and
+ *              skips slots that were rewritten while being read.
+ *
+ *              Only the first snaplen bytes of each frame are kept. The
+ *              dump writes the capture file format described by struct
+ *              emapi_cap_hdr, which is read in place by emapi_capfile_*.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* fopen(), fwrite(), fseek()
+ */
+#include <stdio.h>
+
+/* malloc(), free()
+ */
+#include <stdlib.h>
+
+/* memset(), memcpy()
+ */
+#include <string.h>
+
+/* clock_gettime()
+ */
+#include <time.h>
+
+/* open(), close()
+ */
+#include <fcntl.h>
+#include <unistd.h>
+
+/* mmap(), munmap()
+ */
+#include <sys/mman.h>
+
+/* fstat()
+ */
+#include <sys/stat.h>
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+#define EMCP_VER 					2
+#define EMCP_BOM 					0x01020304
+#define EMCP_ALIGN(x) 				(((x) + 7) & ~7ul)
+
+/* ENUMERATIONS ==============================================================*/
+
+/* STRUCTS ===================================================================*/
+
+/**
+ * Capture ring slot
+ */
+struct emcp_slot
+{
+	__u64 seq;						//!< 2n+1 while frame n is written, 2n+2 once complete
+	struct emapi_cap_rec rec;
+	__u8 data[];
+};
+
+/**
+ * Capture ring
+ */
+struct emcp_ring
+{
+	__u8 *mem;						//!< Slots
+	unsigned long bytes;			//!< Size of mem
+	unsigned slots;					//!< Number of slots, a power of 2
+	unsigned snaplen;				//!< Bytes of each frame kept
+	unsigned stride;				//!< Bytes between slots
+	__u64 next;						//!< Number of frames claimed so far
+};
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+int emapi_capture_on;
+
+static struct emcp_ring ring;
+
+/* PROTOTYPES ================================================================*/
+
+/* FUNCTIONS =================================================================*/
+
+static inline struct emcp_slot *emcp_slot(__u64 n)
+{
+	return (struct emcp_slot*) &ring.mem[(n & (ring.slots - 1)) * ring.stride];
+}
+
+/**
+ * Allocate the capture ring and start capturing
+ *
+ * Call before traffic starts. A ring already allocated is released.
+ *
+ * @param 	slots 	Frames kept, rounded up to a power of 2
+ * @param 	snaplen Bytes of each frame kept. 0 for EMLN_CAP_SNAP
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_capture_init(unsigned slots, unsigned snaplen)
+{
+	unsigned n;
+
+	emapi_capture_free();
+
+	if (snaplen == 0)
+		snaplen = EMLN_CAP_SNAP;
+	if (snaplen > EMLN_MSG || slots == 0 || slots > (1u << 24))
+		return 1;
+
+	for ( n = 1 ; n < slots ; n *= 2 )
+		;
+
+	ring.slots = n;
+	ring.snaplen = snaplen;
+	ring.stride = (sizeof(struct emcp_slot) + snaplen + 63) & ~63u;
+	ring.bytes = (unsigned long) ring.slots * ring.stride;
+	ring.next = 0;
+
+	ring.mem = mmap(NULL, ring.bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring.mem == MAP_FAILED)
+	{
+		ring.mem = NULL;
+		return 1;
+	}
+
+	emapi_capture_enable(1);
+	return 0;
+}
+
+/**
+ * Pause or resume capturing
+ *
+ * @param 	on 		Non zero to capture. Ignored until emapi_capture_init()
+ */
+void emapi_capture_enable(int on)
+{
+	__atomic_store_n(&emapi_capture_on, (on && ring.mem != NULL) ? 1 : 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Store a frame in the capture ring
+ *
+ * Only call while emapi_capture_on is set. Safe to call from any thread.
+ *
+ * @param 	side 	[EMSK] client or server
+ * @param 	conn 	Connection identifier
+ * @param 	dir 	[EMCD] direction
+ * @param 	hdr 	Serialized header of EMLN_HDR bytes
+ * @param 	payload Serialized payload
+ * @param 	len 	Length of the payload
+ */
+void emapi_capture(unsigned side, unsigned conn, unsigned dir, __u8 *hdr, __u8 *payload, unsigned len)
+{
+	struct emcp_slot *sl;
+	unsigned cap, n;
+	__u64 seq;
+
+	if (ring.mem == NULL)
+		return;
+
+	seq = __atomic_fetch_add(&ring.next, 1, __ATOMIC_RELAXED);
+	sl = emcp_slot(seq);
+
+	__atomic_store_n(&sl->seq, 2 * seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	cap = EMLN_HDR + len;
+	if (cap > ring.snaplen)
+		cap = ring.snaplen;
+
+	sl->rec.ts = emapi_now_ns();
+	sl->rec.conn = conn;
+	sl->rec.caplen = cap;
+	sl->rec.dir = dir;
+	sl->rec.side = side;
+	sl->rec.len = EMLN_HDR + len;
+	sl->rec.rsvd = 0;
+
+	n = cap < EMLN_HDR ? cap : EMLN_HDR;
+	memcpy(sl->data, hdr, n);
+	if (cap > EMLN_HDR)
+		memcpy(&sl->data[EMLN_HDR], payload, cap - EMLN_HDR);
+
+	__atomic_store_n(&sl->seq, 2 * seq + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * Write the frames held by the capture ring to a file, oldest first
+ *
+ * Capturing continues during the dump. Frames overwritten while the dump
+ * reads them are counted as dropped.
+ *
+ * @param 	path 	File to create
+ * @return 	number of records written, -1 upon error
+ */
+long emapi_capture_dump(const char *path)
+{
+	static const __u8 zero[8];
+	struct emapi_cap_hdr h;
+	struct emcp_slot *sl;
+	struct timespec rt, mt;
+	__u64 n, first, last, s1;
+	unsigned pad;
+	__u8 *tmp;
+	FILE *fp;
+	long rv;
+
+	// Initialize variables
+	rv = -1;
+	tmp = NULL;
+	fp = NULL;
+
+	// Validate Inputs
+	if (path == NULL || ring.mem == NULL)
+		goto end;
+
+	tmp = (__u8*) malloc(ring.stride);
+	if (tmp == NULL)
+		goto end;
+
+	fp = fopen(path, "wb");
+	if (fp == NULL)
+		goto end;
+
+	last = __atomic_load_n(&ring.next, __ATOMIC_ACQUIRE);
+	first = last > ring.slots ? last - ring.slots : 0;
+
+	clock_gettime(CLOCK_REALTIME, &rt);
+	clock_gettime(CLOCK_MONOTONIC, &mt);
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "EMCAP", 6);
+	h.ver = EMCP_VER;
+	h.bom = EMCP_BOM;
+	h.snaplen = ring.snaplen;
+	h.dropped = first;
+	h.epoch = ((__s64) rt.tv_sec - mt.tv_sec) * 1000000000ll + ((__s64) rt.tv_nsec - mt.tv_nsec);
+	if (fwrite(&h, sizeof(h), 1, fp) != 1)
+		goto end;
+
+	for ( n = first ; n < last ; n++ )
+	{
+		sl = emcp_slot(n);
+
+		// Copy the slot out, then make sure no writer touched it meanwhile
+		s1 = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE);
+		if (s1 != 2 * n + 2)
+		{
+			h.dropped++;
+			continue;
+		}
+		memcpy(tmp, sl, sizeof(*sl) + sl->rec.caplen);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&sl->seq, __ATOMIC_RELAXED) != s1)
+		{
+			h.dropped++;
+			continue;
+		}
+
+		sl = (struct emcp_slot*) tmp;
+		pad = EMCP_ALIGN(sl->rec.caplen) - sl->rec.caplen;
+		if (fwrite(&sl->rec, sizeof(sl->rec) + sl->rec.caplen, 1, fp) != 1)
+			goto end;
+		if (pad > 0 && fwrite(zero, pad, 1, fp) != 1)
+			goto end;
+		h.count++;
+	}
+
+	// Fill in the totals
+	if (fseek(fp, 0, SEEK_SET) || fwrite(&h, sizeof(h), 1, fp) != 1)
+		goto end;
+
+	rv = h.count;
+
+end:
+
+	if (fp != NULL && fclose(fp) && rv >= 0)
+		rv = -1;
+	free(tmp);
+	return rv;
+}
+
+/**
+ * Stop capturing and release the capture ring
+ *
+ * No thread may be inside emapi_capture() when this is called.
+ */
+void emapi_capture_free(void)
+{
+	emapi_capture_enable(0);
+	if (ring.mem != NULL)
+		munmap(ring.mem, ring.bytes);
+	memset(&ring, 0, sizeof(ring));
+}
+
+/**
+ * Map a capture file for reading
+ *
+ * Files written on a host of the other byte order are rejected.
+ *
+ * @param[out] 	f 		struct emapi_capfile* to initialize
+ * @param 		path 	Capture file
+ * @return 		0 upon success, non zero otherwise
+ */
+int emapi_capfile_open(struct emapi_capfile *f, const char *path)
+{
+	struct stat st;
+	void *p;
+	int fd;
+
+	memset(f, 0, sizeof(*f));
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 1;
+
+	if (fstat(fd, &st) || (unsigned long) st.st_size < sizeof(struct emapi_cap_hdr))
+	{
+		close(fd);
+		return 1;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return 1;
+
+	f->hdr = (struct emapi_cap_hdr*) p;
+	f->size = st.st_size;
+	f->off = sizeof(struct emapi_cap_hdr);
+
+	if (memcmp(f->hdr->magic, "EMCAP", 6) || f->hdr->ver != EMCP_VER || f->hdr->bom != EMCP_BOM)
+	{
+		emapi_capfile_close(f);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Advance to the next record of a capture file
+ *
+ * @param 		f 		struct emapi_capfile*
+ * @param[out] 	r 		Set to the record. The frame follows it
+ * @return 		1 if a record was returned, 0 at the end, -1 if the file is corrupt
+ */
+int emapi_capfile_next(struct emapi_capfile *f, struct emapi_cap_rec **r)
+{
+	struct emapi_cap_rec *rec;
+
+	if (f->idx >= f->hdr->count)
+		return 0;
+
+	if (f->off + sizeof(*rec) > f->size)
+		return -1;
+
+	rec = (struct emapi_cap_rec*) ((__u8*) f->hdr + f->off);
+	if (rec->caplen > f->hdr->snaplen || rec->caplen > rec->len
+		|| f->off + sizeof(*rec) + EMCP_ALIGN(rec->caplen) > f->size)
+		return -1;
+
+	f->off += sizeof(*rec) + EMCP_ALIGN(rec->caplen);
+	f->idx++;
+	*r = rec;
+	return 1;
+}
+
+/**
+ * Unmap a capture file
+ *
+ * @param 	f 		struct emapi_capfile*
+ */
+void emapi_capfile_close(struct emapi_capfile *f)
+{
+	if (f->hdr != NULL)
+		munmap(f->hdr, f->size);
+	memset(f, 0, sizeof(*f));
+}
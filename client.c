@@ -0,0 +1,525 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		client.c
+ *
+ * @brief 		Code file for the EM API asynchronous client
+ *
+ * @details 	Requests are tagged with one of EMLN_TAGS tags so that many
+ *              requests can be in flight on one connection. Responses are
+ *              matched to their request through a completion table indexed
+ *              by tag and delivered to the callback given at submission.
+ *
+ *              The client is not thread safe. Drive it from one thread with
+ *              emapi_client_poll(), or add emapi_client_fd() to an existing
+ *              poll loop and call emapi_client_process() when it is ready.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* malloc(), free()
+ */
+#include <stdlib.h>
+
+/* memset(), memcpy(), memmove()
+ */
+#include <string.h>
+
+/* Return error codes from functions
+ */
+#include <errno.h>
+
+/* read(), write(), close()
+ */
+#include <unistd.h>
+
+/* fcntl()
+ */
+#include <fcntl.h>
+
+/* poll()
+ */
+#include <poll.h>
+
+/* send()
+ */
+#include <sys/socket.h>
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+/* ENUMERATIONS ==============================================================*/
+
+/* STRUCTS ===================================================================*/
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+/* PROTOTYPES ================================================================*/
+
+/* FUNCTIONS =================================================================*/
+
+/**
+ * Features assumed for a server that does not answer EMOP_HELLO
+ */
+static void emcl_hello_v0(struct emapi_hello *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->ver = EMVER_V0;
+	h->max_msg = EMLN_MSG;
+	h->ops[0] = (1 << EMOP_LIST_DEV) | (1 << EMOP_CONN_DEV) | (1 << EMOP_DISCON_DEV);
+}
+
+/**
+ * Initialize a client on an already connected socket
+ *
+ * The client takes ownership of the descriptor and makes it non-blocking
+ *
+ * @param 	c 		struct emapi_client* to initialize
+ * @param 	fd 		Connected stream socket
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_client_init(struct emapi_client *c, int fd)
+{
+	unsigned i;
+	int fl;
+
+	memset(c, 0, sizeof(*c));
+	c->fd = -1;
+
+	fl = fcntl(fd, F_GETFL);
+	if (fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK))
+		return 1;
+
+	c->rbuf = (__u8*) malloc(EMLN_RX_BUF);
+	if (c->rbuf == NULL)
+		return 1;
+
+	c->fd = fd;
+	emapi_framer_init(&c->rx);
+	emcl_hello_v0(&c->peer);
+
+	// Hand out low tags first
+	for ( i = 0 ; i < EMLN_TAGS ; i++ )
+		c->free[i] = EMLN_TAGS - 1 - i;
+	c->nfree = EMLN_TAGS;
+
+	return 0;
+}
+
+/**
+ * Connect to a server and initialize a client
+ *
+ * @param 	c 		struct emapi_client* to initialize
+ * @param 	addr 	Address in the format accepted by emapi_connect()
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_client_open(struct emapi_client *c, const char *addr)
+{
+	int fd;
+
+	fd = emapi_connect(addr);
+	if (fd < 0)
+		return 1;
+
+	if (emapi_client_init(c, fd))
+	{
+		close(fd);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Complete every request in flight with a NULL response
+ */
+static void emcl_abort(struct emapi_client *c)
+{
+	struct emapi_client_req *r;
+	unsigned i;
+
+	for ( i = 0 ; i < EMLN_TAGS ; i++ )
+	{
+		r = &c->req[i];
+		if (!r->busy)
+			continue;
+		r->busy = 0;
+		c->free[c->nfree++] = i;
+		c->inflight--;
+		if (r->fn != NULL)
+			r->fn(c, NULL, r->arg);
+	}
+}
+
+/**
+ * Close the connection and release the client resources
+ *
+ * Requests still in flight complete with a NULL response
+ *
+ * @param 	c 		struct emapi_client*
+ */
+void emapi_client_close(struct emapi_client *c)
+{
+	if (c->fd >= 0)
+		close(c->fd);
+	c->fd = -1;
+
+	emcl_abort(c);
+
+	free(c->rbuf);
+	free(c->tx);
+	c->rbuf = NULL;
+	c->tx = NULL;
+	c->tx_off = c->tx_len = c->tx_cap = 0;
+}
+
+/**
+ * Reserve room for len more bytes in the transmit buffer
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+static int emcl_tx_reserve(struct emapi_client *c, unsigned len)
+{
+	unsigned cap;
+	__u8 *p;
+
+	if (c->tx_off > 0 && c->tx_off == c->tx_len)
+		c->tx_off = c->tx_len = 0;
+
+	if (c->tx_len + len <= c->tx_cap)
+		return 0;
+
+	if (c->tx_off > 0)
+	{
+		memmove(c->tx, &c->tx[c->tx_off], c->tx_len - c->tx_off);
+		c->tx_len -= c->tx_off;
+		c->tx_off = 0;
+		if (c->tx_len + len <= c->tx_cap)
+			return 0;
+	}
+
+	cap = c->tx_cap ? c->tx_cap : EMLN_MSG;
+	while (cap < c->tx_len + len)
+		cap *= 2;
+	p = (__u8*) realloc(c->tx, cap);
+	if (p == NULL)
+		return 1;
+	c->tx = p;
+	c->tx_cap = cap;
+	return 0;
+}
+
+/**
+ * Queue a request
+ *
+ * A free tag is written into h->tag. The request is sent by the next call
+ * to emapi_client_flush(), emapi_client_process() or emapi_client_poll().
+ *
+ * @param 	c 		struct emapi_client*
+ * @param 	h 		struct emapi_hdr* of the request. h->len must be the payload length
+ * @param 	payload Serialized payload or NULL if h->len is 0
+ * @param 	fn 		Called with the response, or with NULL if the connection fails
+ * @param 	arg 	Passed to fn
+ * @return 	tag assigned to the request, -1 upon error (errno EBUSY if all tags are in use)
+ */
+int emapi_client_submit(struct emapi_client *c, struct emapi_hdr *h, __u8 *payload, emapi_cb_fn fn, void *arg)
+{
+	struct emapi_client_req *r;
+	unsigned tag;
+
+	if (c->fd < 0 || h->len > EMLN_PAYLOAD || (h->len > 0 && payload == NULL))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (c->nfree == 0)
+	{
+		errno = EBUSY;
+		return -1;
+	}
+	if (emcl_tx_reserve(c, EMLN_HDR + h->len))
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+
+	tag = c->free[--c->nfree];
+	r = &c->req[tag];
+	r->fn = fn;
+	r->arg = arg;
+	r->opcode = h->opcode;
+	r->busy = 1;
+	r->t0 = emapi_stats_on ? emapi_now_ns() : 0;
+	c->inflight++;
+
+	h->tag = tag;
+	emapi_enc_hdr(&c->tx[c->tx_len], h);
+	if (emapi_capture_on)
+		emapi_capture(EMSK_CLIENT, c->fd, EMCD_TX, &c->tx[c->tx_len], payload, h->len);
+	c->tx_len += EMLN_HDR;
+	if (h->len > 0)
+	{
+		memcpy(&c->tx[c->tx_len], payload, h->len);
+		c->tx_len += h->len;
+	}
+
+	return tag;
+}
+
+/**
+ * Write as much of the queued requests as the socket accepts
+ *
+ * @param 	c 		struct emapi_client*
+ * @return 	0 upon success, non zero if the connection failed
+ */
+int emapi_client_flush(struct emapi_client *c)
+{
+	ssize_t n;
+
+	while (c->tx_off < c->tx_len)
+	{
+		n = send(c->fd, &c->tx[c->tx_off], c->tx_len - c->tx_off, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == EAGAIN)
+			return 0;
+		if (n <= 0)
+			return 1;
+		c->tx_off += n;
+	}
+	c->tx_off = c->tx_len = 0;
+	return 0;
+}
+
+/**
+ * Deliver a response to the request with a matching tag
+ */
+static void emcl_complete(struct emapi_client *c, struct emapi_frame *f)
+{
+	struct emapi_client_req *r;
+	emapi_cb_fn fn;
+	void *arg;
+
+	r = &c->req[f->hdr.tag];
+
+	// Ignore responses that do not match a request in flight
+	if (!r->busy || f->hdr.type != EMMT_RSP)
+		return;
+
+	if (r->t0 != 0)
+		emapi_stats_record(EMSK_CLIENT, r->opcode, f->hdr.rc, emapi_now_ns() - r->t0);
+
+	fn = r->fn;
+	arg = r->arg;
+
+	// Release the tag first so the callback may submit a new request
+	r->busy = 0;
+	c->free[c->nfree++] = f->hdr.tag;
+	c->inflight--;
+
+	if (fn != NULL)
+		fn(c, f, arg);
+}
+
+/**
+ * Send queued requests and deliver all responses received so far
+ *
+ * Does not block
+ *
+ * @param 	c 		struct emapi_client*
+ * @return 	number of responses delivered, -1 if the connection failed
+ */
+int emapi_client_process(struct emapi_client *c)
+{
+	struct emapi_env_view v;
+	struct emapi_frame f, inner;
+	ssize_t n;
+	int rv, cnt;
+
+	if (c->fd < 0)
+		return -1;
+
+	if (emapi_client_flush(c))
+		goto fail;
+
+	cnt = 0;
+	for (;;)
+	{
+		n = read(c->fd, c->rbuf, EMLN_RX_BUF);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == EAGAIN)
+			break;
+		if (n <= 0)
+			goto fail;
+
+		emapi_framer_feed(&c->rx, c->rbuf, n);
+		while ( (rv = emapi_framer_next(&c->rx, &f)) == 1 )
+		{
+			if (emapi_capture_on)
+				emapi_capture(EMSK_CLIENT, c->fd, EMCD_RX, f.buf, f.payload, f.hdr.len);
+
+			if (f.hdr.opcode != EMOP_ENVELOPE)
+			{
+				emcl_complete(c, &f);
+				cnt++;
+				continue;
+			}
+
+			// Responses packed in an envelope
+			if (emapi_env_view_init(&v, &f))
+				goto fail;
+			while ( (rv = emapi_env_next(&v, &inner)) == 1 )
+			{
+				emcl_complete(c, &inner);
+				cnt++;
+			}
+			if (rv < 0)
+				goto fail;
+		}
+		if (rv < 0)
+			goto fail;
+		if (n < EMLN_RX_BUF)
+			break;
+	}
+
+	// Callbacks may have queued new requests
+	if (emapi_client_flush(c))
+		goto fail;
+
+	return cnt;
+
+fail:
+
+	close(c->fd);
+	c->fd = -1;
+	emcl_abort(c);
+	return -1;
+}
+
+/**
+ * Wait up to timeout_ms for the connection to become ready, then process it
+ *
+ * @param 	c 			struct emapi_client*
+ * @param 	timeout_ms 	Milliseconds to wait, -1 to wait forever
+ * @return 	number of responses delivered, -1 if the connection failed
+ */
+int emapi_client_poll(struct emapi_client *c, int timeout_ms)
+{
+	struct pollfd p;
+
+	if (c->fd < 0)
+		return -1;
+
+	p.fd = c->fd;
+	p.events = POLLIN | (c->tx_off < c->tx_len ? POLLOUT : 0);
+	p.revents = 0;
+
+	if (poll(&p, 1, timeout_ms) < 0 && errno != EINTR)
+		return -1;
+
+	return emapi_client_process(c);
+}
+
+/**
+ * Block until every request in flight has completed
+ *
+ * @param 	c 		struct emapi_client*
+ * @return 	0 upon success, non zero if the connection failed
+ */
+int emapi_client_wait(struct emapi_client *c)
+{
+	while (c->inflight > 0)
+		if (emapi_client_poll(c, -1) < 0)
+			return 1;
+	return 0;
+}
+
+/**
+ * Completion of the EMOP_HELLO request sent by emapi_client_hello()
+ */
+static void emcl_hello_done(struct emapi_client *c, struct emapi_frame *rsp, void *arg)
+{
+	struct emapi_hello h;
+	int *rc = (int*) arg;
+
+	if (rsp == NULL)
+		return;
+
+	if (rsp->hdr.rc != EMRC_SUCCESS || rsp->hdr.len < EMLN_HELLO)
+	{
+		emcl_hello_v0(&c->peer);
+		*rc = rsp->hdr.rc != EMRC_SUCCESS ? rsp->hdr.rc : EMRC_INVALID_INPUT;
+		return;
+	}
+
+	emapi_dec_hello(&h, rsp->payload);
+	emapi_hello_merge(&c->peer, &c->peer, &h);
+	*rc = 0;
+}
+
+/**
+ * Exchange features with the server and store the common set in c->peer
+ *
+ * Blocks until the response arrives. The request uses header version 
+ * EMVER_V0 so that servers of any version can answer it.
+ *
+ * @param 	c 		struct emapi_client*
+ * @param 	own 	Features of this end, NULL for those of this library
+ * @return 	0 upon success, EMRC_UNSUPPORTED if the server does not answer 
+ * 			EMOP_HELLO, other non zero values upon error
+ */
+int emapi_client_hello(struct emapi_client *c, const struct emapi_hello *own)
+{
+	struct emapi_hdr h;
+	__u8 buf[EMLN_HELLO];
+	int rc;
+
+	// Initialize variables
+	rc = -1;
+
+	if (own != NULL)
+		memcpy(&c->peer, own, sizeof(c->peer));
+	else 
+		emapi_hello_init(&c->peer, NULL);
+
+	emapi_enc_hello(buf, &c->peer);
+	emapi_fill_hdr(&h, EMMT_REQ, 0, 0, EMOP_HELLO, EMLN_HELLO, 0, 0);
+	if (emapi_client_submit(c, &h, buf, emcl_hello_done, &rc) < 0)
+		goto fail;
+
+	if (emapi_client_wait(c) || rc < 0)
+		goto fail;
+
+	return rc;
+
+fail:
+
+	emcl_hello_v0(&c->peer);
+	return -1;
+}
+
+/**
+ * Descriptor to poll for readiness
+ *
+ * Poll for POLLIN, and for POLLOUT while emapi_client_pending() is non zero
+ *
+ * @param 	c 		struct emapi_client*
+ * @return 	file descriptor
+ */
+int emapi_client_fd(struct emapi_client *c)
+{
+	return c->fd;
+}
+
+/**
+ * Number of bytes queued but not yet written
+ */
+unsigned emapi_client_pending(struct emapi_client *c)
+{
+	return c->tx_len - c->tx_off;
+}
@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		dispatch.c
+ *
+ * @brief 		Code file for server side EM API opcode dispatch
+ *
+ * @details 	Handlers are kept in a flat table indexed by opcode along with
+ *              the rules used to validate a request before the handler is
+ *              called, so dispatching a request is a single table lookup.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* memset(), memcpy()
+ */
+#include <string.h>
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+/* ENUMERATIONS ==============================================================*/
+
+/* STRUCTS ===================================================================*/
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+/* PROTOTYPES ================================================================*/
+
+/* FUNCTIONS =================================================================*/
+
+/**
+ * EMOP_HELLO: Answer with the features of this library and the opcodes 
+ * registered in the table at the time of the request
+ */
+static void emds_hello(struct emapi_conn *c, struct emapi_frame *f, void *arg)
+{
+	struct emapi_hello h;
+	__u8 buf[EMLN_HELLO];
+
+	emapi_hello_init(&h, (struct emapi_ops*) arg);
+	emapi_enc_hello(buf, &h);
+	emapi_conn_reply(c, &f->hdr, EMRC_SUCCESS, 0, 0, buf, EMLN_HELLO);
+}
+
+/**
+ * Clear an opcode handler table
+ *
+ * EMOP_HELLO is answered by a built-in handler, which may be replaced with 
+ * emapi_ops_register(). Every other opcode answers EMRC_UNSUPPORTED.
+ *
+ * @param 	t 		struct emapi_ops* table
+ */
+void emapi_ops_init(struct emapi_ops *t)
+{
+	memset(t, 0, sizeof(*t));
+	emapi_ops_register(t, EMOP_HELLO, emds_hello, t, NULL);
+}
+
+/**
+ * Register a handler for an opcode
+ *
+ * @param 	t 		struct emapi_ops* table
+ * @param 	opcode 	Opcode to handle [EMOP]. Values above EMOP_MAX are allowed
+ * @param 	fn 		Handler
+ * @param 	arg 	Passed to fn
+ * @param 	info 	Validation rules, NULL to use the rules of a built-in opcode
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_ops_register(struct emapi_ops *t, unsigned opcode, emapi_op_fn fn, void *arg, const struct emapi_opinfo *info)
+{
+	// Validate Inputs
+	if ( (t == NULL) || (fn == NULL) || (opcode > 0xFF) )
+		return 1;
+
+	if (info == NULL)
+		info = emapi_opinfo(opcode);
+	if (info == NULL)
+		return 1;
+
+	t->op[opcode].fn = fn;
+	t->op[opcode].arg = arg;
+	memcpy(&t->op[opcode].info, info, sizeof(*info));
+
+	return 0;
+}
+
+/**
+ * Validate a request and call the handler registered for its opcode
+ *
+ * Requests with a header version newer than EMVER_V2 are answered 
+ * EMRC_UNSUPPORTED.
+ *
+ * @param 	c 		struct emapi_conn* the request arrived on
+ * @param 	f 		struct emapi_frame* holding the request
+ * @param 	arg 	struct emapi_ops* table
+ */
+void emapi_ops_dispatch(struct emapi_conn *c, struct emapi_frame *f, void *arg)
+{
+	struct emapi_ops *t = (struct emapi_ops*) arg;
+	struct emapi_op *op;
+	struct emapi_hdr *h;
+	unsigned bad;
+
+	h = &f->hdr;
+	op = &t->op[h->opcode];
+
+	// Only requests are dispatched
+	if (h->type != EMMT_REQ)
+		return;
+
+	if (op->fn == NULL || h->ver > EMVER_V2)
+	{
+		emapi_conn_reply(c, h, EMRC_UNSUPPORTED, 0, 0, NULL, 0);
+		return;
+	}
+
+	bad = (h->len < op->info.min_len) | (h->len > op->info.max_len);
+	if (op->info.flags & EMOF_CHK_IMM)
+		bad |= (h->a > op->info.max_a) | (h->b > op->info.max_b);
+	if (op->info.ent_len)
+		bad |= (h->len != h->a * op->info.ent_len);
+
+	if (bad)
+	{
+		emapi_conn_reply(c, h, EMRC_INVALID_INPUT, 0, 0, NULL, 0);
+		return;
+	}
+
+	op->fn(c, f, op->arg);
+}
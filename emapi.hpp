@@ -0,0 +1,321 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		emapi.hpp
+ *
+ * @brief 		Optional C++17 bindings for the EM API codec
+ *
+ * @details 	emapi::encode<T>() and emapi::decode<T>() select the codec of
+ *              an object type at compile time and call the inline functions
+ *              of emapi_inline.h, so they compile to the same code as calling
+ *              those functions from C. Buffers are passed as spans, which
+ *              are std::span when available and a minimal equivalent
+ *              otherwise. emapi::header builds headers in constant
+ *              expressions and emapi::dev_range iterates over a List Devices
+ *              payload without copying it.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+#ifndef _EMAPI_HPP
+#define _EMAPI_HPP
+
+/* INCLUDES ==================================================================*/
+
+/* std::array
+ */
+#include <array>
+
+/* std::size_t
+ */
+#include <cstddef>
+
+/* std::span when compiled as C++20
+ */
+#if __has_include(<span>) && __cplusplus >= 202002L
+#include <span>
+#endif
+
+/* The library header is installed as emapi.h
+ */
+#if __has_include("emapi.h")
+#include "emapi.h"
+#else
+#include "main.h"
+#endif
+
+namespace emapi {
+
+/* SPANS =====================================================================*/
+
+#if defined(__cpp_lib_span)
+
+using bytes = std::span<__u8>;
+using cbytes = std::span<const __u8>;
+
+#else
+
+/**
+ * Contiguous range of T used when std::span is not available
+ */
+template <class T>
+class span
+{
+public:
+	constexpr span() noexcept : p_(nullptr), n_(0) {}
+	constexpr span(T *p, std::size_t n) noexcept : p_(p), n_(n) {}
+	template <std::size_t N>
+	constexpr span(T (&a)[N]) noexcept : p_(a), n_(N) {}
+	template <class U, std::size_t N>
+	constexpr span(std::array<U, N> &a) noexcept : p_(a.data()), n_(N) {}
+	template <class U, std::size_t N>
+	constexpr span(const std::array<U, N> &a) noexcept : p_(a.data()), n_(N) {}
+	template <class U>
+	constexpr span(const span<U> &s) noexcept : p_(s.data()), n_(s.size()) {}
+
+	constexpr T *data() const noexcept { return p_; }
+	constexpr std::size_t size() const noexcept { return n_; }
+	constexpr bool empty() const noexcept { return n_ == 0; }
+	constexpr T &operator[](std::size_t i) const noexcept { return p_[i]; }
+	constexpr T *begin() const noexcept { return p_; }
+	constexpr T *end() const noexcept { return p_ + n_; }
+	constexpr span subspan(std::size_t off) const noexcept { return span(p_ + off, n_ - off); }
+
+private:
+	T *p_;
+	std::size_t n_;
+};
+
+using bytes = span<__u8>;
+using cbytes = span<const __u8>;
+
+#endif
+
+/* CODECS ====================================================================*/
+
+/**
+ * Codec of an object type. Only the specializations below exist, so
+ * encoding an unsupported type fails to compile.
+ *
+ * Each specialization provides:
+ * - type: the [EMOB] object identifier
+ * - size(o, ver): bytes needed to encode o
+ * - need(src, n, ver): bytes needed to decode the object at src, given n
+ *   readable bytes, or 0 if n is too short to tell or the object is malformed
+ * - enc(dst, o, ver) and dec(src, o, ver): the functions of emapi_inline.h
+ */
+template <class T>
+struct codec;
+
+template <>
+struct codec<emapi_hdr>
+{
+	static constexpr unsigned type = EMOB_HDR;
+	static constexpr std::size_t size(const emapi_hdr &, unsigned) noexcept { return EMLN_HDR; }
+	static constexpr std::size_t need(const __u8 *, std::size_t, unsigned) noexcept { return EMLN_HDR; }
+	static int enc(__u8 *dst, const emapi_hdr &o, unsigned) noexcept { return emapi_enc_hdr(dst, &o); }
+	static int dec(const __u8 *src, emapi_hdr &o, unsigned) noexcept { return emapi_dec_hdr(&o, src); }
+};
+
+template <>
+struct codec<emapi_dev>
+{
+	static constexpr unsigned type = EMOB_LIST_DEV;
+	static constexpr std::size_t idlen(unsigned ver) noexcept { return ver >= EMVER_V2 ? 4 : 1; }
+	static constexpr std::size_t size(const emapi_dev &o, unsigned ver) noexcept { return idlen(ver) + 1 + o.len; }
+	static constexpr std::size_t need(const __u8 *src, std::size_t n, unsigned ver) noexcept
+	{
+		// A name that does not fit emapi_dev.name is malformed
+		if (n <= idlen(ver) || src[idlen(ver)] > EMLN_DEV_NAME)
+			return 0;
+		return idlen(ver) + 1 + src[idlen(ver)];
+	}
+	static int enc(__u8 *dst, const emapi_dev &o, unsigned ver) noexcept { return emapi_enc_dev(dst, &o, ver); }
+	static int dec(const __u8 *src, emapi_dev &o, unsigned ver) noexcept { return emapi_dec_dev(&o, src, ver); }
+};
+
+template <>
+struct codec<emapi_conn_ent>
+{
+	static constexpr unsigned type = EMOB_CONN_BATCH;
+	static constexpr std::size_t size(const emapi_conn_ent &, unsigned) noexcept { return EMLN_CONN_ENT; }
+	static constexpr std::size_t need(const __u8 *, std::size_t, unsigned) noexcept { return EMLN_CONN_ENT; }
+	static int enc(__u8 *dst, const emapi_conn_ent &o, unsigned ver) noexcept { return emapi_enc_conn_ent(dst, &o, ver); }
+	static int dec(const __u8 *src, emapi_conn_ent &o, unsigned ver) noexcept { return emapi_dec_conn_ent(&o, src, ver); }
+};
+
+template <>
+struct codec<emapi_hello>
+{
+	static constexpr unsigned type = EMOB_HELLO;
+	static constexpr std::size_t size(const emapi_hello &, unsigned) noexcept { return EMLN_HELLO; }
+	static constexpr std::size_t need(const __u8 *, std::size_t, unsigned) noexcept { return EMLN_HELLO; }
+	static int enc(__u8 *dst, const emapi_hello &o, unsigned) noexcept { return emapi_enc_hello(dst, &o); }
+	static int dec(const __u8 *src, emapi_hello &o, unsigned) noexcept { return emapi_dec_hello(&o, src); }
+};
+
+/**
+ * Encode an object
+ *
+ * @param 	dst 	Destination bytes
+ * @param 	o 		Object to encode
+ * @param 	ver 	Header version [EMVER] of the message. Headers use their own
+ * @return 	bytes written, 0 if dst is too small or o is malformed
+ */
+template <class T>
+inline std::size_t encode(bytes dst, const T &o, unsigned ver = EMVER_V0) noexcept
+{
+	if (codec<T>::size(o, ver) > dst.size())
+		return 0;
+	int rv = codec<T>::enc(dst.data(), o, ver);
+	return rv < 0 ? 0 : rv;
+}
+
+/**
+ * Decode an object
+ *
+ * @param 	src 	Source bytes
+ * @param 	o 		Object to fill in
+ * @param 	ver 	Header version [EMVER] of the message. Headers use their own
+ * @return 	bytes consumed, 0 if src is too short or malformed
+ */
+template <class T>
+inline std::size_t decode(cbytes src, T &o, unsigned ver = EMVER_V0) noexcept
+{
+	std::size_t n = codec<T>::need(src.data(), src.size(), ver);
+	if (n == 0 || n > src.size())
+		return 0;
+	int rv = codec<T>::dec(src.data(), o, ver);
+	return rv < 0 ? 0 : rv;
+}
+
+/**
+ * Decode an object that is known to fit, e.g. a header of a complete frame
+ */
+template <class T>
+inline T decode(const __u8 *src, unsigned ver = EMVER_V0) noexcept
+{
+	T o;
+	codec<T>::dec(src, o, ver);
+	return o;
+}
+
+/* HEADER BUILDER ============================================================*/
+
+/**
+ * Header builder usable in constant expressions
+ *
+ * constexpr auto h = emapi::header().opcode(EMOP_CONN_DEV).a(3).b(7);
+ * constexpr auto w = h.wire();
+ */
+class header
+{
+public:
+	constexpr header() noexcept : h_{} {}
+	constexpr header(const emapi_hdr &h) noexcept : h_(h) {}
+
+	constexpr header &type(unsigned v) noexcept { h_.type = v; return *this; }
+	constexpr header &ver(unsigned v) noexcept { h_.ver = v; return *this; }
+	constexpr header &tag(unsigned v) noexcept { h_.tag = v; return *this; }
+	constexpr header &rc(unsigned v) noexcept { h_.rc = v; return *this; }
+	constexpr header &opcode(unsigned v) noexcept { h_.opcode = v; return *this; }
+	constexpr header &a(unsigned v) noexcept { h_.a = v; return *this; }
+	constexpr header &len(unsigned v) noexcept { h_.len = v; return *this; }
+	constexpr header &b(__u32 v) noexcept { h_.b = v; return *this; }
+
+	constexpr const emapi_hdr &get() const noexcept { return h_; }
+	constexpr operator emapi_hdr() const noexcept { return h_; }
+
+	/**
+	 * Serialized header. Same bytes as emapi_enc_hdr()
+	 */
+	constexpr std::array<__u8, EMLN_HDR> wire() const noexcept
+	{
+		std::array<__u8, EMLN_HDR> d{};
+		d[ 0] = ((h_.ver << 4) & 0xF0) | (h_.type & 0x0F);
+		d[ 1] = h_.tag;
+		d[ 2] = h_.rc;
+		d[ 3] = h_.opcode;
+		d[ 4] = (h_.a        ) & 0x00FF;
+		d[ 5] = h_.ver >= EMVER_V2 ? (h_.a >> 8) & 0x00FF : 0;
+		d[ 6] = (h_.len      ) & 0x00FF;
+		d[ 7] = (h_.len >> 8 ) & 0x00FF;
+		d[ 8] = (h_.b        ) & 0x00FF;
+		d[ 9] = (h_.b   >>  8) & 0x00FF;
+		d[10] = (h_.b   >> 16) & 0x00FF;
+		d[11] = (h_.b   >> 24) & 0x00FF;
+		return d;
+	}
+
+private:
+	emapi_hdr h_;
+};
+
+/* RANGES ====================================================================*/
+
+/**
+ * Range over the entries of a serialized List Devices payload
+ *
+ * Entries are struct emapi_dev_ref pointing into the payload, which must
+ * outlive the range. Iteration stops at the first malformed entry.
+ *
+ * for (const emapi_dev_ref &d : emapi::dev_range(frame)) ...
+ */
+class dev_range
+{
+public:
+	struct sentinel {};
+
+	class iterator
+	{
+	public:
+		using value_type = emapi_dev_ref;
+		using reference = const emapi_dev_ref &;
+		using pointer = const emapi_dev_ref *;
+		using difference_type = std::ptrdiff_t;
+
+		explicit iterator(const emapi_dev_view &v) noexcept : v_(v), ok_(0) { ++*this; }
+
+		reference operator*() const noexcept { return d_; }
+		pointer operator->() const noexcept { return &d_; }
+		iterator &operator++() noexcept { ok_ = emapi_dev_next(&v_, &d_) == 1; return *this; }
+
+		friend bool operator==(const iterator &i, sentinel) noexcept { return !i.ok_; }
+		friend bool operator!=(const iterator &i, sentinel) noexcept { return i.ok_; }
+		friend bool operator==(sentinel, const iterator &i) noexcept { return !i.ok_; }
+		friend bool operator!=(sentinel, const iterator &i) noexcept { return i.ok_; }
+
+	private:
+		emapi_dev_view v_;
+		emapi_dev_ref d_;
+		int ok_;
+	};
+
+	/**
+	 * @param 	payload Serialized entries
+	 * @param 	num 	Number of entries (Immediate A of the response)
+	 * @param 	ver 	Header version [EMVER] of the response
+	 */
+	dev_range(cbytes payload, unsigned num, unsigned ver = EMVER_V0) noexcept
+	{
+		if (emapi_dev_view_init_ver(&v_, const_cast<__u8*>(payload.data()), payload.size(), num, ver))
+			emapi_dev_view_init_ver(&v_, nullptr, 0, 0, ver);
+	}
+
+	/**
+	 * @param 	f 		List Devices response
+	 */
+	explicit dev_range(const emapi_frame &f) noexcept : dev_range(cbytes(f.payload, f.hdr.len), f.hdr.a, f.hdr.ver) {}
+
+	iterator begin() const noexcept { return iterator(v_); }
+	sentinel end() const noexcept { return sentinel(); }
+
+private:
+	emapi_dev_view v_;
+};
+
+} // namespace emapi
+
+#endif //ifndef _EMAPI_HPP
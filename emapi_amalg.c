@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		emapi_amalg.c
+ *
+ * @brief 		Single translation unit build of the EM API library
+ *
+ * @details 	Compiles every module of the library as one file so the
+ *              compiler can inline and constant fold across modules, e.g.
+ *              the header codec into the transport and client. Built by
+ *              `make amalg`. Produces the same library as the per module
+ *              build.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* Some modules need GNU extensions, which must be requested before the
+ * first system header
+ */
+#define _GNU_SOURCE
+
+#include "main.c"
+#include "pool.c"
+#include "transport.c"
+#include "client.c"
+#include "dispatch.c"
+#include "uring.c"
+#include "shmring.c"
+#include "stats.c"
+#include "capture.c"
+#include "mock.c"
+#include "fmt.c"
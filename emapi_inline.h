@@ -0,0 +1,220 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		emapi_inline.h
+ *
+ * @brief 		Header only codec for EM API objects
+ *
+ * @details 	One static inline encoder and decoder per object type, so a
+ *              caller that knows the type at compile time gets the code
+ *              inlined and constant folded at the call site. The generic
+ *              emapi_serialize() and emapi_deserialize() are wrappers around
+ *              these functions and produce identical bytes.
+ *
+ *              Included by main.h. Needs no library code, so it can be used
+ *              on its own to encode and decode messages.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+#ifndef _EMAPI_INLINE_H
+#define _EMAPI_INLINE_H
+
+/* INCLUDES ==================================================================*/
+
+/* memcpy()
+ */
+#include <string.h>
+
+/* FUNCTIONS =================================================================*/
+
+/**
+ * Encode a header into EMLN_HDR bytes
+ *
+ * @param[out] 	dst 		__u8* to EMLN_HDR bytes
+ * @param[in] 	o 			struct emapi_hdr* to encode
+ * @return 					EMLN_HDR
+ */
+static inline int emapi_enc_hdr(__u8 *dst, const struct emapi_hdr *o)
+{
+	dst[0]  = ((o->ver  << 4) & 0xF0) | (o->type & 0x0F);
+	dst[1]  = o->tag;
+	dst[2]  = o->rc;
+	dst[3]  = o->opcode;
+	dst[4]  = (o->a        ) & 0x00FF;
+	dst[5]  = o->ver >= EMVER_V2 ? (o->a >> 8) & 0x00FF : 0;
+	dst[6]  = (o->len      ) & 0x00FF;
+	dst[7]  = (o->len >> 8 ) & 0x00FF;
+	dst[ 8] = (o->b        ) & 0x00FF;
+	dst[ 9] = (o->b   >>  8) & 0x00FF;
+	dst[10] = (o->b   >> 16) & 0x00FF;
+	dst[11] = (o->b   >> 24) & 0x00FF;
+	return EMLN_HDR;
+}
+
+/**
+ * Decode a header from EMLN_HDR bytes. The layout follows the version field.
+ *
+ * @param[out] 	o 			struct emapi_hdr* to fill in
+ * @param[in] 	src 		__u8* to EMLN_HDR bytes
+ * @return 					EMLN_HDR
+ */
+static inline int emapi_dec_hdr(struct emapi_hdr *o, const __u8 *src)
+{
+	o->ver 			= (src[ 0] >> 4) & 0x0F;
+	o->type 		= (src[ 0]     ) & 0x0F;
+	o->tag 			=  src[ 1];
+	o->rc 			=  src[ 2];
+	o->opcode 		=  src[ 3];
+	o->a 			=  src[ 4];
+	if (o->ver >= EMVER_V2)
+		o->a 		|= (src[ 5] <<  8);
+	o->len 			= (src[ 7] <<  8) |  src[ 6];
+	o->b 			= ((__u32) src[11] << 24) | (src[10] << 16) | (src[ 9] << 8) | src[ 8];
+	return EMLN_HDR;
+}
+
+/**
+ * Encode one List Devices entry. The caller checks that dst is large enough.
+ *
+ * @param[out] 	dst 		__u8* to at least 5 + o->len bytes
+ * @param[in] 	o 			struct emapi_dev* to encode
+ * @param[in] 	ver 		Header version [EMVER] of the message
+ * @return 					number of bytes written, -1 if the name is longer 
+ * 							than EMLN_DEV_NAME. Nothing is written then
+ */
+static inline int emapi_enc_dev(__u8 *dst, const struct emapi_dev *o, unsigned ver)
+{
+	unsigned k;
+
+	if (o->len > EMLN_DEV_NAME)
+		return -1;
+
+	k = 0;
+	dst[k++] = (o->id      ) & 0x00FF;
+	if (ver >= EMVER_V2)
+	{
+		dst[k++] = (o->id >>  8) & 0x00FF;
+		dst[k++] = (o->id >> 16) & 0x00FF;
+		dst[k++] = (o->id >> 24) & 0x00FF;
+	}
+	dst[k++] = o->len;
+	memcpy(&dst[k], o->name, o->len);
+	return k + o->len;
+}
+
+/**
+ * Decode one List Devices entry
+ *
+ * @param[out] 	o 			struct emapi_dev* to fill in
+ * @param[in] 	src 		__u8* to the entry
+ * @param[in] 	ver 		Header version [EMVER] of the message
+ * @return 					number of bytes consumed, -1 if the name is longer 
+ * 							than EMLN_DEV_NAME
+ */
+static inline int emapi_dec_dev(struct emapi_dev *o, const __u8 *src, unsigned ver)
+{
+	unsigned k;
+
+	k = 0;
+	if (ver >= EMVER_V2)
+	{
+		o->id = ((__u32) src[3] << 24) | (src[2] << 16) | (src[1] << 8) | src[0];
+		k += 4;
+	}
+	else
+		o->id = src[k++];
+	o->len 	= src[k++];
+	if (o->len > EMLN_DEV_NAME)
+	{
+		o->len = 0;
+		o->name[0] = 0;
+		return -1;
+	}
+	if (o->len == 0)
+		o->name[0] = 0;
+	else
+		memcpy(o->name, &src[k], o->len);
+	return k + o->len;
+}
+
+/**
+ * Encode one Connect Batch / Disconnect Batch entry into EMLN_CONN_ENT bytes
+ *
+ * @param[out] 	dst 		__u8* to EMLN_CONN_ENT bytes
+ * @param[in] 	o 			struct emapi_conn_ent* to encode
+ * @param[in] 	ver 		Header version [EMVER] of the message
+ * @return 					EMLN_CONN_ENT
+ */
+static inline int emapi_enc_conn_ent(__u8 *dst, const struct emapi_conn_ent *o, unsigned ver)
+{
+	dst[0] = (o->ppid      ) & 0x00FF;
+	dst[1] = o->flags;
+	dst[2] = o->rc;
+	dst[3] = ver >= EMVER_V2 ? (o->ppid >> 8) & 0x00FF : 0;
+	dst[4] = (o->dev      ) & 0x00FF;
+	dst[5] = (o->dev >>  8) & 0x00FF;
+	dst[6] = (o->dev >> 16) & 0x00FF;
+	dst[7] = (o->dev >> 24) & 0x00FF;
+	return EMLN_CONN_ENT;
+}
+
+/**
+ * Decode one Connect Batch / Disconnect Batch entry from EMLN_CONN_ENT bytes
+ *
+ * @param[out] 	o 			struct emapi_conn_ent* to fill in
+ * @param[in] 	src 		__u8* to EMLN_CONN_ENT bytes
+ * @param[in] 	ver 		Header version [EMVER] of the message
+ * @return 					EMLN_CONN_ENT
+ */
+static inline int emapi_dec_conn_ent(struct emapi_conn_ent *o, const __u8 *src, unsigned ver)
+{
+	o->ppid 	= src[0];
+	if (ver >= EMVER_V2)
+		o->ppid |= (src[3] << 8);
+	o->flags 	= src[1];
+	o->rc 		= src[2];
+	o->dev 		= ((__u32) src[7] << 24) | (src[6] << 16) | (src[5] << 8) | src[4];
+	return EMLN_CONN_ENT;
+}
+
+/**
+ * Encode a hello object into EMLN_HELLO bytes
+ *
+ * @param[out] 	dst 		__u8* to EMLN_HELLO bytes
+ * @param[in] 	o 			struct emapi_hello* to encode
+ * @return 					EMLN_HELLO
+ */
+static inline int emapi_enc_hello(__u8 *dst, const struct emapi_hello *o)
+{
+	dst[0] = o->ver;
+	dst[1] = 0;
+	dst[2] = (o->caps         ) & 0x00FF;
+	dst[3] = (o->caps    >>  8) & 0x00FF;
+	dst[4] = (o->max_msg      ) & 0x00FF;
+	dst[5] = (o->max_msg >>  8) & 0x00FF;
+	dst[6] = (o->max_msg >> 16) & 0x00FF;
+	dst[7] = (o->max_msg >> 24) & 0x00FF;
+	memcpy(&dst[8], o->ops, sizeof(o->ops));
+	return EMLN_HELLO;
+}
+
+/**
+ * Decode a hello object from EMLN_HELLO bytes
+ *
+ * @param[out] 	o 			struct emapi_hello* to fill in
+ * @param[in] 	src 		__u8* to EMLN_HELLO bytes
+ * @return 					EMLN_HELLO
+ */
+static inline int emapi_dec_hello(struct emapi_hello *o, const __u8 *src)
+{
+	o->ver 			=  src[0];
+	o->caps 		= (src[3] <<  8) |  src[2];
+	o->max_msg 		= ((__u32) src[7] << 24) | (src[6] << 16) | (src[5] << 8) | src[4];
+	memcpy(o->ops, &src[8], sizeof(o->ops));
+	return EMLN_HELLO;
+}
+
+#endif //ifndef _EMAPI_INLINE_H
@@ -0,0 +1,498 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		fmt.c
+ *
+ * @brief 		Code file for the EM API text and JSON formatter
+ *
+ * @details 	Objects and complete messages are written as one line of text
+ *              or one JSON object into a buffer supplied by the caller. The
+ *              formatter does not allocate and does not use stdio, so it can
+ *              be called for every message from any thread, e.g. to log into
+ *              an application ring buffer.
+ *
+ *              Text output is a list of key=value fields. JSON output uses
+ *              numbers for every numeric field, including those shown in hex
+ *              in the text output.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* memcpy()
+ */
+#include <string.h>
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+/* ENUMERATIONS ==============================================================*/
+
+/* STRUCTS ===================================================================*/
+
+/**
+ * Output cursor
+ */
+struct emfm_out
+{
+	char *p;						//!< Next byte to write
+	char *end;						//!< Last byte of the buffer, kept for the NUL
+	int full;						//!< Set once output did not fit
+	int json;						//!< Write JSON instead of text
+	unsigned n;						//!< Fields written to the current object
+};
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+static const char emfm_digits[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static const char emfm_hexdig[] = "0123456789abcdef";
+
+/* PROTOTYPES ================================================================*/
+
+static void emfm_frame(struct emfm_out *o, struct emapi_frame *f, int nest);
+
+/* FUNCTIONS =================================================================*/
+
+static inline void emfm_mem(struct emfm_out *o, const char *s, unsigned n)
+{
+	if (o->p + n > o->end)
+	{
+		o->full = 1;
+		return;
+	}
+	memcpy(o->p, s, n);
+	o->p += n;
+}
+
+static inline void emfm_chr(struct emfm_out *o, char ch)
+{
+	if (o->p >= o->end)
+	{
+		o->full = 1;
+		return;
+	}
+	*o->p++ = ch;
+}
+
+static inline void emfm_str(struct emfm_out *o, const char *s)
+{
+	emfm_mem(o, s, strlen(s));
+}
+
+/**
+ * Write an unsigned decimal number, two digits at a time
+ */
+static void emfm_dec(struct emfm_out *o, __u64 v)
+{
+	char tmp[20];
+	unsigned k;
+
+	k = sizeof(tmp);
+	while (v >= 100)
+	{
+		k -= 2;
+		memcpy(&tmp[k], &emfm_digits[(v % 100) * 2], 2);
+		v /= 100;
+	}
+	if (v >= 10)
+	{
+		k -= 2;
+		memcpy(&tmp[k], &emfm_digits[v * 2], 2);
+	}
+	else
+		tmp[--k] = '0' + v;
+
+	emfm_mem(o, &tmp[k], sizeof(tmp) - k);
+}
+
+/**
+ * Write 0x and exactly digits hex digits
+ */
+static void emfm_hex(struct emfm_out *o, __u64 v, unsigned digits)
+{
+	char tmp[18];
+	unsigned i;
+
+	tmp[0] = '0';
+	tmp[1] = 'x';
+	for ( i = 0 ; i < digits ; i++ )
+		tmp[1 + digits - i] = emfm_hexdig[(v >> (4 * i)) & 0x0F];
+	emfm_mem(o, tmp, 2 + digits);
+}
+
+/**
+ * Write up to n bytes of s, stopping at a NUL. JSON strings are quoted and
+ * escaped, text strings are quoted only when quote is set. Both escape '"'
+ * and backslash with a backslash. Text replaces control characters with '?'.
+ */
+static void emfm_text(struct emfm_out *o, const char *s, unsigned n, int quote)
+{
+	unsigned i, k;
+	__u8 ch;
+
+	if (o->json || quote)
+		emfm_chr(o, '"');
+
+	for ( i = k = 0 ; i < n && s[i] != 0 ; i++ )
+	{
+		ch = s[i];
+		if (ch >= 0x20 && ch != '"' && ch != '\\')
+			continue;
+
+		// Flush the plain run, then escape the character
+		emfm_mem(o, &s[k], i - k);
+		k = i + 1;
+		if (ch == '"' || ch == '\\')
+		{
+			emfm_chr(o, '\\');
+			emfm_chr(o, ch);
+		}
+		else if (!o->json)
+			emfm_chr(o, '?');
+		else
+		{
+			emfm_mem(o, "\\u00", 4);
+			emfm_chr(o, emfm_hexdig[ch >> 4]);
+			emfm_chr(o, emfm_hexdig[ch & 0x0F]);
+		}
+	}
+	emfm_mem(o, &s[k], i - k);
+
+	if (o->json || quote)
+		emfm_chr(o, '"');
+}
+
+/**
+ * Start an object. Text objects have no delimiters.
+ */
+static inline void emfm_open(struct emfm_out *o)
+{
+	if (o->json)
+		emfm_chr(o, '{');
+	o->n = 0;
+}
+
+static inline void emfm_close(struct emfm_out *o)
+{
+	if (o->json)
+		emfm_chr(o, '}');
+}
+
+/**
+ * Write the separator and key of the next field of the current object
+ */
+static void emfm_key(struct emfm_out *o, const char *key)
+{
+	if (o->n++ > 0)
+		emfm_chr(o, o->json ? ',' : ' ');
+
+	if (o->json)
+	{
+		emfm_chr(o, '"');
+		emfm_str(o, key);
+		emfm_mem(o, "\":", 2);
+	}
+	else
+	{
+		emfm_str(o, key);
+		emfm_chr(o, '=');
+	}
+}
+
+static void emfm_u(struct emfm_out *o, const char *key, __u64 v)
+{
+	emfm_key(o, key);
+	emfm_dec(o, v);
+}
+
+/**
+ * Field shown in hex in text and as a number in JSON
+ */
+static void emfm_x(struct emfm_out *o, const char *key, __u64 v, unsigned digits)
+{
+	emfm_key(o, key);
+	if (o->json)
+		emfm_dec(o, v);
+	else
+		emfm_hex(o, v, digits);
+}
+
+/**
+ * Enumerated field shown by name in text and as a number in JSON. Values
+ * without a name are shown in hex.
+ */
+static void emfm_e(struct emfm_out *o, const char *key, unsigned v, const char *name)
+{
+	emfm_key(o, key);
+	if (o->json)
+		emfm_dec(o, v);
+	else if (name != NULL)
+		emfm_str(o, name);
+	else
+		emfm_hex(o, v, 2);
+}
+
+static void emfm_hdr(struct emfm_out *o, struct emapi_hdr *h)
+{
+	emfm_open(o);
+	emfm_e(o, "type", h->type, emmt(h->type));
+	emfm_u(o, "ver", h->ver);
+	emfm_x(o, "tag", h->tag, 2);
+	emfm_e(o, "rc", h->rc, emrc(h->rc));
+	emfm_e(o, "opcode", h->opcode, emop(h->opcode));
+	emfm_x(o, "a", h->a, 4);
+	emfm_u(o, "len", h->len);
+	emfm_x(o, "b", h->b, 8);
+	emfm_close(o);
+}
+
+static void emfm_dev(struct emfm_out *o, __u32 id, const char *name, unsigned len)
+{
+	emfm_open(o);
+	emfm_u(o, "id", id);
+	emfm_key(o, "name");
+	emfm_text(o, name, len, 1);
+	emfm_close(o);
+}
+
+static void emfm_conn_ent(struct emfm_out *o, struct emapi_conn_ent *e)
+{
+	emfm_open(o);
+	emfm_u(o, "ppid", e->ppid);
+	emfm_x(o, "flags", e->flags, 2);
+	emfm_e(o, "rc", e->rc, emrc(e->rc));
+	emfm_u(o, "dev", e->dev);
+	emfm_close(o);
+}
+
+static void emfm_hello(struct emfm_out *o, struct emapi_hello *h)
+{
+	unsigned i, k;
+
+	emfm_open(o);
+	emfm_u(o, "ver", h->ver);
+	emfm_x(o, "caps", h->caps, 4);
+	emfm_u(o, "max_msg", h->max_msg);
+	emfm_key(o, "ops");
+	emfm_chr(o, o->json ? '[' : '{');
+	for ( i = k = 0 ; i < 256 ; i++ )
+	{
+		if (!emapi_hello_has(h, i))
+			continue;
+		if (k++ > 0)
+			emfm_chr(o, ',');
+		emfm_dec(o, i);
+	}
+	emfm_chr(o, o->json ? ']' : '}');
+	emfm_close(o);
+}
+
+static void emfm_obj(struct emfm_out *o, void *obj, unsigned type)
+{
+	switch (type)
+	{
+		case EMOB_HDR:
+			emfm_hdr(o, (struct emapi_hdr*) obj);
+			break;
+
+		case EMOB_LIST_DEV:
+		{
+			struct emapi_dev *d = (struct emapi_dev*) obj;
+			emfm_dev(o, d->id, d->name, d->len < EMLN_DEV_NAME ? d->len : EMLN_DEV_NAME);
+		}
+			break;
+
+		case EMOB_CONN_BATCH:
+			emfm_conn_ent(o, (struct emapi_conn_ent*) obj);
+			break;
+
+		case EMOB_HELLO:
+			emfm_hello(o, (struct emapi_hello*) obj);
+			break;
+
+		default:
+			o->full = 1;
+			break;
+	}
+}
+
+/**
+ * Start the next entry of a list of objects
+ */
+static inline void emfm_item(struct emfm_out *o, unsigned i)
+{
+	if (o->json)
+	{
+		if (i > 0)
+			emfm_chr(o, ',');
+	}
+	else
+		emfm_mem(o, " | ", 3);
+}
+
+/**
+ * Write the objects of a payload, decoded in place
+ */
+static void emfm_payload(struct emfm_out *o, struct emapi_frame *f, int nest)
+{
+	struct emapi_dev_view dv;
+	struct emapi_dev_ref d;
+	struct emapi_env_view ev;
+	struct emapi_frame inner;
+	struct emapi_conn_ent e;
+	struct emapi_hello h;
+	unsigned i, type;
+
+	type = (f->hdr.type == EMMT_REQ) ? emapi_emob_req(f->hdr.opcode) : emapi_emob_rsp(f->hdr.opcode);
+	i = 0;
+
+	if (f->hdr.opcode == EMOP_ENVELOPE && !nest)
+	{
+		emapi_env_view_init(&ev, f);
+		while (emapi_env_next(&ev, &inner) == 1)
+		{
+			emfm_item(o, i++);
+			if (!o->json)
+				emfm_chr(o, '[');
+			emfm_frame(o, &inner, 1);
+			if (!o->json)
+				emfm_chr(o, ']');
+		}
+		return;
+	}
+
+	switch (type)
+	{
+		case EMOB_LIST_DEV:
+			emapi_dev_view_init_ver(&dv, f->payload, f->hdr.len, f->hdr.a, f->hdr.ver);
+			while (emapi_dev_next(&dv, &d) == 1)
+			{
+				emfm_item(o, i++);
+				emfm_dev(o, d.id, d.name, d.len);
+			}
+			break;
+
+		case EMOB_CONN_BATCH:
+			for ( ; (i + 1) * EMLN_CONN_ENT <= f->hdr.len ; i++ )
+			{
+				emapi_dec_conn_ent(&e, &f->payload[i * EMLN_CONN_ENT], f->hdr.ver);
+				emfm_item(o, i);
+				emfm_conn_ent(o, &e);
+			}
+			break;
+
+		case EMOB_HELLO:
+			if (f->hdr.len < EMLN_HELLO)
+				break;
+			emapi_dec_hello(&h, f->payload);
+			emfm_item(o, i);
+			emfm_hello(o, &h);
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void emfm_frame(struct emfm_out *o, struct emapi_frame *f, int nest)
+{
+	if (o->json)
+	{
+		emfm_mem(o, "{\"hdr\":", 7);
+		emfm_hdr(o, &f->hdr);
+		emfm_mem(o, ",\"obj\":[", 8);
+	}
+	else
+		emfm_hdr(o, &f->hdr);
+
+	if (f->hdr.len > 0 && f->payload != NULL)
+		emfm_payload(o, f, nest);
+
+	if (o->json)
+		emfm_mem(o, "]}", 2);
+}
+
+/**
+ * Terminate the output and compute the return value
+ */
+static int emfm_end(struct emfm_out *o, char *buf)
+{
+	if (o->full)
+	{
+		buf[0] = 0;
+		return -1;
+	}
+	*o->p = 0;
+	return o->p - buf;
+}
+
+/**
+ * Format an object as one line of text or as a JSON object
+ *
+ * @param 	buf 	Output buffer. Always NUL terminated when size > 0
+ * @param 	size 	Size of buf in bytes
+ * @param 	obj 	Object to format
+ * @param 	type 	Type of the object [EMOB]. A list device entry is one
+ * 					struct emapi_dev and a connect entry is one struct emapi_conn_ent
+ * @param 	flags 	Bitmask of [EMFM] flags
+ * @return 	length of the output without the NUL, -1 if it does not fit or
+ * 			the type is unknown
+ */
+int emapi_fmt(char *buf, unsigned size, void *obj, unsigned type, unsigned flags)
+{
+	struct emfm_out o;
+
+	// Validate Inputs
+	if (buf == NULL || size == 0)
+		return -1;
+
+	o.p = buf;
+	o.end = buf + size - 1;
+	o.full = (obj == NULL);
+	o.json = flags & EMFM_JSON;
+	o.n = 0;
+
+	if (!o.full)
+		emfm_obj(&o, obj, type);
+	return emfm_end(&o, buf);
+}
+
+/**
+ * Format a received or serialized message, header and payload objects
+ *
+ * The payload is decoded in place according to the opcode, the message
+ * type and the header version. The messages held by an envelope are
+ * formatted in turn. JSON output is {"hdr":{...},"obj":[...]}.
+ *
+ * @param 	buf 	Output buffer. Always NUL terminated when size > 0
+ * @param 	size 	Size of buf in bytes
+ * @param 	f 		struct emapi_frame* holding the message
+ * @param 	flags 	Bitmask of [EMFM] flags
+ * @return 	length of the output without the NUL, -1 if it does not fit
+ */
+int emapi_fmt_frame(char *buf, unsigned size, struct emapi_frame *f, unsigned flags)
+{
+	struct emfm_out o;
+
+	// Validate Inputs
+	if (buf == NULL || size == 0)
+		return -1;
+
+	o.p = buf;
+	o.end = buf + size - 1;
+	o.full = (f == NULL);
+	o.json = flags & EMFM_JSON;
+	o.n = 0;
+
+	if (!o.full)
+		emfm_frame(&o, f, 0);
+	return emfm_end(&o, buf);
+}
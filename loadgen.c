@@ -0,0 +1,524 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		loadgen.c
+ *
+ * @brief 		Multi-threaded load generator for EM API servers
+ *
+ * @details 	Each thread drives a number of client connections with a
+ *              weighted mix of List Devices, Connect Device and Disconnect
+ *              Device requests, through the same asynchronous client and
+ *              tag handling applications use.
+ *
+ *              With a target rate the load is open-loop: every request has
+ *              an intended send time on a fixed schedule and its latency is
+ *              measured from that time. A request that cannot be sent
+ *              because every tag is in use waits, and the wait counts
+ *              against its latency, so a stalled server is not hidden by a
+ *              generator that slowed down with it. Without a rate each
+ *              connection keeps a fixed number of requests in flight.
+ *
+ *              Without -a the requests are answered by an in-process
+ *              emulated CSE (see mock.c).
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* ppoll()
+ */
+#define _GNU_SOURCE
+
+/* printf(), snprintf(), sscanf()
+ */
+#include <stdio.h>
+
+/* malloc(), calloc(), free(), atoi(), atof()
+ */
+#include <stdlib.h>
+
+/* memset()
+ */
+#include <string.h>
+
+/* getopt(), getpid()
+ */
+#include <unistd.h>
+
+/* ppoll()
+ */
+#include <poll.h>
+
+/* struct timespec
+ */
+#include <time.h>
+
+/* pthread_create()
+ */
+#include <pthread.h>
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+#define LG_THREADS 					64 		//!< Most generator or server threads
+#define LG_CONNS 					256 	//!< Most connections per thread
+#define LG_DEVS 					1024 	//!< Devices of the in-process server
+#define LG_PORTS 					256 	//!< Ports of the in-process server
+#define LG_DRAIN_NS 				1000000000ull 	//!< Time allowed for the last responses
+
+/* ENUMERATIONS ==============================================================*/
+
+/**
+ * Operations in the mix
+ */
+enum _LGOP
+{
+	LGOP_LIST 		= 0,
+	LGOP_CONN 		= 1,
+	LGOP_DISCON 	= 2,
+	LGOP_MAX
+};
+
+/* STRUCTS ===================================================================*/
+
+/**
+ * Generator configuration
+ */
+struct lg_cfg
+{
+	const char *addr;				//!< Server address
+	unsigned threads;				//!< Generator threads
+	unsigned conns;					//!< Connections per thread
+	unsigned depth;					//!< Requests in flight per connection without a rate
+	double rate;					//!< Requests per second over all threads, 0 for max
+	__u64 dur_ns;					//!< Length of the run
+	unsigned mix[LGOP_MAX];			//!< Weight of each operation
+	unsigned devs;					//!< Devices addressed by Connect Device
+	unsigned ports;					//!< Ports addressed by Connect / Disconnect Device
+};
+
+/**
+ * Connection driven by a generator thread
+ */
+struct lg_conn
+{
+	struct emapi_client cl;
+	__u64 t[EMLN_TAGS];				//!< Intended send time of each request in flight
+	struct lg_thread *th;
+};
+
+/**
+ * Generator thread
+ */
+struct lg_thread
+{
+	struct lg_cfg *cfg;
+	struct lg_conn *conn;			//!< Connections
+	pthread_t tid;
+	unsigned idx;					//!< Thread number
+	__u64 seed;						//!< Random state
+	__u64 start;					//!< Time the run starts, same for all threads
+	__u64 sent;						//!< Requests sent
+	__u64 done;						//!< Responses received
+	__u64 failed;					//!< Requests that got no response
+	__u64 late;						//!< Largest delay between intended and actual send
+};
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+/* PROTOTYPES ================================================================*/
+
+/* FUNCTIONS =================================================================*/
+
+static inline unsigned lg_rand(struct lg_thread *th)
+{
+	__u64 x = th->seed;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	th->seed = x;
+	return (unsigned) (x >> 32);
+}
+
+/**
+ * Response callback. Records the latency from the intended send time.
+ */
+static void lg_done(struct emapi_client *c, struct emapi_frame *rsp, void *arg)
+{
+	struct lg_conn *lc = (struct lg_conn*) arg;
+
+	(void) c;
+
+	if (rsp == NULL)
+	{
+		lc->th->failed++;
+		return;
+	}
+	lc->th->done++;
+	emapi_stats_record(EMSK_CLIENT, rsp->hdr.opcode, rsp->hdr.rc, emapi_now_ns() - lc->t[rsp->hdr.tag]);
+}
+
+/**
+ * Build and submit one request picked from the mix
+ *
+ * @param 	t0 		Intended send time
+ * @return 	0 upon success, non zero if the connection has no free tag
+ */
+static int lg_submit(struct lg_thread *th, struct lg_conn *lc, __u64 t0, __u64 now)
+{
+	struct lg_cfg *cfg = th->cfg;
+	struct emapi_smsg m;
+	unsigned r;
+	int tag;
+
+	r = lg_rand(th) % (cfg->mix[LGOP_LIST] + cfg->mix[LGOP_CONN] + cfg->mix[LGOP_DISCON]);
+	if (r < cfg->mix[LGOP_LIST])
+		emapi_sfill_listdev(&m, 0, lg_rand(th) % cfg->devs);
+	else if (r < cfg->mix[LGOP_LIST] + cfg->mix[LGOP_CONN])
+		emapi_sfill_conn(&m, lg_rand(th) % cfg->ports, lg_rand(th) % cfg->devs);
+	else
+		emapi_sfill_disconn(&m, lg_rand(th) % cfg->ports, 0);
+
+	tag = emapi_client_submit(&lc->cl, &m.hdr, m.payload, lg_done, lc);
+	if (tag < 0)
+		return 1;
+
+	lc->t[tag] = t0;
+	if (now - t0 > th->late)
+		th->late = now - t0;
+	th->sent++;
+	return 0;
+}
+
+/**
+ * Generator thread: send on schedule until the run ends, then drain
+ */
+static void *lg_thread(void *arg)
+{
+	struct lg_thread *th = (struct lg_thread*) arg;
+	struct lg_cfg *cfg = th->cfg;
+	struct pollfd p[LG_CONNS];
+	struct lg_conn *lc;
+	struct timespec ts, *tp;
+	__u64 now, next, step, end, t;
+	unsigned k, rr, inflight, blocked;
+
+	// Stagger the threads over one interval so their sends do not coincide
+	step = cfg->rate > 0 ? (__u64) (1e9 * cfg->threads / cfg->rate) : 0;
+	next = th->start + step * th->idx / cfg->threads;
+	end = th->start + cfg->dur_ns;
+	rr = 0;
+
+	for (;;)
+	{
+		now = emapi_now_ns();
+		blocked = 0;
+
+		if (now < end)
+		{
+			if (step > 0)
+			{
+				// Send every request that is due, oldest first
+				while (next <= now)
+				{
+					for ( k = 0 ; k < cfg->conns ; k++ )
+					{
+						lc = &th->conn[(rr + k) % cfg->conns];
+						if (lc->cl.fd >= 0 && !lg_submit(th, lc, next, now))
+							break;
+					}
+					// Every tag is in use. The request waits for a response.
+					if (k == cfg->conns)
+					{
+						blocked = 1;
+						break;
+					}
+					rr = (rr + k + 1) % cfg->conns;
+					next += step;
+				}
+			}
+			else
+			{
+				// Keep depth requests in flight on every connection
+				for ( k = 0 ; k < cfg->conns ; k++ )
+				{
+					lc = &th->conn[k];
+					while (lc->cl.fd >= 0 && lc->cl.inflight < cfg->depth && !lg_submit(th, lc, now, now))
+						;
+				}
+			}
+		}
+
+		inflight = 0;
+		for ( k = 0 ; k < cfg->conns ; k++ )
+		{
+			lc = &th->conn[k];
+			p[k].fd = lc->cl.fd;
+			p[k].events = POLLIN | (emapi_client_pending(&lc->cl) ? POLLOUT : 0);
+			p[k].revents = 0;
+			if (lc->cl.fd >= 0)
+				inflight += lc->cl.inflight;
+		}
+		if (now >= end && (inflight == 0 || now >= end + LG_DRAIN_NS))
+			break;
+
+		// Sleep until a response arrives or the next request is due
+		tp = NULL;
+		if (now < end && step > 0 && !blocked)
+		{
+			t = next > now ? next - now : 0;
+			if (t > end - now)
+				t = end - now;
+			ts.tv_sec = t / 1000000000ull;
+			ts.tv_nsec = t % 1000000000ull;
+			tp = &ts;
+		}
+		else if (now >= end || blocked)
+		{
+			ts.tv_sec = 0;
+			ts.tv_nsec = 10000000;
+			tp = &ts;
+		}
+		if (ppoll(p, cfg->conns, tp, NULL) < 0)
+			continue;
+
+		for ( k = 0 ; k < cfg->conns ; k++ )
+			if (p[k].revents)
+				emapi_client_process(&th->conn[k].cl);
+	}
+
+	for ( k = 0 ; k < cfg->conns ; k++ )
+		emapi_client_close(&th->conn[k].cl);
+	return NULL;
+}
+
+static void *lg_server_thread(void *arg)
+{
+	emapi_server_run((struct emapi_server*) arg);
+	return NULL;
+}
+
+/**
+ * Print throughput and latency percentiles
+ */
+static void lg_report(struct lg_cfg *cfg, struct lg_thread *th, __u64 elapsed)
+{
+	struct emapi_stats *st;
+	struct emapi_hist *h;
+	__u64 sent, done, failed, late;
+	unsigned i;
+
+	sent = done = failed = late = 0;
+	for ( i = 0 ; i < cfg->threads ; i++ )
+	{
+		sent += th[i].sent;
+		done += th[i].done;
+		failed += th[i].failed;
+		if (th[i].late > late)
+			late = th[i].late;
+	}
+
+	printf("threads %u connections %u sent %llu responses %llu failed %llu\n", cfg->threads,
+		cfg->threads * cfg->conns, (unsigned long long) sent, (unsigned long long) done,
+		(unsigned long long) failed);
+	printf("elapsed %.3f s throughput %.0f req/s (target %s) max send delay %.1f us\n", elapsed / 1e9,
+		done / (elapsed / 1e9), cfg->rate > 0 ? "fixed" : "max", late / 1e3);
+
+	st = (struct emapi_stats*) malloc(sizeof(*st));
+	if (st == NULL)
+		return;
+	emapi_stats_snapshot(st);
+
+	printf("%-22s %10s %10s %10s %10s %10s %10s\n", "latency (us)", "count", "req/s", "p50", "p99", "p99.9", "max");
+	for ( i = 0 ; i < EMOP_MAX ; i++ )
+	{
+		h = &st->op[EMSK_CLIENT][i];
+		if (h->count == 0)
+			continue;
+		printf("%-22s %10llu %10.0f %10.1f %10.1f %10.1f %10.1f\n", emop(i), (unsigned long long) h->count,
+			h->count / (elapsed / 1e9), emapi_hist_pct(h, 50) / 1e3, emapi_hist_pct(h, 99) / 1e3,
+			emapi_hist_pct(h, 99.9) / 1e3, h->max / 1e3);
+	}
+	for ( i = 0 ; i < EMRC_MAX ; i++ )
+	{
+		h = &st->rc[EMSK_CLIENT][i];
+		if (h->count > 0)
+			printf("rc %-19s %10llu\n", emrc(i), (unsigned long long) h->count);
+	}
+	free(st);
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-a addr] [-t threads] [-c conns] [-r rate | -q depth] [-d secs] [-m list:conn:discon] [-s threads]\n", prog);
+	printf("  -a  Server address (default: in-process emulated CSE)\n");
+	printf("  -t  Generator threads (default 1)\n");
+	printf("  -c  Connections per thread (default 1)\n");
+	printf("  -r  Requests per second over all threads, open-loop (default: max rate)\n");
+	printf("  -q  Requests in flight per connection at max rate (default %d)\n", EMLN_TAGS);
+	printf("  -d  Duration in seconds (default 5)\n");
+	printf("  -m  Weights of List / Connect / Disconnect Device (default 2:1:1)\n");
+	printf("  -n  Devices and ports addressed as devs:ports (default %d:%d)\n", LG_DEVS, LG_PORTS);
+	printf("  -s  Server threads of the in-process server (default 1)\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct emapi_server *srv;
+	struct emapi_mock mock;
+	struct emapi_ops ops;
+	struct lg_thread *th;
+	struct lg_cfg cfg;
+	pthread_t st[LG_THREADS];
+	unsigned i, k, sthreads, up;
+	char name[64];
+	__u64 t0;
+	int opt, lfd, rv;
+
+	// Initialize variables
+	memset(&cfg, 0, sizeof(cfg));
+	memset(&mock, 0, sizeof(mock));
+	cfg.threads = 1;
+	cfg.conns = 1;
+	cfg.depth = EMLN_TAGS;
+	cfg.dur_ns = 5000000000ull;
+	cfg.mix[LGOP_LIST] = 2;
+	cfg.mix[LGOP_CONN] = 1;
+	cfg.mix[LGOP_DISCON] = 1;
+	cfg.devs = LG_DEVS;
+	cfg.ports = LG_PORTS;
+	sthreads = 1;
+	srv = NULL;
+	th = NULL;
+	up = 0;
+	rv = 1;
+
+	while ( (opt = getopt(argc, argv, "a:t:c:r:q:d:m:n:s:h")) != -1 )
+	{
+		switch (opt)
+		{
+			case 'a': cfg.addr = optarg; 					break;
+			case 't': cfg.threads = atoi(optarg); 			break;
+			case 'c': cfg.conns = atoi(optarg); 			break;
+			case 'r': cfg.rate = atof(optarg); 				break;
+			case 'q': cfg.depth = atoi(optarg); 			break;
+			case 'd': cfg.dur_ns = atof(optarg) * 1e9; 		break;
+			case 's': sthreads = atoi(optarg); 				break;
+			case 'm':
+				if (sscanf(optarg, "%u:%u:%u", &cfg.mix[0], &cfg.mix[1], &cfg.mix[2]) != 3)
+					cfg.mix[0] = cfg.mix[1] = cfg.mix[2] = 0;
+				break;
+			case 'n':
+				if (sscanf(optarg, "%u:%u", &cfg.devs, &cfg.ports) != 2)
+					cfg.devs = 0;
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (cfg.threads == 0 || cfg.threads > LG_THREADS || cfg.conns == 0 || cfg.conns > LG_CONNS
+		|| cfg.depth == 0 || cfg.depth > EMLN_TAGS || cfg.rate < 0 || cfg.dur_ns == 0
+		|| cfg.mix[0] + cfg.mix[1] + cfg.mix[2] == 0 || cfg.devs == 0 || cfg.ports == 0 || cfg.ports > 256
+		|| sthreads == 0 || sthreads > LG_THREADS)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	// Start the in-process server
+	if (cfg.addr == NULL)
+	{
+		snprintf(name, sizeof(name), "@emapi-loadgen-%d", (int) getpid());
+		cfg.addr = name;
+		emapi_ops_init(&ops);
+		srv = (struct emapi_server*) calloc(sthreads, sizeof(*srv));
+		lfd = emapi_listen(cfg.addr);
+		if (srv == NULL || lfd < 0 || emapi_mock_init(&mock, cfg.devs, cfg.ports) || emapi_mock_register(&mock, &ops))
+		{
+			printf("in-process server: failed\n");
+			goto end;
+		}
+		for ( up = 0 ; up < sthreads ; up++ )
+		{
+			if (emapi_server_init(&srv[up], emapi_ops_dispatch, &ops)
+				|| emapi_server_listen_fd(&srv[up], up == 0 ? lfd : dup(lfd)))
+			{
+				printf("in-process server: failed\n");
+				goto stop;
+			}
+			pthread_create(&st[up], NULL, lg_server_thread, &srv[up]);
+		}
+	}
+
+	// Connect everything before the clock starts
+	th = (struct lg_thread*) calloc(cfg.threads, sizeof(*th));
+	if (th == NULL)
+		goto stop;
+	for ( i = 0 ; i < cfg.threads ; i++ )
+	{
+		th[i].cfg = &cfg;
+		th[i].idx = i;
+		th[i].seed = 0x9E3779B97F4A7C15ull * (i + 1);
+		th[i].conn = (struct lg_conn*) calloc(cfg.conns, sizeof(struct lg_conn));
+		if (th[i].conn == NULL)
+			goto stop;
+		for ( k = 0 ; k < cfg.conns ; k++ )
+		{
+			th[i].conn[k].th = &th[i];
+			th[i].conn[k].cl.fd = -1;
+		}
+		for ( k = 0 ; k < cfg.conns ; k++ )
+		{
+			if (emapi_client_open(&th[i].conn[k].cl, cfg.addr))
+			{
+				printf("connect %s: failed\n", cfg.addr);
+				goto stop;
+			}
+		}
+	}
+
+	t0 = emapi_now_ns() + 1000000;
+	for ( i = 0 ; i < cfg.threads ; i++ )
+	{
+		th[i].start = t0;
+		pthread_create(&th[i].tid, NULL, lg_thread, &th[i]);
+	}
+	for ( i = 0 ; i < cfg.threads ; i++ )
+		pthread_join(th[i].tid, NULL);
+
+	lg_report(&cfg, th, emapi_now_ns() - t0);
+	rv = 0;
+
+stop:
+
+	if (th != NULL)
+	{
+		for ( i = 0 ; i < cfg.threads ; i++ )
+		{
+			if (th[i].conn != NULL && rv != 0)
+				for ( k = 0 ; k < cfg.conns ; k++ )
+					emapi_client_close(&th[i].conn[k].cl);
+			free(th[i].conn);
+		}
+		free(th);
+	}
+	for ( i = 0 ; i < up ; i++ )
+		emapi_server_stop(&srv[i]);
+	for ( i = 0 ; i < up ; i++ )
+	{
+		pthread_join(st[i], NULL);
+		emapi_server_free(&srv[i]);
+	}
+
+end:
+
+	free(srv);
+	emapi_mock_free(&mock);
+	return rv;
+}
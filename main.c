@@ -26,6 +26,11 @@
 
 #include <arrayutils.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EMAPI_X86 1
+#endif
+
 #include "main.h"
 
 /* MACROS ====================================================================*/
@@ -52,6 +57,8 @@ const char *STR_EMOB[] = {
 	"Null", 		// EMOB_NULL			=  0,
 	"emob_hdr", 	// EMOB_HDR				=  1, //!< struct emapi_hdr
 	"emob_dev", 	// EMOB_LIST_DEV		=  2, //!< struct emapi_list_dev
+	"emob_conn", 	// EMOB_CONN_BATCH		=  3, //!< struct emapi_conn_ent
+	"emob_hello", 	// EMOB_HELLO			=  4, //!< struct emapi_hello
 };
 
 /**
@@ -62,6 +69,10 @@ const char *STR_EMOP[] = {
 	"List Devices", 			// EMOP_LIST_DEV		= 0x01
 	"Connect Device", 			// EMOP_CONN_DEV		= 0x02
 	"Disconnect Device",  		// EMOP_DISCON_DEV 		= 0x03
+	"Connect Device Batch", 	// EMOP_CONN_DEV_BATCH 	= 0x04
+	"Disconnect Device Batch", 	// EMOP_DISCON_DEV_BATCH = 0x05
+	"Envelope", 				// EMOP_ENVELOPE 		= 0x06
+	"Hello", 					// EMOP_HELLO 			= 0x07
 };
 
 /**
@@ -76,16 +87,39 @@ const char *STR_EMRC[] = {
 	"Busy",										// EMRC_BUSY							= 0x06,
 };
 
+/**
+ * Properties of each EM API Opcode (OP)
+ *
+ * Lengths are of the request payload
+ */
+const struct emapi_opinfo EMOP_INFO[] = {
+	//  req 			rsp 			min	max	flags 			max_a 	max_b 	ent_len
+	{ EMOB_NULL, 		EMOB_NULL,		0, 	0, 	0, 				0, 		0, 		0 }, // EMOP_EVENT 		= 0x00
+	{ EMOB_LIST_DEV, 	EMOB_LIST_DEV,	0, 	0, 	0, 				0, 		0, 		0 }, // EMOP_LIST_DEV 	= 0x01
+	{ EMOB_NULL, 		EMOB_NULL,		0, 	0, 	0, 				0, 		0, 		0 }, // EMOP_CONN_DEV 	= 0x02
+	{ EMOB_NULL, 		EMOB_NULL,		0, 	0, 	EMOF_CHK_IMM, 	0xFFFF, 1, 		0 }, // EMOP_DISCON_DEV	= 0x03
+	{ EMOB_CONN_BATCH, 	EMOB_CONN_BATCH, EMLN_CONN_ENT, EMLN_CONN_NUM*EMLN_CONN_ENT, 
+											EMOF_CHK_IMM, 	EMLN_CONN_NUM, 0, EMLN_CONN_ENT }, // EMOP_CONN_DEV_BATCH 	= 0x04
+	{ EMOB_CONN_BATCH, 	EMOB_CONN_BATCH, EMLN_CONN_ENT, EMLN_CONN_NUM*EMLN_CONN_ENT, 
+											EMOF_CHK_IMM, 	EMLN_CONN_NUM, 0, EMLN_CONN_ENT }, // EMOP_DISCON_DEV_BATCH 	= 0x05
+	{ EMOB_NULL, 		EMOB_NULL,		EMLN_HDR, EMLN_PAYLOAD, 0, 	0, 		0, 		0 }, // EMOP_ENVELOPE 	= 0x06
+	{ EMOB_HELLO, 		EMOB_HELLO,		EMLN_HELLO, EMLN_HELLO, EMOF_CHK_IMM, 0, 0, 	0 }, // EMOP_HELLO 	= 0x07
+};
+
 /* PROTOTYPES ================================================================*/
 
 void emapi_prnt_hdr(void *ptr);
 void emapi_prnt_list_dev(void *ptr);
+void emapi_prnt_conn_ent(void *ptr);
+void emapi_prnt_hello(void *ptr);
 
 /* FUNCTIONS =================================================================*/
 
 /**
  * @brief Convert from a Little Endian byte array to a struct
  * 
+ * Payload objects are decoded with the original (EMVER_V0) layout. 
+ *
  * @param[out] dst void Pointer to destination struct
  * @param[in] src void Pointer to unsigned char array
  * @param[in] type unsigned enum _EMOB representing type of object to deserialize
@@ -94,6 +128,26 @@ void emapi_prnt_list_dev(void *ptr);
  * @return number of bytes consumed. -1 upon error otherwise. 
  */
 int emapi_deserialize(void *dst, __u8 *src, unsigned type, void *param)
+{
+	return emapi_deserialize_ver(dst, src, type, param, EMVER_V0);
+}
+
+/**
+ * @brief Convert from a Little Endian byte array to a struct
+ * 
+ * A header selects its own layout from its version field. Payload objects 
+ * use the layout of the header version given in ver.
+ *
+ * @param[out] dst void Pointer to destination struct
+ * @param[in] src void Pointer to unsigned char array
+ * @param[in] type unsigned enum _EMOB representing type of object to deserialize
+ * @param[in] param void * to data needed to deserialize the byte stream 
+ * (e.g. count of objects to expect in the stream)
+ * @param[in] ver unsigned header version [EMVER] of the message
+ * @return number of bytes consumed. 0 if more than EMLN_CONN_NUM connect 
+ * entries are requested. -1 upon error otherwise. 
+ */
+int emapi_deserialize_ver(void *dst, __u8 *src, unsigned type, void *param, unsigned ver)
 {
 	int rv;
 
@@ -112,24 +166,14 @@ int emapi_deserialize(void *dst, __u8 *src, unsigned type, void *param)
 			break;
 
 		case EMOB_HDR: //!< struct emapi_hdr
-		{
-			struct emapi_hdr *o = (struct emapi_hdr*) dst;
-			o->ver 			= (src[ 0] >> 4) & 0x0F;	
-			o->type 		= (src[ 0]     ) & 0x0F;	
-			o->tag 			=  src[ 1]; 
-			o->rc 			=  src[ 2];
-			o->opcode 		=  src[ 3];
-			o->a 			=  src[ 4];
-			o->len 			= (src[ 7] <<  8) |  src[ 6];
-			o->b 			= (src[11] << 24) | (src[10] << 16) | (src[ 9] << 8) | src[ 8];
-			rv = EMLN_HDR;
-		}
+			rv = emapi_dec_hdr((struct emapi_hdr*) dst, src);
 			break;
 
 		case EMOB_LIST_DEV: //!< struct emapi_dev
 		{
 			unsigned i, k, num;
 			struct emapi_dev *o;
+			int n;
 
 			// Initialize variables 
 			k = 0;
@@ -141,19 +185,44 @@ int emapi_deserialize(void *dst, __u8 *src, unsigned type, void *param)
 
 			for ( i = 0 ; i < num ; i++ )
 			{
-				o->id 	= src[k++];	
-				o->len 	= src[k++];	
-				if (o->len == 0)
-					o->name[0] = 0;
-				else 
-					memcpy(o->name, &src[k], o->len);
-				k += o->len;
-				o++;	
+				n = emapi_dec_dev(o++, &src[k], ver);
+				if (n < 0)
+					goto end;
+				k += n;
 			}
 			rv = k; 
 		}
 			break;
 
+		case EMOB_CONN_BATCH: //!< struct emapi_conn_ent
+		{
+			unsigned i, num;
+			struct emapi_conn_ent *o;
+
+			// Initialize variables 
+			o = (struct emapi_conn_ent*) dst;
+			if (param == NULL) 
+				num = 1;
+			else 
+				num = *((unsigned *) param);
+
+			// Like the serialize side, never write past obj.conn[]
+			if (num > EMLN_CONN_NUM)
+			{
+				rv = 0;
+				goto end;
+			}
+
+			for ( i = 0 ; i < num ; i++ )
+				src += emapi_dec_conn_ent(o++, src, ver);
+			rv = num * EMLN_CONN_ENT; 
+		}
+			break;
+
+		case EMOB_HELLO: //!< struct emapi_hello
+			rv = emapi_dec_hello((struct emapi_hello*) dst, src);
+			break;
+
 		default:
 			goto end;
 	}
@@ -163,6 +232,483 @@ end:
 	return rv;
 }
 
+/**
+ * Scalar decode of headers [i, num) into a structure of arrays 
+ */
+static void emapi_deserialize_hdrs_scalar(struct emapi_hdr_soa *d, __u8 *src, unsigned i, unsigned num)
+{
+	__u8 *p;
+
+	for ( ; i < num ; i++ )
+	{
+		p = &src[i * EMLN_HDR];
+		d->ver[i] 		= (p[ 0] >> 4) & 0x0F;
+		d->type[i] 		= (p[ 0]     ) & 0x0F;
+		d->tag[i] 		=  p[ 1];
+		d->rc[i] 		=  p[ 2];
+		d->opcode[i] 	=  p[ 3];
+		d->a[i] 		=  p[ 4];
+		if (d->ver[i] >= EMVER_V2)
+			d->a[i] 	|= (p[ 5] <<  8);
+		d->len[i] 		= (p[ 7] <<  8) |  p[ 6];
+		d->b[i] 		= ((__u32) p[11] << 24) | (p[10] << 16) | (p[ 9] << 8) | p[ 8];
+	}
+}
+
+#ifdef EMAPI_X86
+/**
+ * SSSE3 decode of headers in groups of four 
+ *
+ * Four headers occupy 48 bytes, i.e. three 16 byte registers. Each output 
+ * vector is assembled by shuffling the bytes it needs out of each of the 
+ * three registers and OR'ing the results together:
+ * - fld: first four bytes (type/ver, tag, rc, opcode) of each header
+ * - len: bytes 4-5 (Immediate A) of each header in bytes 0-7, len in bytes 8-15
+ * - b:   Immediate B of each header
+ *
+ * Byte 5 is only part of Immediate A from EMVER_V2 on, so it is masked off
+ * for headers of older versions.
+ *
+ * @return number of headers decoded 
+ */
+__attribute__((target("ssse3")))
+static unsigned emapi_deserialize_hdrs_ssse3(struct emapi_hdr_soa *d, __u8 *src, unsigned num)
+{
+	__m128i r0, r1, r2, fld, len, b, wide;
+	unsigned i;
+	__u32 u;
+
+	const __m128i f0 = _mm_setr_epi8(   0,   12, -128, -128,    1,   13, -128, -128,    2,   14, -128, -128,    3,   15, -128, -128);
+	const __m128i f1 = _mm_setr_epi8(-128, -128,    8, -128, -128, -128,    9, -128, -128, -128,   10, -128, -128, -128,   11, -128);
+	const __m128i f2 = _mm_setr_epi8(-128, -128, -128,    4, -128, -128, -128,    5, -128, -128, -128,    6, -128, -128, -128,    7);
+	const __m128i l0 = _mm_setr_epi8(   4,    5, -128, -128, -128, -128, -128, -128,    6,    7, -128, -128, -128, -128, -128, -128);
+	const __m128i l1 = _mm_setr_epi8(-128, -128,    0,    1,   12,   13, -128, -128, -128, -128,    2,    3,   14,   15, -128, -128);
+	const __m128i l2 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128,    8,    9, -128, -128, -128, -128, -128, -128,   10,   11);
+	const __m128i b0 = _mm_setr_epi8(   8,    9,   10,   11, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+	const __m128i b1 = _mm_setr_epi8(-128, -128, -128, -128,    4,    5,    6,    7, -128, -128, -128, -128, -128, -128, -128, -128);
+	const __m128i b2 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128,    0,    1,    2,    3,   12,   13,   14,   15);
+	const __m128i nib = _mm_set1_epi8(0x0F);
+	const __m128i v1 = _mm_set1_epi8(EMVER_V2 - 1);
+	const __m128i ones = _mm_set1_epi8(-1);
+
+	for ( i = 0 ; i + 4 <= num ; i += 4 )
+	{
+		r0 = _mm_loadu_si128((__m128i*) &src[i * EMLN_HDR     ]);
+		r1 = _mm_loadu_si128((__m128i*) &src[i * EMLN_HDR + 16]);
+		r2 = _mm_loadu_si128((__m128i*) &src[i * EMLN_HDR + 32]);
+
+		fld = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r0, f0), _mm_shuffle_epi8(r1, f1)), _mm_shuffle_epi8(r2, f2));
+		len = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r0, l0), _mm_shuffle_epi8(r1, l1)), _mm_shuffle_epi8(r2, l2));
+		b   = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r0, b0), _mm_shuffle_epi8(r1, b1)), _mm_shuffle_epi8(r2, b2));
+
+		// Split the first byte into type (low nibble) and version (high nibble)
+		u = _mm_cvtsi128_si32(_mm_and_si128(fld, nib));
+		memcpy(&d->type[i], &u, 4);
+		wide = _mm_and_si128(_mm_srli_epi16(fld, 4), nib);
+		u = _mm_cvtsi128_si32(wide);
+		memcpy(&d->ver[i], &u, 4);
+
+		// Keep the upper byte of Immediate A only for wide headers: 0x00FF or 0xFFFF per header
+		wide = _mm_unpacklo_epi8(ones, _mm_cmpgt_epi8(wide, v1));
+
+		u = _mm_cvtsi128_si32(_mm_srli_si128(fld, 4));
+		memcpy(&d->tag[i], &u, 4);
+		u = _mm_cvtsi128_si32(_mm_srli_si128(fld, 8));
+		memcpy(&d->rc[i], &u, 4);
+		u = _mm_cvtsi128_si32(_mm_srli_si128(fld, 12));
+		memcpy(&d->opcode[i], &u, 4);
+		_mm_storel_epi64((__m128i*) &d->a[i], _mm_and_si128(len, wide));
+		_mm_storel_epi64((__m128i*) &d->len[i], _mm_srli_si128(len, 8));
+		_mm_storeu_si128((__m128i*) &d->b[i], b);
+	}
+
+	return i;
+}
+#endif
+
+/**
+ * @brief Deserialize a run of back to back EM API Headers 
+ *
+ * @param[out] 	dst 		struct emapi_hdr_soa* with arrays of at least num entries
+ * @param[in] 	src 		__u8* to num * EMLN_HDR bytes
+ * @param[in] 	num 		Number of headers to decode
+ * @return 					number of bytes consumed, -1 upon error
+ */
+int emapi_deserialize_hdrs(struct emapi_hdr_soa *dst, __u8 *src, unsigned num)
+{
+	unsigned i;
+
+	// Validate Inputs 
+	if ( (dst == NULL) || (src == NULL) )
+		return -1;
+
+	i = 0;
+
+#ifdef EMAPI_X86
+	if (__builtin_cpu_supports("ssse3"))
+		i = emapi_deserialize_hdrs_ssse3(dst, src, num);
+#endif
+
+	emapi_deserialize_hdrs_scalar(dst, src, i, num);
+
+	return num * EMLN_HDR;
+}
+
+/**
+ * Prepare a cursor over a serialized List Devices payload without copying it
+ *
+ * @param[out] 	v 			struct emapi_dev_view* to initialize
+ * @param[in] 	payload 	__u8* to the serialized payload (e.g. emapi_buf.payload)
+ * @param[in] 	len 		Length of the payload in bytes (emapi_hdr.len)
+ * @param[in] 	num 		Number of entries in the payload (emapi_hdr.a)
+ * @return 					0 upon success, non zero otherwise
+ */
+int emapi_dev_view_init(struct emapi_dev_view *v, __u8 *payload, unsigned len, unsigned num)
+{
+	return emapi_dev_view_init_ver(v, payload, len, num, EMVER_V0);
+}
+
+/**
+ * Prepare a cursor over a serialized List Devices payload of a given header version
+ *
+ * @param[out] 	v 			struct emapi_dev_view* to initialize
+ * @param[in] 	payload 	__u8* to the serialized payload (e.g. emapi_buf.payload)
+ * @param[in] 	len 		Length of the payload in bytes (emapi_hdr.len)
+ * @param[in] 	num 		Number of entries in the payload (emapi_hdr.a)
+ * @param[in] 	ver 		Header version of the response (emapi_hdr.ver)
+ * @return 					0 upon success, non zero otherwise
+ */
+int emapi_dev_view_init_ver(struct emapi_dev_view *v, __u8 *payload, unsigned len, unsigned num, unsigned ver)
+{
+	// Validate Inputs 
+	if ( (v == NULL) || (payload == NULL && len > 0) || (len > EMLN_PAYLOAD) )
+		return 1;
+
+	v->buf = payload;
+	v->len = len;
+	v->num = num;
+	v->idx = 0;
+	v->off = 0;
+	v->idlen = ver >= EMVER_V2 ? 4 : 1;
+	return 0;
+}
+
+/**
+ * Advance a List Devices cursor to the next entry 
+ *
+ * The returned name pointer refers to the payload buffer and is only valid 
+ * as long as that buffer is. 
+ *
+ * @param[in] 	v 			struct emapi_dev_view* to advance
+ * @param[out] 	d 			struct emapi_dev_ref* filled with pointers into the payload
+ * @return 					1 if an entry was returned, 0 at the end, -1 if the payload is truncated
+ */
+int emapi_dev_next(struct emapi_dev_view *v, struct emapi_dev_ref *d)
+{
+	__u8 *p;
+
+	if (v->idx >= v->num)
+		return 0;
+
+	// Each entry is at least the id and len bytes 
+	if (v->off + v->idlen + 1 > v->len)
+		return -1;
+
+	p = &v->buf[v->off];
+	if (v->off + v->idlen + 1 + p[v->idlen] > v->len)
+		return -1;
+
+	if (v->idlen == 4)
+		d->id = ((__u32) p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+	else 
+		d->id = p[0];
+	d->len 	= p[v->idlen];
+	d->name = (char*) &p[v->idlen + 1];
+
+	v->off += v->idlen + 1 + d->len;
+	v->idx++;
+	return 1;
+}
+
+/**
+ * Reset a stream framer to its initial state
+ *
+ * @param[out] 	f 			struct emapi_framer* to initialize
+ */
+void emapi_framer_init(struct emapi_framer *f)
+{
+	f->in = NULL;
+	f->in_len = 0;
+	f->in_off = 0;
+	f->fill = 0;
+}
+
+/**
+ * Hand the next chunk of the byte stream to the framer
+ *
+ * @param[in] 	f 			struct emapi_framer* to feed
+ * @param[in] 	data 		__u8* to the bytes received from the stream
+ * @param[in] 	len 		Number of bytes in data
+ */
+void emapi_framer_feed(struct emapi_framer *f, __u8 *data, unsigned len)
+{
+	f->in = data;
+	f->in_len = len;
+	f->in_off = 0;
+}
+
+/**
+ * Extract the next complete EM API Message from the fed data
+ *
+ * @param[in] 	f 			struct emapi_framer* to read from
+ * @param[out] 	fr 			struct emapi_frame* filled with the next message
+ * @return 					1 if a frame was returned, 0 if more data is needed, -1 upon error
+ */
+int emapi_framer_next(struct emapi_framer *f, struct emapi_frame *fr)
+{
+	unsigned avail, need, n;
+	__u8 *p;
+
+	avail = f->in_len - f->in_off;
+	p = f->in + f->in_off;
+
+	// Complete a frame that was split across chunks 
+	if (f->fill > 0)
+	{
+		if (f->fill < EMLN_HDR)
+		{
+			n = EMLN_HDR - f->fill;
+			if (n > avail)
+				n = avail;
+			memcpy(&f->buf[f->fill], p, n);
+			f->fill += n;
+			f->in_off += n;
+			avail -= n;
+			p += n;
+			if (f->fill < EMLN_HDR)
+				return 0;
+		}
+
+		emapi_dec_hdr(&fr->hdr, f->buf);
+		if (fr->hdr.len > EMLN_PAYLOAD)
+			return -1;
+
+		need = EMLN_HDR + fr->hdr.len - f->fill;
+		n = need < avail ? need : avail;
+		memcpy(&f->buf[f->fill], p, n);
+		f->fill += n;
+		f->in_off += n;
+		if (n < need)
+			return 0;
+
+		fr->buf = f->buf;
+		fr->payload = &f->buf[EMLN_HDR];
+		fr->len = f->fill;
+		f->fill = 0;
+		return 1;
+	}
+
+	if (avail == 0)
+		return 0;
+
+	// Stage a partial header 
+	if (avail < EMLN_HDR)
+	{
+		memcpy(f->buf, p, avail);
+		f->fill = avail;
+		f->in_off += avail;
+		return 0;
+	}
+
+	emapi_dec_hdr(&fr->hdr, p);
+	if (fr->hdr.len > EMLN_PAYLOAD)
+		return -1;
+
+	// Stage a partial frame 
+	if (avail < EMLN_HDR + (unsigned) fr->hdr.len)
+	{
+		memcpy(f->buf, p, avail);
+		f->fill = avail;
+		f->in_off += avail;
+		return 0;
+	}
+
+	// Return the frame in place 
+	fr->buf = p;
+	fr->payload = p + EMLN_HDR;
+	fr->len = EMLN_HDR + fr->hdr.len;
+	f->in_off += fr->len;
+	return 1;
+}
+
+/**
+ * Prepare a cursor over the messages of an envelope without copying them
+ *
+ * @param[out] 	v 			struct emapi_env_view* to initialize
+ * @param[in] 	f 			struct emapi_frame* holding an EMOP_ENVELOPE message
+ * @return 					0 upon success, non zero otherwise
+ */
+int emapi_env_view_init(struct emapi_env_view *v, struct emapi_frame *f)
+{
+	// Validate Inputs 
+	if ( (v == NULL) || (f == NULL) || (f->hdr.opcode != EMOP_ENVELOPE) || (f->hdr.len > EMLN_PAYLOAD) )
+		return 1;
+
+	v->buf = f->payload;
+	v->len = f->hdr.len;
+	v->num = f->hdr.a;
+	v->idx = 0;
+	v->off = 0;
+	return 0;
+}
+
+/**
+ * Advance an envelope cursor to the next message
+ *
+ * The returned frame points into the envelope and is valid as long as the 
+ * envelope is.
+ *
+ * @param[in] 	v 			struct emapi_env_view* to advance
+ * @param[out] 	f 			struct emapi_frame* filled with the next message
+ * @return 					1 if a message was returned, 0 at the end, -1 if the envelope is malformed
+ */
+int emapi_env_next(struct emapi_env_view *v, struct emapi_frame *f)
+{
+	__u8 *p;
+
+	if (v->idx >= v->num)
+		return v->off == v->len ? 0 : -1;
+
+	if (v->off + EMLN_HDR > v->len)
+		return -1;
+
+	p = &v->buf[v->off];
+	emapi_dec_hdr(&f->hdr, p);
+	if (v->off + EMLN_HDR + f->hdr.len > v->len || f->hdr.opcode == EMOP_ENVELOPE)
+		return -1;
+
+	f->buf = p;
+	f->payload = p + EMLN_HDR;
+	f->len = EMLN_HDR + f->hdr.len;
+	v->off += f->len;
+	v->idx++;
+	return 1;
+}
+
+/**
+ * Prepare an envelope encoder
+ *
+ * @param[out] 	e 			struct emapi_coal* to initialize
+ * @param[in] 	max 		Bytes queued before emapi_coal_due() is true. 0 or 
+ * 							values above EMLN_MSG mean EMLN_MSG
+ * @param[in] 	max_us 		Age in microseconds of the oldest message before 
+ * 							emapi_coal_due() is true. 0 disables the time threshold
+ * @return 					0 upon success, non zero otherwise
+ */
+int emapi_coal_init(struct emapi_coal *e, unsigned max, unsigned max_us)
+{
+	// Validate Inputs 
+	if (e == NULL)
+		return 1;
+
+	e->max = (max == 0 || max > EMLN_MSG) ? EMLN_MSG : max;
+	e->max_ns = (__u64) max_us * 1000;
+	emapi_coal_reset(e);
+	return 0;
+}
+
+/**
+ * Copy a message into the envelope
+ *
+ * @param[in] 	e 			struct emapi_coal*
+ * @param[in] 	h 			struct emapi_hdr* of the message. h->len must be the payload length
+ * @param[in] 	payload 	Serialized payload or NULL if h->len is 0
+ * @return 					0 upon success, 1 if the envelope is full and must 
+ * 							be sealed first, -1 upon error
+ */
+int emapi_coal_add(struct emapi_coal *e, struct emapi_hdr *h, __u8 *payload)
+{
+	// Validate Inputs 
+	if ( (e == NULL) || (h == NULL) || (h->len > EMLN_PAYLOAD) || (h->len > 0 && payload == NULL) 
+		|| (h->opcode == EMOP_ENVELOPE) )
+		return -1;
+
+	if ( (e->num >= EMLN_ENV_NUM) || (e->len + EMLN_HDR + h->len > EMLN_MSG) )
+		return 1;
+
+	if (e->num == 0)
+	{
+		e->type = h->type;
+		if (e->max_ns > 0)
+			e->t0 = emapi_now_ns();
+	}
+
+	emapi_enc_hdr(&e->buf[e->len], h);
+	if (h->len > 0)
+		memcpy(&e->buf[e->len + EMLN_HDR], payload, h->len);
+	e->len += EMLN_HDR + h->len;
+	e->num++;
+	return 0;
+}
+
+/**
+ * Whether the envelope has reached its size or time threshold
+ *
+ * @param[in] 	e 			struct emapi_coal*
+ * @return 					1 if the envelope should be sealed and sent, 0 otherwise
+ */
+int emapi_coal_due(struct emapi_coal *e)
+{
+	if (e->num == 0)
+		return 0;
+	if (e->len >= e->max)
+		return 1;
+	if (e->max_ns > 0 && emapi_now_ns() - e->t0 >= e->max_ns)
+		return 1;
+	return 0;
+}
+
+/**
+ * Finish the envelope
+ *
+ * A single message is returned as is, without the envelope header. The 
+ * returned bytes stay valid until emapi_coal_reset().
+ *
+ * @param[in] 	e 			struct emapi_coal*
+ * @param[out] 	buf 		Set to the start of the bytes to send
+ * @return 					number of bytes to send, 0 if empty
+ */
+int emapi_coal_seal(struct emapi_coal *e, __u8 **buf)
+{
+	struct emapi_hdr h;
+
+	if (e->num == 0)
+		return 0;
+
+	if (e->num == 1)
+	{
+		*buf = &e->buf[EMLN_HDR];
+		return e->len - EMLN_HDR;
+	}
+
+	emapi_fill_hdr(&h, e->type, 0, 0, EMOP_ENVELOPE, e->len - EMLN_HDR, e->num, 0);
+	emapi_enc_hdr(e->buf, &h);
+	*buf = e->buf;
+	return e->len;
+}
+
+/**
+ * Empty the envelope after the sealed bytes were sent
+ *
+ * @param[in] 	e 			struct emapi_coal*
+ */
+void emapi_coal_reset(struct emapi_coal *e)
+{
+	e->num = 0;
+	e->len = EMLN_HDR;
+	e->t0 = 0;
+}
+
 /**
  * Convenience function to populate a emapi_hdr object 
  *
@@ -172,7 +718,7 @@ end:
  * @param[in] 	rc 			__u8 retrun code
  * @param[in] 	opcode    	__u8 opcode [EMOP]	
  * @param[in] 	len  		__u16 Length of payload in bytes 		
- * @param[in] 	a         	__u8 Immediate value A
+ * @param[in] 	a         	__u16 Immediate value A
  * @param[in] 	b         	__u32 Immediate value B
  */
 int emapi_fill_hdr
@@ -183,7 +729,7 @@ int emapi_fill_hdr
 	__u8 rc,				
 	__u8 opcode,    		
 	__u16 len, 				
-	__u8 a,
+	__u16 a,
 	__u32 b					
 )
 {
@@ -302,98 +848,605 @@ end:
 	return rv;
 }
 
-/**
- * @brief Convert an object into Little Endian byte array format
- * 
- * @param[out] dst void Pointer to destination unsigned char array
- * @param[in] src void Pointer to object to serialize
- * @param[in] type unsigned enum _EMOB representing type of object to serialize
- * @return number of serialized bytes, 0 if error 
+/** 
+ * Prepare an EM API Message - Connect Batch 
+ *
+ * Entries are appended with emapi_fill_batch_add()
+ *
+ * @param m		emapi_msg* to fill
+ * @return 		0 upon success, non zero otherwise
  */
-int emapi_serialize(__u8 *dst, void *src, unsigned type, void *param)
+int emapi_fill_conn_batch(struct emapi_msg *m)
 {
 	int rv;
 
-	// Initialize variables 
-	rv = 0;
+	// Initialize variables
+	rv = 1;
 
 	// Validate Inputs 
-	if ( (type == EMOB_NULL) || (type >= EMOB_MAX) )
+	if (m == NULL)
 		goto end;
 
-	switch(type)
-	{
-		case EMOB_HDR: //!< struct emapi_hdr
-		{
-			struct emapi_hdr *o = (struct emapi_hdr*) src;
-			dst[0]  = ((o->ver  << 4) & 0xF0) | (o->type & 0x0F);
-			dst[1]  = o->tag;
-			dst[2]  = o->rc;
-			dst[3]  = o->opcode;
-			dst[4]  = o->a;
-			dst[6]  = (o->len      ) & 0x00FF;
-			dst[7]  = (o->len >> 8 ) & 0x00FF;
-			dst[ 8] = (o->b        ) & 0x00FF;
-			dst[ 9] = (o->b   >>  8) & 0x00FF;
-			dst[10] = (o->b   >> 16) & 0x00FF;
-			dst[11] = (o->b   >> 24) & 0x00FF;
-			rv = EMLN_HDR;
-		}
-			break;
+	// Clear Header
+	memset(&m->hdr, 0, sizeof(struct emapi_hdr));
 
-		case EMOB_LIST_DEV: //!< struct emapi_dev
-		{
-			struct emapi_dev *o = (struct emapi_dev*) src;
-			dst[0] = o->id;
-			dst[1] = o->len;
-			memcpy(&dst[2], o->name, o->len);
-			rv = o->len + 2;;
-		}
-			break;
+	// Set header 
+	m->hdr.opcode = EMOP_CONN_DEV_BATCH;	
 
-		default:
-			goto end;
-	}
+	rv = 0;
 
 end:
-	
-	return rv;
-};
 
-/**
- * Determine the Request Object Identifier [EMOB] for an EM API Message Opcode [EMOP]
- *
- * @param	opcode 	This is an EM API Opcode [EMOP]
- * @return	int		Returns the EM API Object Identifier [EMOB] used in a Request
- */
-int emapi_emob_req(unsigned int opcode)
-{
-	switch (opcode)
-	{
-		case EMOP_EVENT:				return EMOB_NULL;	
-		case EMOP_LIST_DEV:				return EMOB_LIST_DEV;
-		case EMOP_CONN_DEV:				return EMOB_NULL;	
-		case EMOP_DISCON_DEV: 			return EMOB_NULL;
-		default: 						return EMOB_NULL;
-	}
+	return rv;
 }
 
-/**
- * Determine the Response Object Identifier [EMOB] for an EM API Message Opcode [EMOP]
+/** 
+ * Prepare an EM API Message - Disconnect Batch 
  *
- * @param	opcode 	This is an EM API Opcode [EMOP]
- * @return	int		Returns the EM API Object Identifier [EMOB] used in a Response 
+ * Entries are appended with emapi_fill_batch_add()
+ *
+ * @param m		emapi_msg* to fill
+ * @return 		0 upon success, non zero otherwise
  */
-int emapi_emob_rsp(unsigned int opcode)
+int emapi_fill_disconn_batch(struct emapi_msg *m)
 {
-	switch (opcode)
+	int rv;
+
+	// Initialize variables
+	rv = 1;
+
+	// Validate Inputs 
+	if (m == NULL)
+		goto end;
+
+	// Clear Header
+	memset(&m->hdr, 0, sizeof(struct emapi_hdr));
+
+	// Set header 
+	m->hdr.opcode = EMOP_DISCON_DEV_BATCH;	
+
+	rv = 0;
+
+end:
+
+	return rv;
+}
+
+/**
+ * Fill in the features supported by this library
+ *
+ * The transport always unpacks envelopes and EMOP_ENVELOPE and EMOP_HELLO 
+ * are always advertised.
+ *
+ * @param h 	struct emapi_hello* to fill in
+ * @param t 	struct emapi_ops* whose registered opcodes are advertised, 
+ * 				NULL to advertise every opcode below EMOP_MAX
+ */
+void emapi_hello_init(struct emapi_hello *h, const struct emapi_ops *t)
+{
+	unsigned i;
+
+	memset(h, 0, sizeof(*h));
+	h->ver = EMVER_V2;
+	h->caps = EMHC_ENVELOPE;
+	h->max_msg = EMLN_MSG;
+
+	for ( i = 0 ; i < 256 ; i++ )
+		if ( (t == NULL) ? (i < EMOP_MAX && i != EMOP_EVENT) : (t->op[i].fn != NULL) )
+			h->ops[i / 8] |= 1 << (i % 8);
+
+	h->ops[EMOP_ENVELOPE / 8] |= 1 << (EMOP_ENVELOPE % 8);
+	h->ops[EMOP_HELLO / 8] |= 1 << (EMOP_HELLO % 8);
+}
+
+/**
+ * Compute the features supported by both ends
+ *
+ * @param dst 	struct emapi_hello* to fill in. May be a or b
+ * @param a 	struct emapi_hello* of one end
+ * @param b 	struct emapi_hello* of the other end
+ */
+void emapi_hello_merge(struct emapi_hello *dst, const struct emapi_hello *a, const struct emapi_hello *b)
+{
+	unsigned i;
+
+	dst->ver = a->ver < b->ver ? a->ver : b->ver;
+	dst->caps = a->caps & b->caps;
+	dst->max_msg = a->max_msg < b->max_msg ? a->max_msg : b->max_msg;
+	for ( i = 0 ; i < sizeof(dst->ops) ; i++ )
+		dst->ops[i] = a->ops[i] & b->ops[i];
+}
+
+/**
+ * Test whether an opcode is set in a hello object
+ *
+ * @param h 		struct emapi_hello*
+ * @param opcode 	Opcode [EMOP]
+ * @return 			non zero if the opcode is supported
+ */
+int emapi_hello_has(const struct emapi_hello *h, unsigned opcode)
+{
+	if (opcode > 0xFF)
+		return 0;
+	return (h->ops[opcode / 8] >> (opcode % 8)) & 1;
+}
+
+/** 
+ * Append an entry to a Connect Batch or Disconnect Batch message
+ *
+ * Immediate A and the payload length are updated to match
+ *
+ * @param m		emapi_msg* prepared by emapi_fill_conn_batch() or emapi_fill_disconn_batch()
+ * @param ppid 	PPID
+ * @param dev 	Device ID. Ignored by Disconnect Batch
+ * @param flags [EMCF] flags
+ * @return 		0 upon success, non zero if the message is full
+ */
+int emapi_fill_batch_add(struct emapi_msg *m, int ppid, int dev, int flags)
+{
+	struct emapi_conn_ent *e;
+	int rv;
+
+	// Initialize variables
+	rv = 1;
+
+	// Validate Inputs 
+	if ( (m == NULL) || (m->hdr.a >= EMLN_CONN_NUM) )
+		goto end;
+
+	e = &m->obj.conn[m->hdr.a];
+	e->ppid = ppid;
+	e->flags = flags;
+	e->rc = 0;
+	e->dev = dev;
+
+	m->hdr.a++;
+	m->hdr.len = m->hdr.a * EMLN_CONN_ENT;
+		
+	rv = 0;
+
+end:
+
+	return rv;
+}
+
+/** 
+ * Prepare a compact EM API Message - Connect
+ *
+ * @param m		emapi_smsg* to fill
+ * @return 		0 upon success, non zero otherwise
+ */
+int emapi_sfill_conn(struct emapi_smsg *m, int ppid, int dev)
+{
+	int rv;
+
+	// Initialize variables
+	rv = 1;
+
+	// Validate Inputs 
+	if (m == NULL)
+		goto end;
+
+	// Clear Header
+	memset(&m->hdr, 0, sizeof(struct emapi_hdr));
+
+	// Set header 
+	m->hdr.opcode = EMOP_CONN_DEV;	
+	m->hdr.a = ppid;
+	m->hdr.b = dev;
+
+	// Set object
+	m->payload = NULL;
+		
+	rv = 0;
+
+end:
+
+	return rv;
+}
+
+/** 
+ * Prepare a compact EM API Message - Disconnect
+ *
+ * @param m		emapi_smsg* to fill
+ * @return 		0 upon success, non zero otherwise
+ */
+int emapi_sfill_disconn(struct emapi_smsg *m, int ppid, int all)
+{
+	int rv;
+
+	// Initialize variables
+	rv = 1;
+
+	// Validate Inputs 
+	if (m == NULL)
+		goto end;
+
+	// Clear Header
+	memset(&m->hdr, 0, sizeof(struct emapi_hdr));
+
+	// Set header 
+	m->hdr.opcode = EMOP_DISCON_DEV;	
+	m->hdr.a = ppid;
+	m->hdr.b = all;
+
+	// Set object
+	m->payload = NULL;
+		
+	rv = 0;
+
+end:
+
+	return rv;
+}
+
+/** 
+ * Prepare a compact EM API Message - List Devices
+ *
+ * @param m		emapi_smsg* to fill
+ * @return 		0 upon success, non zero otherwise
+ */
+int emapi_sfill_listdev(struct emapi_smsg *m, int num, int start)
+{
+	int rv;
+
+	// Initialize variables
+	rv = 1;
+
+	// Validate Inputs 
+	if (m == NULL)
+		goto end;
+
+	// Clear Header
+	memset(&m->hdr, 0, sizeof(struct emapi_hdr));
+
+	// Set header 
+	m->hdr.opcode = EMOP_LIST_DEV;	
+	m->hdr.a = num;
+	m->hdr.b = start;
+
+	// Set object
+	m->payload = NULL;
+		
+	rv = 0;
+
+end:
+
+	return rv;
+}
+
+/**
+ * @brief Serialize a compact EM API Message 
+ *
+ * Writes the header followed by m->hdr.len bytes of the out-of-line payload.
+ *
+ * @param[out] 	dst 		__u8* to at least EMLN_HDR + m->hdr.len bytes
+ * @param[in] 	m 			struct emapi_smsg* to serialize
+ * @return 					number of serialized bytes, -1 upon error
+ */
+int emapi_serialize_smsg(__u8 *dst, struct emapi_smsg *m)
+{
+	// Validate Inputs 
+	if ( (dst == NULL) || (m == NULL) || (m->hdr.len > EMLN_PAYLOAD) )
+		return -1;
+	if ( (m->hdr.len > 0) && (m->payload == NULL) )
+		return -1;
+
+	emapi_enc_hdr(dst, &m->hdr);
+	if (m->hdr.len > 0)
+		memcpy(&dst[EMLN_HDR], m->payload, m->hdr.len);
+
+	return EMLN_HDR + m->hdr.len;
+}
+
+/**
+ * @brief Deserialize a compact EM API Message 
+ *
+ * Decodes the header and points m->payload at the serialized payload in src 
+ * without copying it. The caller must provide the complete frame.
+ *
+ * @param[out] 	m 			struct emapi_smsg* to fill
+ * @param[in] 	src 		__u8* to a serialized header + payload
+ * @return 					number of bytes consumed, -1 upon error
+ */
+int emapi_deserialize_smsg(struct emapi_smsg *m, __u8 *src)
+{
+	// Validate Inputs 
+	if ( (m == NULL) || (src == NULL) )
+		return -1;
+
+	emapi_dec_hdr(&m->hdr, src);
+	if (m->hdr.len > EMLN_PAYLOAD)
+		return -1;
+
+	m->payload = NULL;
+	if (m->hdr.len > 0)
+		m->payload = &src[EMLN_HDR];
+
+	return EMLN_HDR + m->hdr.len;
+}
+
+/**
+ * @brief Convert an object into Little Endian byte array format
+ * 
+ * Payload objects are encoded with the original (EMVER_V0) layout. 
+ *
+ * @param[out] dst void Pointer to destination unsigned char array
+ * @param[in] src void Pointer to object to serialize
+ * @param[in] type unsigned enum _EMOB representing type of object to serialize
+ * @param[in] param void * to data needed to serialize the byte stream 
+ * (e.g. count of objects to serialize)
+ * @return number of serialized bytes, 0 if error 
+ */
+int emapi_serialize(__u8 *dst, void *src, unsigned type, void *param)
+{
+	return emapi_serialize_ver(dst, src, type, param, EMVER_V0);
+}
+
+/**
+ * @brief Convert an object into Little Endian byte array format
+ * 
+ * A header selects its own layout from its version field. Payload objects 
+ * use the layout of the header version given in ver. Fields wider than the
+ * layout allows are truncated.
+ *
+ * @param[out] dst void Pointer to destination unsigned char array
+ * @param[in] src void Pointer to object to serialize
+ * @param[in] type unsigned enum _EMOB representing type of object to serialize
+ * @param[in] param void * to data needed to serialize the byte stream 
+ * (e.g. count of objects to serialize)
+ * @param[in] ver unsigned header version [EMVER] of the message
+ * @return number of serialized bytes, 0 if error 
+ */
+int emapi_serialize_ver(__u8 *dst, void *src, unsigned type, void *param, unsigned ver)
+{
+	int rv;
+
+	// Initialize variables 
+	rv = 0;
+
+	// Validate Inputs 
+	if ( (type == EMOB_NULL) || (type >= EMOB_MAX) )
+		goto end;
+
+	switch(type)
+	{
+		case EMOB_HDR: //!< struct emapi_hdr
+			rv = emapi_enc_hdr(dst, (struct emapi_hdr*) src);
+			break;
+
+		case EMOB_LIST_DEV: //!< struct emapi_dev
+		{
+			unsigned i, k, num;
+			struct emapi_dev *o;
+			int n;
+
+			// Initialize variables 
+			k = 0;
+			o = (struct emapi_dev*) src;
+			if (param == NULL) 
+				num = 1;
+			else 
+				num = *((unsigned *) param);
+
+			for ( i = 0 ; i < num ; i++ )
+			{
+				if (k + (ver >= EMVER_V2 ? 5 : 2) + o->len > EMLN_PAYLOAD)
+					goto end;
+				n = emapi_enc_dev(&dst[k], o++, ver);
+				if (n < 0)
+					goto end;
+				k += n;
+			}
+			rv = k;
+		}
+			break;
+
+		case EMOB_CONN_BATCH: //!< struct emapi_conn_ent
+		{
+			unsigned i, num;
+			struct emapi_conn_ent *o;
+
+			// Initialize variables 
+			o = (struct emapi_conn_ent*) src;
+			if (param == NULL) 
+				num = 1;
+			else 
+				num = *((unsigned *) param);
+
+			if (num > EMLN_CONN_NUM)
+				goto end;
+
+			for ( i = 0 ; i < num ; i++ )
+				dst += emapi_enc_conn_ent(dst, o++, ver);
+			rv = num * EMLN_CONN_ENT;
+		}
+			break;
+
+		case EMOB_HELLO: //!< struct emapi_hello
+			rv = emapi_enc_hello(dst, (struct emapi_hello*) src);
+			break;
+
+		default:
+			goto end;
+	}
+
+end:
+	
+	return rv;
+};
+
+/**
+ * @brief Serialize a complete List Devices response in one call
+ *
+ * Serializes num entries of m->obj.dev into the payload, then fills in and 
+ * serializes the header with the payload length, Immediate A set to the 
+ * number of devices returned and Immediate B set to the total number of 
+ * devices. The tag, return code and version of m->hdr are preserved and 
+ * the version selects the layout of the entries. 
+ *
+ * @param[out] 	b 			struct emapi_buf* to serialize into
+ * @param[in] 	m 			struct emapi_msg* holding the devices
+ * @param[in] 	num 		Number of entries in m->obj.dev to serialize
+ * @param[in] 	total 		Total number of devices 
+ * @return 					length of EM API Header + payload, -1 upon error
+ */
+int emapi_serialize_listdev(struct emapi_buf *b, struct emapi_msg *m, unsigned num, unsigned total)
+{
+	int rv, len;
+
+	// Initialize variables 
+	rv = -1;
+
+	// Validate Inputs 
+	if ( (b == NULL) || (m == NULL) || (num > EMLN_DEV_NUM) )
+		goto end;
+
+	len = 0;
+	if (num > 0) 
+	{
+		len = emapi_serialize_ver(b->payload, m->obj.dev, EMOB_LIST_DEV, &num, m->hdr.ver);
+		if (len == 0)
+			goto end;
+	}
+
+	m->hdr.type = EMMT_RSP;
+	m->hdr.opcode = EMOP_LIST_DEV;
+	m->hdr.a = num;
+	m->hdr.b = total;
+	m->hdr.len = len;
+	emapi_enc_hdr(b->hdr, &m->hdr);
+
+	rv = EMLN_HDR + len;
+
+end:
+
+	return rv;
+}
+
+/**
+ * @brief Serialize an EM API Message into an iovec array for writev()/sendmsg()
+ *
+ * struct emapi_dev stores id, len and name back to back, so each entry is 
+ * sent straight from the message. From EMVER_V2 on an entry is one iovec. 
+ * Before EMVER_V2 the id is 1 byte and an entry takes two iovecs: the low 
+ * byte of the id and then len and name. Either way this requires a little
+ * endian host.
+ * 
+ * @param[out] 	iov 		struct iovec array to fill
+ * @param[in] 	iovcnt 		Number of entries available in iov
+ * @param[out] 	hdr 		__u8 buffer of EMLN_HDR bytes to hold the serialized header
+ * @param[in] 	m 			struct emapi_msg* to serialize
+ * @param[in] 	type 		unsigned enum _EMOB of the payload object
+ * @param[in] 	num 		Number of payload objects stored in m->obj
+ * @return 					number of iovec entries used, -1 upon error
+ */
+int emapi_serialize_iov(struct iovec *iov, unsigned iovcnt, __u8 *hdr, struct emapi_msg *m, unsigned type, unsigned num)
+{
+	unsigned i, len, cnt;
+	int rv;
+
+	// Initialize variables 
+	rv = -1;
+	len = 0;
+	cnt = 1;
+
+	// Validate Inputs 
+	if ( (iov == NULL) || (iovcnt < 1) || (hdr == NULL) || (m == NULL) )
+		goto end;
+
+	switch(type)
 	{
-		case EMOP_EVENT:				return EMOB_NULL;
-		case EMOP_LIST_DEV:				return EMOB_LIST_DEV;
-		case EMOP_CONN_DEV:				return EMOB_NULL;	
-		case EMOP_DISCON_DEV: 			return EMOB_NULL;
-		default: 						return EMOB_NULL;
+		case EMOB_NULL:
+			break;
+
+		case EMOB_LIST_DEV: //!< struct emapi_dev
+		{
+			struct emapi_dev *d;
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+			goto end;
+#endif
+			if (num > EMLN_DEV_NUM)
+				goto end;
+
+			for ( i = 0 ; i < num ; i++ )
+			{
+				d = &m->obj.dev[i];
+				if (d->len > EMLN_DEV_NAME)
+					goto end;
+				if (m->hdr.ver >= EMVER_V2)
+				{
+					if (cnt + 1 > iovcnt)
+						goto end;
+					iov[cnt].iov_base = d;
+					iov[cnt++].iov_len = 5 + d->len;
+					len += 5 + d->len;
+					continue;
+				}
+
+				if (cnt + 2 > iovcnt)
+					goto end;
+				iov[cnt].iov_base = &d->id;
+				iov[cnt++].iov_len = 1;
+				iov[cnt].iov_base = &d->len;
+				iov[cnt++].iov_len = 1 + d->len;
+				len += 2 + d->len;
+			}
+			if (len > EMLN_PAYLOAD)
+				goto end;
+		}
+			break;
+
+		default:
+			goto end;
 	}
+
+	m->hdr.len = len;
+	emapi_enc_hdr(hdr, &m->hdr);
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = EMLN_HDR;
+	rv = cnt;
+
+end:
+
+	return rv;
+}
+
+/**
+ * Determine the Request Object Identifier [EMOB] for an EM API Message Opcode [EMOP]
+ *
+ * @param	opcode 	This is an EM API Opcode [EMOP]
+ * @return	int		Returns the EM API Object Identifier [EMOB] used in a Request
+ */
+int emapi_emob_req(unsigned int opcode)
+{
+	if (opcode >= EMOP_MAX) 	return EMOB_NULL;
+	return EMOP_INFO[opcode].req;
+}
+
+/**
+ * Determine the Response Object Identifier [EMOB] for an EM API Message Opcode [EMOP]
+ *
+ * @param	opcode 	This is an EM API Opcode [EMOP]
+ * @return	int		Returns the EM API Object Identifier [EMOB] used in a Response 
+ */
+int emapi_emob_rsp(unsigned int opcode)
+{
+	if (opcode >= EMOP_MAX) 	return EMOB_NULL;
+	return EMOP_INFO[opcode].rsp;
+}
+
+/**
+ * Look up the properties of an EM API Message Opcode [EMOP]
+ *
+ * @param	opcode 	This is an EM API Opcode [EMOP]
+ * @return	struct emapi_opinfo* for the opcode, NULL if the opcode is unknown
+ */
+const struct emapi_opinfo *emapi_opinfo(unsigned int opcode)
+{
+	if (opcode >= EMOP_MAX) 	return NULL;
+	return &EMOP_INFO[opcode];
 }
 
 /* Functions to return a string representation of an object*/
@@ -436,6 +1489,8 @@ void emapi_prnt(void *ptr, unsigned type)
 	{
 		case EMOB_HDR:         emapi_prnt_hdr(ptr);						break;
 		case EMOB_LIST_DEV:    emapi_prnt_list_dev(ptr);				break;
+		case EMOB_CONN_BATCH:  emapi_prnt_conn_ent(ptr);				break;
+		case EMOB_HELLO:       emapi_prnt_hello(ptr);					break;
 		default: break;
 	}
 }
@@ -449,7 +1504,7 @@ void emapi_prnt_hdr(void *ptr)
 	printf("Tag:               0x%02x\n", o->tag);
 	printf("Return Code:       0x%02x\n", o->rc);
 	printf("Opcode:            0x%02x\n", o->opcode);
-	printf("Immediate: A       0x%02x\n", o->a);
+	printf("Immediate: A       0x%04x\n", o->a);
 	printf("Len:               0x%04x\n", o->len);
 	printf("Immediate: B       0x%08x\n", o->b);
 }
@@ -457,6 +1512,27 @@ void emapi_prnt_hdr(void *ptr)
 void emapi_prnt_list_dev(void *ptr)
 {
 	struct emapi_dev *o = (struct emapi_dev*) ptr;
-	printf("%02d - %s\n", o->id, o->name);
+	printf("%02u - %s\n", o->id, o->name);
 }
 
+void emapi_prnt_conn_ent(void *ptr)
+{
+	struct emapi_conn_ent *o = (struct emapi_conn_ent*) ptr;
+	printf("ppid %02d dev %u flags 0x%02x rc %s\n", o->ppid, o->dev, o->flags, emrc(o->rc));
+}
+
+void emapi_prnt_hello(void *ptr)
+{
+	struct emapi_hello *o = (struct emapi_hello*) ptr;
+	unsigned i;
+
+	printf("emapi_hello:\n");
+	printf("Version:           0x%02x\n", o->ver);
+	printf("Capabilities:      0x%04x\n", o->caps);
+	printf("Max message:       %u\n", o->max_msg);
+	printf("Opcodes:          ");
+	for ( i = 0 ; i < 256 ; i++ )
+		if (emapi_hello_has(o, i))
+			printf(" 0x%02x", i);
+	printf("\n");
+}
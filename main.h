@@ -26,6 +26,15 @@
  */
 #include <linux/types.h>
 
+/**
+ * For struct iovec 
+ */
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* MACROS ====================================================================*/
 
 // Length of struct emapi_hdr 
@@ -39,6 +48,62 @@
 // Maximum numberof devices returned 
 #define EMLN_DEV_NUM 				64
 
+// Maximum number of entries in a batched connect / disconnect 
+#define EMLN_CONN_NUM 				128
+
+// Length of a serialized batched connect / disconnect entry 
+#define EMLN_CONN_ENT 				8
+
+// Maximum number of messages in an envelope 
+#define EMLN_ENV_NUM 				255
+
+// Size of the per connection read buffer 
+#define EMLN_RX_BUF 				65536
+
+// Number of distinct tags, i.e. max requests in flight per connection 
+#define EMLN_TAGS 					256
+
+// Batched connect / disconnect entry flags 
+#define EMCF_ALL 					0x01 	//!< Disconnect every device from the PPID
+
+// Length of a serialized hello object 
+#define EMLN_HELLO 					40
+
+// Hello capability flags 
+#define EMHC_ENVELOPE 				0x0001 	//!< Unpacks messages coalesced in an EMOP_ENVELOPE
+
+// Formatter flags 
+#define EMFM_JSON 					0x01 	//!< Write JSON instead of key=value text
+
+// Opcode flags 
+#define EMOF_CHK_IMM 				0x01 	//!< Immediates are validated against emapi_opinfo.max_a/b
+
+// Returned by a transport backend that cannot run on this kernel 
+#define EMTB_UNAVAILABLE 			(-2)
+
+// Default size of each direction of a shared memory ring 
+#define EMLN_SHM_RING 				(256*1024)
+
+// Shared memory ring flags 
+#define EMSH_MPSC 					0x01 	//!< Several threads or processes may send on the same end
+
+// Latency histograms: 2^EMST_SUB_BITS linear buckets per power of 2 up to 2^40 ns 
+#define EMST_SUB_BITS 				3
+#define EMST_BUCKETS 				312
+#define EMST_OPS 					16 		//!< Opcodes with their own histogram. Larger opcodes share the last one
+#define EMST_RCS 					8 		//!< Return codes with their own histogram. Larger codes share the last one
+#define EMST_RC_NONE 				0xFF 	//!< No return code known, only the opcode histogram is updated
+
+// Default bytes of each frame kept by the capture ring 
+#define EMLN_CAP_SNAP 				256
+
+// Pool block sizes 
+#define EMPL_SIZE_HDR 				64 		//!< Header-only messages (struct emapi_smsg, serialized header)
+#define EMPL_SIZE_SMALL 			1024 	//!< Messages with a small payload
+
+// Pool flags 
+#define EMPL_HUGEPAGE 				0x01 	//!< Back the pool with huge pages when available
+
 /* ENUMERATIONS ==============================================================*/
 
 /**
@@ -51,9 +116,25 @@ enum _EMOB
 	EMOB_NULL				=  0,
 	EMOB_HDR				=  1, //!< struct emapi_hdr
 	EMOB_LIST_DEV			=  2, //!< struct emapi_list_dev
+	EMOB_CONN_BATCH			=  3, //!< struct emapi_conn_ent
+	EMOB_HELLO				=  4, //!< struct emapi_hello
 	EMOB_MAX
 };
 
+/**
+ * EM API Header Versions (VER)
+ *
+ * Versions at or above EMVER_V2 use the wide layout: Immediate A is 16 bits
+ * (header bytes 4-5), device IDs are 32 bits and PPIDs are 16 bits. Lower
+ * versions use the original 8 bit fields.
+ */
+enum _EMVER
+{
+	EMVER_V0 		= 0,
+	EMVER_V2 		= 2,
+	EMVER_MAX
+};
+
 /**
  * EM API Command Message Category Types (MT)
  */
@@ -74,6 +155,10 @@ enum _EMOP
 	EMOP_LIST_DEV						= 0x01,
 	EMOP_CONN_DEV						= 0x02,
 	EMOP_DISCON_DEV 					= 0x03,
+	EMOP_CONN_DEV_BATCH 				= 0x04,
+	EMOP_DISCON_DEV_BATCH 				= 0x05,
+	EMOP_ENVELOPE 						= 0x06,
+	EMOP_HELLO 							= 0x07,
 	EMOP_MAX
 };
 
@@ -92,6 +177,47 @@ enum _EMRC
 };
 
 
+/**
+ * Pool size classes (PC)
+ */
+enum _EMPC
+{
+	EMPC_HDR 		= 0, 	//!< Up to EMPL_SIZE_HDR bytes
+	EMPC_SMALL 		= 1, 	//!< Up to EMPL_SIZE_SMALL bytes
+	EMPC_MSG 		= 2, 	//!< Up to EMLN_MSG or sizeof(struct emapi_msg) bytes
+	EMPC_MAX
+};
+
+/**
+ * Server event loop backends (TB)
+ */
+enum _EMTB
+{
+	EMTB_EPOLL 		= 0, 	//!< epoll and non-blocking read/write
+	EMTB_URING 		= 1, 	//!< io_uring with multishot accept/recv. Falls back to EMTB_EPOLL
+	EMTB_MAX
+};
+
+/**
+ * Sources of latency samples (SK)
+ */
+enum _EMSK
+{
+	EMSK_CLIENT 	= 0, 	//!< Client round trip from submission to completion
+	EMSK_SERVER 	= 1, 	//!< Server handler time
+	EMSK_MAX
+};
+
+/**
+ * Direction of a captured frame (CD)
+ */
+enum _EMCD
+{
+	EMCD_RX 		= 0, 	//!< Received
+	EMCD_TX 		= 1, 	//!< Sent
+	EMCD_MAX
+};
+
 /* STRUCTS ===================================================================*/
 
 /** 
@@ -105,8 +231,7 @@ struct emapi_hdr
 	__u8 rc;					//!< Return Code [EMRC]
 	__u8 opcode;    			//!< OpCode [EMOP]
 
-	__u8 a;						//!< Immediate A 
-	__u8 rsvd;				
+	__u16 a;					//!< Immediate A. 8 bits on the wire before EMVER_V2
 	__u16 len;					//!< Payload length in bytes
 
 	__u32 b;					//!< Immediate B
@@ -130,10 +255,13 @@ struct emapi_hdr
 /**
  * List devices - Response Entry (Opcode 01h) 
  *
+ * Serialized as id, len, name. The id is 1 byte before EMVER_V2 and 4 bytes
+ * (LE32) from EMVER_V2 on. Packed so that from EMVER_V2 on an entry is 
+ * stored exactly as it appears on the wire on little endian hosts.
  */
-struct emapi_dev 
+struct __attribute__((__packed__)) emapi_dev 
 {
-	__u8 id;					//!< Device ID
+	__u32 id;					//!< Device ID
 	__u8 len; 					//!< Length of device name
 	char name[EMLN_DEV_NAME];	//!< Device name 
 }; 
@@ -141,7 +269,7 @@ struct emapi_dev
 /**
  * Connect - Request (Opcode 02h)
  * 
- * Immediate A: PPID 
+ * Immediate A: PPID (16 bits from EMVER_V2 on)
  * Immediate B: Device ID
  */
 
@@ -152,6 +280,85 @@ struct emapi_dev
  * Immediate B: All   1=Disconnect all, 0=Disconnect PPID in Immediate A
  */
 
+/**
+ * Connect Batch / Disconnect Batch - Request (Opcode 04h / 05h)
+ * 
+ * Immediate A: Num entries
+ * Immediate B: None
+ * Payload: Array of struct emapi_conn_ent with rc set to 0
+ */
+
+/**
+ * Connect Batch / Disconnect Batch - Response (Opcode 04h / 05h)
+ * 
+ * Immediate A: Num entries
+ * Immediate B: Num entries that failed 
+ * Payload: The request entries with rc set to the result of each entry
+ */
+
+/**
+ * Connect Batch / Disconnect Batch - Entry (Opcode 04h / 05h)
+ *
+ * Serialized as EMLN_CONN_ENT bytes: ppid, flags, rc, reserved, dev (LE32).
+ * From EMVER_V2 on the reserved byte holds the upper 8 bits of the PPID.
+ */
+struct emapi_conn_ent
+{
+	__u16 ppid;					//!< PPID
+	__u8 flags;					//!< [EMCF] flags
+	__u8 rc;					//!< Return code of this entry [EMRC]. 0 in a request
+	__u32 dev;					//!< Device ID. Ignored by Disconnect Batch
+};
+
+/**
+ * Envelope (Opcode 06h)
+ *
+ * Immediate A: Num messages
+ * Immediate B: None
+ * Payload: Complete serialized messages (HDR + payload) back to back. 
+ *          Envelopes do not nest.
+ */
+
+/**
+ * Hello - Request / Response (Opcode 07h)
+ *
+ * Sent with header version EMVER_V0 so that any server can answer it. A 
+ * server without a handler answers EMRC_UNSUPPORTED.
+ *
+ * Immediate A: None
+ * Immediate B: None
+ * Payload: struct emapi_hello of the sender
+ */
+
+/**
+ * Hello - Features supported by one end of a connection (Opcode 07h)
+ *
+ * Serialized as EMLN_HELLO bytes: ver, reserved, caps (LE16), max_msg (LE32),
+ * ops. Each end advertises its own features and uses the intersection
+ * computed by emapi_hello_merge(). Batch opcodes are supported when their 
+ * bit is set in ops.
+ */
+struct emapi_hello
+{
+	__u8 ver;						//!< Highest header version supported [EMVER]
+	__u16 caps;						//!< Bitmask of [EMHC] flags
+	__u32 max_msg;					//!< Largest message accepted, HDR + payload
+	__u8 ops[32];					//!< Bitmap of supported opcodes, bit n of byte n/8
+};
+
+/**
+ * Compact EM API Message 
+ *
+ * Header-only messages (e.g. Connect, Disconnect) need no more than this. 
+ * A payload, when present, is kept out of line and is hdr.len bytes of 
+ * serialized data.
+ */
+struct emapi_smsg
+{
+	struct emapi_hdr hdr;			//!< EM API Header 
+	__u8 *payload;					//!< Serialized payload or NULL if hdr.len is 0
+};
+
 /**
  * This struct is to store the serialized EM API header and object 
  */
@@ -172,94 +379,1231 @@ struct emapi_msg
 	union 
 	{
 		struct emapi_dev dev[EMLN_DEV_NUM];
+		struct emapi_conn_ent conn[EMLN_CONN_NUM];
 	} obj;	
 };
 
-/* GLOBAL VARIABLES ==========================================================*/
+/**
+ * A complete EM API Message located by the stream framer
+ */
+struct emapi_frame
+{
+	struct emapi_hdr hdr;		//!< Deserialized EM API Header
+	__u8 *buf;					//!< Start of serialized frame (HDR + payload)
+	__u8 *payload;				//!< Start of serialized payload
+	unsigned len;				//!< Length of the whole frame in bytes
+};
 
-/* PROTOTYPES ================================================================*/
+/**
+ * Resumable framer that splits a byte stream into EM API Messages
+ *
+ * Frames that lie entirely within the current input chunk are returned in 
+ * place. Only frames split across chunks are staged in buf.
+ */
+struct emapi_framer
+{
+	__u8 *in;					//!< Current input chunk 
+	unsigned in_len;			//!< Length of the current input chunk
+	unsigned in_off;			//!< Bytes of the current input chunk consumed
+	unsigned fill;				//!< Bytes of a partial frame staged in buf
+	__u8 buf[EMLN_MSG];			//!< Staging buffer for frames split across chunks
+};
 
 /**
- * @brief Convert from a Little Endian byte array to a struct
- * 
- * @param[out] dst void Pointer to destination struct
- * @param[in] src void Pointer to unsigned char array
- * @param[in] type unsigned enum _EMOB representing type of object to deserialize
- * @param[in] param void * to data needed to deserialize the byte stream 
- * (e.g. count of objects to expect in the stream)
- * @return number of bytes consumed. -1 upon error
+ * Structure of arrays to hold a batch of deserialized EM API Headers 
+ *
+ * Each member points to an array with room for the number of headers 
+ * being decoded. 
  */
-int emapi_deserialize(void *dst, __u8 *src, unsigned type, void *param);
+struct emapi_hdr_soa
+{
+	__u8 *type;					//!< Type of EM API message [EMMT]
+	__u8 *ver;					//!< Header Version 
+	__u8 *tag;					//!< Tag used to track response messages 
+	__u8 *rc;					//!< Return Code [EMRC]
+	__u8 *opcode;				//!< OpCode [EMOP]
+	__u16 *a;					//!< Immediate A 
+	__u16 *len;					//!< Payload length in bytes
+	__u32 *b;					//!< Immediate B
+};
 
 /**
- * Convenience function to populate a emapi_hdr object 
+ * Read-only reference to a List Devices entry inside a serialized payload
+ */
+struct emapi_dev_ref
+{
+	__u32 id;					//!< Device ID
+	__u8 len; 					//!< Length of device name
+	char *name;					//!< Device name (points into the payload, not NUL terminated if truncated)
+};
+
+/**
+ * Cursor to walk the entries of a serialized List Devices payload in place
+ */
+struct emapi_dev_view
+{
+	__u8 *buf;					//!< Start of serialized payload 
+	unsigned len;				//!< Length of serialized payload in bytes
+	unsigned num;				//!< Number of entries expected (Immediate A) 
+	unsigned idx;				//!< Number of entries consumed so far
+	unsigned off;				//!< Byte offset of the next entry
+	unsigned idlen;				//!< Bytes of each device ID, set by the header version
+};
+
+/**
+ * Cursor to walk the messages of a serialized envelope in place
+ */
+struct emapi_env_view
+{
+	__u8 *buf;					//!< Start of the envelope payload
+	unsigned len;				//!< Length of the envelope payload in bytes
+	unsigned num;				//!< Number of messages expected (Immediate A)
+	unsigned idx;				//!< Number of messages consumed so far
+	unsigned off;				//!< Byte offset of the next message
+};
+
+/**
+ * Packs messages into an envelope until a size or time threshold is reached
+ */
+struct emapi_coal
+{
+	unsigned max;				//!< Due once this many bytes are queued
+	__u64 max_ns;				//!< Due once the oldest message is this old
+	__u64 t0;					//!< Time the oldest message was added
+	unsigned num;				//!< Messages queued
+	unsigned len;				//!< Bytes of buf in use, including the envelope header
+	__u8 type;					//!< Message type of the first message [EMMT]
+	__u8 buf[EMLN_MSG];			//!< Envelope header followed by the messages
+};
+
+/**
+ * Log-linear latency histogram in nanoseconds
+ */
+struct emapi_hist
+{
+	__u64 count;					//!< Number of samples
+	__u64 sum;						//!< Sum of all samples
+	__u64 min;						//!< Smallest sample, 0 if count is 0
+	__u64 max;						//!< Largest sample
+	__u64 bucket[EMST_BUCKETS];		//!< Samples per bucket
+};
+
+/**
+ * Latency histograms per opcode and per return code
+ */
+struct emapi_stats
+{
+	struct emapi_hist op[EMSK_MAX][EMST_OPS];	//!< Indexed by [EMSK] and opcode
+	struct emapi_hist rc[EMSK_MAX][EMST_RCS];	//!< Indexed by [EMSK] and return code
+};
+
+/**
+ * Capture file header
  *
- * @param[out] 	fh 			struct emapi_hdr* to fill in
- * @param[in] 	type    	__u8 Request / Response [EMMT]
- * @param[in] 	tag			__u8 message tag identifier 		
- * @param[in] 	rc 			__u8 retrun code
- * @param[in] 	opcode    	__u8 opcode [EMOP]	
- * @param[in] 	len  		__u16 Length of payload in bytes 		
- * @param[in] 	a         	__u8 Immediate value A
- * @param[in] 	b         	__u32 Immediate value B
- * @return 					length of EM API Header + payload 
+ * A capture file is this header followed by count records. Each record is a
+ * struct emapi_cap_rec followed by caplen bytes of the frame, padded to a
+ * multiple of 8 bytes. Header and record fields are in the byte order of the
+ * host that wrote the file, so that the file can be read in place. Frames 
+ * are kept as they were on the wire.
  */
-int emapi_fill_hdr
-(
-	struct emapi_hdr *eh, 
-	__u8 type,				
-	__u8 tag,				
-	__u8 rc,				
-	__u8 opcode,    		
-	__u16 len, 				
-	__u8 a,
-	__u32 b					
-);
+struct emapi_cap_hdr
+{
+	char magic[6];					//!< "EMCAP" and a NUL
+	__u16 ver;						//!< File format version
+	__u32 snaplen;					//!< Bytes of each frame kept
+	__u32 bom;						//!< 0x01020304 in the byte order of the writer
+	__u64 count;					//!< Number of records in the file
+	__u64 dropped;					//!< Frames overwritten or torn before the dump
+	__s64 epoch;					//!< Add to emapi_cap_rec.ts to get CLOCK_REALTIME ns
+};
 
 /**
- * Determine the Request Object Identifier [EMOB] for an EM API Message Opcode [EMOP]
+ * Capture record header
+ */
+struct emapi_cap_rec
+{
+	__u64 ts;						//!< CLOCK_MONOTONIC time in ns
+	__u32 conn;						//!< Connection id on a server, descriptor on a client
+	__u16 caplen;					//!< Bytes of the frame that follow
+	__u8 dir;						//!< [EMCD] direction
+	__u8 side;						//!< [EMSK] client or server
+	__u32 len;						//!< Length of the whole frame
+	__u32 rsvd;
+};
+
+/**
+ * Capture file opened for reading
+ */
+struct emapi_capfile
+{
+	struct emapi_cap_hdr *hdr;		//!< Start of the mapping
+	unsigned long size;				//!< Size of the mapping
+	unsigned long off;				//!< Offset of the next record
+	__u64 idx;						//!< Records returned so far
+};
+
+/**
+ * Emulated CSE answering EMOP_LIST_DEV, EMOP_CONN_DEV and EMOP_DISCON_DEV
  *
- * @param	opcode 	This is an EM API Opcode [EMOP]
- * @return	int		Returns the EM API Object Identifier [EMOB] used in a Request
+ * Handlers may run on several server threads at once. The configuration 
+ * must not change while servers are running.
  */
-int emapi_emob_req(unsigned int opcode);
+struct emapi_mock
+{
+	unsigned devs;					//!< Number of devices
+	unsigned ports;					//!< Number of ports devices can be connected to
+	unsigned lat_ns;				//!< Service time each reply is held back for
+	unsigned busy_ppm;				//!< Requests answered EMRC_BUSY, per million
+	unsigned err_ppm;				//!< Requests answered EMRC_INTERNAL_ERROR, per million
+	__u32 *bind;					//!< Device connected to each port plus 1, 0 if none
+};
 
 /**
- * Determine the Response Object Identifier [EMOB] for an EM API Message Opcode [EMOP]
+ * Pool statistics 
+ */
+struct emapi_pool_stats
+{
+	__u64 alloc[EMPC_MAX];			//!< Number of allocations per size class
+	__u64 free[EMPC_MAX];			//!< Number of releases per size class
+	__u64 refill[EMPC_MAX];			//!< Number of thread cache refills per size class
+	__u64 slabs;					//!< Number of slabs mapped
+	__u64 huge;						//!< Number of slabs backed by reserved huge pages
+	__u64 bytes;					//!< Total bytes mapped
+};
+
+/**
+ * Properties of an EM API Opcode
+ */
+struct emapi_opinfo
+{
+	__u8 req;						//!< Object carried by the request [EMOB]
+	__u8 rsp;						//!< Object carried by the response [EMOB]
+	__u16 min_len;					//!< Minimum request payload length 
+	__u16 max_len;					//!< Maximum request payload length 
+	__u8 flags;						//!< Bitmask of [EMOF] flags
+	__u16 max_a;					//!< Maximum Immediate A when EMOF_CHK_IMM is set
+	__u32 max_b;					//!< Maximum Immediate B when EMOF_CHK_IMM is set
+	__u8 ent_len;					//!< Size of each request payload entry. If set, len must be Immediate A * ent_len
+};
+
+struct emapi_conn;
+struct emapi_server;
+
+/**
+ * Reply held back by emapi_conn_reply_delay() until it is due
+ */
+struct emapi_delayed
+{
+	__u64 due;						//!< emapi_now_ns() time the reply is sent at
+	int fd;							//!< Socket of the connection
+	unsigned id;					//!< Connection number, tells a reused socket apart
+	unsigned len;					//!< Bytes of buf in use
+	struct emapi_delayed *next;		//!< Next reply, ordered by due time
+	__u8 buf[];						//!< Serialized reply
+};
+
+/**
+ * Function called by the server for each message received
  *
- * @param	opcode 	This is an EM API Opcode [EMOP]
- * @return	int		Returns the EM API Object Identifier [EMOB] used in a Response 
+ * The frame points into the connection's receive buffer and is only valid 
+ * for the duration of the call.
+ *
+ * @param 	c 		struct emapi_conn* the message arrived on 
+ * @param 	f 		struct emapi_frame* holding the message
+ * @param 	arg 	Value passed to emapi_server_init()
  */
-int emapi_emob_rsp(unsigned int opcode);
+typedef void (*emapi_dispatch_fn)(struct emapi_conn *c, struct emapi_frame *f, void *arg);
 
-int emapi_fill_conn(struct emapi_msg *m, int ppid, int dev);
-int emapi_fill_disconn(struct emapi_msg *m, int ppid, int all);
-int emapi_fill_listdev(struct emapi_msg *m, int num, int start);
+/**
+ * Function called by the server when a connection is opened or closed
+ */
+typedef void (*emapi_conn_fn)(struct emapi_conn *c, void *arg);
 
 /**
- * @brief Convert an object into Little Endian byte array format
- * 
- * @param[out] dst void Pointer to destination unsigned char array
- * @param[in] src void Pointer to object to serialize
- * @param[in] type unsigned enum _EMOB representing type of object to serialize
- * @param[in] param void * to data needed to serialize the byte stream 
- * @return number of serialized bytes, -1 if error 
+ * Server side connection
  */
-int emapi_serialize(__u8 *dst, void *src, unsigned type, void *param);
+struct emapi_conn
+{
+	int fd;							//!< Socket, -1 once closed
+	unsigned id;					//!< Connection number, unique per server
+	struct emapi_server *srv;		//!< Server that owns the connection 
+	void *priv;						//!< Free for use by the application
+
+	struct emapi_framer rx;			//!< Splits received bytes into messages
+	__u8 *rbuf;						//!< Receive buffer of EMLN_RX_BUF bytes
+
+	__u8 *tx;						//!< Bytes queued to send
+	unsigned tx_off;				//!< Bytes of tx already sent
+	unsigned tx_len;				//!< Bytes of tx in use
+	unsigned tx_cap;				//!< Size of tx 
+	int want_out;					//!< Waiting for the socket to be writable
+	__u8 rc;						//!< Return code of the last reply, for the stats
+	__u8 *txs;						//!< Bytes handed to the backend and being sent
+	unsigned txs_off;				//!< Bytes of txs already sent
+	unsigned txs_len;				//!< Bytes of txs in use
+	unsigned txs_cap;				//!< Size of txs
+	unsigned refs;					//!< Backend operations outstanding on the connection
+	int dirty;						//!< On the server dirty list
+	struct emapi_conn *next_dirty;	//!< Next connection with queued bytes
+	struct emapi_conn *next;		//!< Next closed connection to release
+};
 
 /**
- * Print an object to the screen
+ * EM API server 
+ */
+struct emapi_server
+{
+	int lfd;						//!< Listening socket
+	int epfd;						//!< epoll instance
+	int wfd;						//!< eventfd to wake the event loop
+	int tfd;						//!< timerfd armed for the first delayed reply
+	volatile int running;			//!< Cleared to stop the event loop
+
+	emapi_dispatch_fn fn;			//!< Called for each message received
+	void *arg;						//!< Passed to the callbacks
+	emapi_conn_fn on_open;			//!< Optional. Called for each new connection
+	emapi_conn_fn on_close;			//!< Optional. Called before a connection is closed
+
+	struct emapi_conn **conns;		//!< Open connections indexed by descriptor
+	unsigned nconns;				//!< Size of conns
+	unsigned count;					//!< Number of open connections
+	unsigned next_id;				//!< Last connection number assigned
+	struct emapi_conn *dirty;		//!< Connections with queued bytes
+	struct emapi_conn *dead;		//!< Connections closed in this pass of the event loop
+	struct emapi_delayed *delayed;	//!< Replies waiting to be sent, first due first
+	struct emapi_delayed *delayed_tail;	//!< Last entry of delayed
+
+	unsigned backend;				//!< Event loop backend [EMTB]
+	void *be;						//!< Backend state while running
+	void (*bflush)(struct emapi_conn *c);	//!< Backend function to send queued bytes
+	void (*bclose)(struct emapi_conn *c);	//!< Backend function called before a connection is closed
+};
+
+/**
+ * Function called by emapi_ops_dispatch() for a request that passed validation
  *
- * @param ptr A pointer to the object to print 
- * @param type The type of object to be printed from enum _EMOB
+ * @param 	c 		struct emapi_conn* the request arrived on 
+ * @param 	f 		struct emapi_frame* holding the request
+ * @param 	arg 	Value passed to emapi_ops_register()
  */
-void emapi_prnt(void *ptr, unsigned type);        
+typedef void (*emapi_op_fn)(struct emapi_conn *c, struct emapi_frame *f, void *arg);
 
-/* Functions to return a string representation of an object*/
-const char *emmt(unsigned u);
-const char *emob(unsigned u);
-const char *emop(unsigned u);
-const char *emrc(unsigned u);
+/**
+ * Handler registered for an opcode 
+ */
+struct emapi_op
+{
+	emapi_op_fn fn;					//!< Handler, NULL if the opcode is unsupported
+	void *arg;						//!< Passed to fn
+	struct emapi_opinfo info;		//!< Used to validate requests before calling fn
+};
+
+/**
+ * Table of opcode handlers indexed by opcode 
+ */
+struct emapi_ops
+{
+	struct emapi_op op[256];
+};
+
+struct emapi_client;
+
+/**
+ * Function called by the client when a request completes
+ *
+ * @param 	c 		struct emapi_client* the request was submitted on
+ * @param 	rsp 	struct emapi_frame* holding the response. NULL if the 
+ * 					connection failed before a response arrived. Only valid
+ * 					for the duration of the call.
+ * @param 	arg 	Value passed to emapi_client_submit()
+ */
+typedef void (*emapi_cb_fn)(struct emapi_client *c, struct emapi_frame *rsp, void *arg);
+
+/**
+ * Completion table entry for a request in flight
+ */
+struct emapi_client_req
+{
+	emapi_cb_fn fn;					//!< Called when the response arrives 
+	void *arg;						//!< Passed to fn
+	__u8 opcode;					//!< Opcode of the request [EMOP]
+	__u8 busy;						//!< Tag is in use
+	__u64 t0;						//!< Submission time when the stats are enabled
+};
+
+/**
+ * Asynchronous EM API client 
+ */
+struct emapi_client
+{
+	int fd;							//!< Socket, -1 once closed
+	void *priv;						//!< Free for use by the application
+	unsigned inflight;				//!< Number of requests awaiting a response
+
+	struct emapi_framer rx;			//!< Splits received bytes into messages
+	__u8 *rbuf;						//!< Receive buffer of EMLN_RX_BUF bytes
+
+	__u8 *tx;						//!< Serialized requests not yet written 
+	unsigned tx_off;				//!< Bytes of tx already written
+	unsigned tx_len;				//!< Bytes of tx in use
+	unsigned tx_cap;				//!< Size of tx 
+
+	struct emapi_client_req req[EMLN_TAGS];	//!< Completion table indexed by tag
+	__u8 free[EMLN_TAGS];			//!< Stack of free tags
+	unsigned nfree;					//!< Number of free tags
+
+	struct emapi_hello peer;		//!< Features both ends support. Set by emapi_client_hello()
+};
+
+/**
+ * One end of a shared memory ring transport 
+ */
+struct emapi_shm
+{
+	int fd;							//!< memfd holding both rings
+	int efd[2];						//!< Doorbell eventfd of each ring
+	int side;						//!< 0 on the end that created the rings, 1 on the end that joined
+	void *base;						//!< Mapping of fd
+	unsigned long size;				//!< Size of the mapping
+	void *tx;						//!< Ring this end sends on
+	void *rx;						//!< Ring this end receives on
+	__u64 rx_pos;					//!< Read position, published by emapi_shm_release()
+	__u64 tx_head;					//!< Last read position of the peer seen by this end
+	unsigned spin;					//!< Polls of an empty ring before emapi_shm_recv() sleeps
+};
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+/* PROTOTYPES ================================================================*/
+
+// Non zero while latency recording is enabled. Set with emapi_stats_enable()
+extern int emapi_stats_on;
+
+// Non zero while frames are captured. Set with emapi_capture_enable()
+extern int emapi_capture_on;
+
+/**
+ * @brief Convert from a Little Endian byte array to a struct
+ * 
+ * @param[out] dst void Pointer to destination struct
+ * @param[in] src void Pointer to unsigned char array
+ * @param[in] type unsigned enum _EMOB representing type of object to deserialize
+ * @param[in] param void * to data needed to deserialize the byte stream 
+ * (e.g. count of objects to expect in the stream)
+ * @return number of bytes consumed. -1 upon error
+ */
+int emapi_deserialize(void *dst, __u8 *src, unsigned type, void *param);
+
+/**
+ * Same as emapi_deserialize() for a payload of a message of header version ver
+ *
+ * @param[in] ver unsigned header version [EMVER] of the message the object came from
+ * @return number of bytes consumed. 0 if more than EMLN_CONN_NUM connect 
+ * entries are requested. -1 upon error
+ */
+int emapi_deserialize_ver(void *dst, __u8 *src, unsigned type, void *param, unsigned ver);
+
+/**
+ * @brief Deserialize a run of back to back EM API Headers 
+ *
+ * Decodes num contiguous serialized headers (EMLN_HDR bytes each) into a 
+ * structure of arrays. Uses SSSE3 shuffles when the CPU supports them.
+ *
+ * @param[out] 	dst 		struct emapi_hdr_soa* with arrays of at least num entries
+ * @param[in] 	src 		__u8* to num * EMLN_HDR bytes
+ * @param[in] 	num 		Number of headers to decode
+ * @return 					number of bytes consumed, -1 upon error
+ */
+int emapi_deserialize_hdrs(struct emapi_hdr_soa *dst, __u8 *src, unsigned num);
+
+/**
+ * Prepare a cursor over a serialized List Devices payload without copying it
+ *
+ * @param[out] 	v 			struct emapi_dev_view* to initialize
+ * @param[in] 	payload 	__u8* to the serialized payload (e.g. emapi_buf.payload)
+ * @param[in] 	len 		Length of the payload in bytes (emapi_hdr.len)
+ * @param[in] 	num 		Number of entries in the payload (emapi_hdr.a)
+ * @return 					0 upon success, non zero otherwise
+ */
+int emapi_dev_view_init(struct emapi_dev_view *v, __u8 *payload, unsigned len, unsigned num);
+
+/**
+ * Same as emapi_dev_view_init() for a payload of header version ver
+ *
+ * @param[in] 	ver 		Header version of the response (emapi_hdr.ver)
+ * @return 					0 upon success, non zero otherwise
+ */
+int emapi_dev_view_init_ver(struct emapi_dev_view *v, __u8 *payload, unsigned len, unsigned num, unsigned ver);
+
+/**
+ * Advance a List Devices cursor to the next entry 
+ *
+ * @param[in] 	v 			struct emapi_dev_view* to advance
+ * @param[out] 	d 			struct emapi_dev_ref* filled with pointers into the payload
+ * @return 					1 if an entry was returned, 0 at the end, -1 if the payload is truncated
+ */
+int emapi_dev_next(struct emapi_dev_view *v, struct emapi_dev_ref *d);
+
+/**
+ * Reset a stream framer to its initial state
+ *
+ * @param[out] 	f 			struct emapi_framer* to initialize
+ */
+void emapi_framer_init(struct emapi_framer *f);
+
+/**
+ * Hand the next chunk of the byte stream to the framer
+ *
+ * The chunk must stay valid until emapi_framer_next() returns 0. 
+ *
+ * @param[in] 	f 			struct emapi_framer* to feed
+ * @param[in] 	data 		__u8* to the bytes received from the stream
+ * @param[in] 	len 		Number of bytes in data
+ */
+void emapi_framer_feed(struct emapi_framer *f, __u8 *data, unsigned len);
+
+/**
+ * Extract the next complete EM API Message from the fed data
+ *
+ * The returned frame is valid until the next call to emapi_framer_next() or 
+ * emapi_framer_feed(). Upon error the stream is out of sync and the framer 
+ * must be reset. 
+ *
+ * @param[in] 	f 			struct emapi_framer* to read from
+ * @param[out] 	fr 			struct emapi_frame* filled with the next message
+ * @return 					1 if a frame was returned, 0 if more data is needed, -1 upon error
+ */
+int emapi_framer_next(struct emapi_framer *f, struct emapi_frame *fr);
+
+/**
+ * Prepare a cursor over the messages of an envelope without copying them
+ *
+ * @param[out] 	v 			struct emapi_env_view* to initialize
+ * @param[in] 	f 			struct emapi_frame* holding an EMOP_ENVELOPE message
+ * @return 					0 upon success, non zero otherwise
+ */
+int emapi_env_view_init(struct emapi_env_view *v, struct emapi_frame *f);
+
+/**
+ * Advance an envelope cursor to the next message
+ *
+ * @param[in] 	v 			struct emapi_env_view* to advance
+ * @param[out] 	f 			struct emapi_frame* pointing into the envelope
+ * @return 					1 if a message was returned, 0 at the end, -1 if the envelope is malformed
+ */
+int emapi_env_next(struct emapi_env_view *v, struct emapi_frame *f);
+
+/**
+ * Prepare an envelope encoder
+ *
+ * @param[out] 	e 			struct emapi_coal* to initialize
+ * @param[in] 	max 		Bytes queued before emapi_coal_due() is true. 0 or 
+ * 							values above EMLN_MSG mean EMLN_MSG
+ * @param[in] 	max_us 		Age in microseconds of the oldest message before 
+ * 							emapi_coal_due() is true. 0 disables the time threshold
+ * @return 					0 upon success, non zero otherwise
+ */
+int emapi_coal_init(struct emapi_coal *e, unsigned max, unsigned max_us);
+
+/**
+ * Copy a message into the envelope
+ *
+ * @param[in] 	e 			struct emapi_coal*
+ * @param[in] 	h 			struct emapi_hdr* of the message. h->len must be the payload length
+ * @param[in] 	payload 	Serialized payload or NULL if h->len is 0
+ * @return 					0 upon success, 1 if the envelope is full and must 
+ * 							be sealed first, -1 upon error
+ */
+int emapi_coal_add(struct emapi_coal *e, struct emapi_hdr *h, __u8 *payload);
+
+/**
+ * Whether the envelope has reached its size or time threshold
+ *
+ * @return 					1 if the envelope should be sealed and sent, 0 otherwise
+ */
+int emapi_coal_due(struct emapi_coal *e);
+
+/**
+ * Finish the envelope
+ *
+ * A single message is returned as is, without the envelope header. The 
+ * returned bytes stay valid until emapi_coal_reset().
+ *
+ * @param[in] 	e 			struct emapi_coal*
+ * @param[out] 	buf 		Set to the start of the bytes to send
+ * @return 					number of bytes to send, 0 if empty
+ */
+int emapi_coal_seal(struct emapi_coal *e, __u8 **buf);
+
+/**
+ * Empty the envelope after the sealed bytes were sent
+ */
+void emapi_coal_reset(struct emapi_coal *e);
+
+/**
+ * Convenience function to populate a emapi_hdr object 
+ *
+ * @param[out] 	fh 			struct emapi_hdr* to fill in
+ * @param[in] 	type    	__u8 Request / Response [EMMT]
+ * @param[in] 	tag			__u8 message tag identifier 		
+ * @param[in] 	rc 			__u8 retrun code
+ * @param[in] 	opcode    	__u8 opcode [EMOP]	
+ * @param[in] 	len  		__u16 Length of payload in bytes 		
+ * @param[in] 	a         	__u16 Immediate value A
+ * @param[in] 	b         	__u32 Immediate value B
+ * @return 					length of EM API Header + payload 
+ */
+int emapi_fill_hdr
+(
+	struct emapi_hdr *eh, 
+	__u8 type,				
+	__u8 tag,				
+	__u8 rc,				
+	__u8 opcode,    		
+	__u16 len, 				
+	__u16 a,
+	__u32 b					
+);
+
+/**
+ * Determine the Request Object Identifier [EMOB] for an EM API Message Opcode [EMOP]
+ *
+ * @param	opcode 	This is an EM API Opcode [EMOP]
+ * @return	int		Returns the EM API Object Identifier [EMOB] used in a Request
+ */
+int emapi_emob_req(unsigned int opcode);
+
+/**
+ * Determine the Response Object Identifier [EMOB] for an EM API Message Opcode [EMOP]
+ *
+ * @param	opcode 	This is an EM API Opcode [EMOP]
+ * @return	int		Returns the EM API Object Identifier [EMOB] used in a Response 
+ */
+int emapi_emob_rsp(unsigned int opcode);
+
+/**
+ * Look up the properties of an EM API Message Opcode [EMOP]
+ *
+ * @param	opcode 	This is an EM API Opcode [EMOP]
+ * @return	struct emapi_opinfo* for the opcode, NULL if the opcode is unknown
+ */
+const struct emapi_opinfo *emapi_opinfo(unsigned int opcode);
+
+int emapi_fill_conn(struct emapi_msg *m, int ppid, int dev);
+int emapi_fill_disconn(struct emapi_msg *m, int ppid, int all);
+int emapi_fill_listdev(struct emapi_msg *m, int num, int start);
+int emapi_fill_conn_batch(struct emapi_msg *m);
+int emapi_fill_disconn_batch(struct emapi_msg *m);
+
+/**
+ * Fill in the features supported by this library
+ *
+ * @param[out] 	h 			struct emapi_hello* to fill in
+ * @param[in] 	t 			struct emapi_ops* whose registered opcodes are 
+ * 							advertised, NULL to advertise every opcode below EMOP_MAX
+ */
+void emapi_hello_init(struct emapi_hello *h, const struct emapi_ops *t);
+
+/**
+ * Compute the features supported by both ends
+ *
+ * @param[out] 	dst 		struct emapi_hello* to fill in. May be a or b
+ * @param[in] 	a 			struct emapi_hello* of one end
+ * @param[in] 	b 			struct emapi_hello* of the other end
+ */
+void emapi_hello_merge(struct emapi_hello *dst, const struct emapi_hello *a, const struct emapi_hello *b);
+
+/**
+ * Test whether an opcode is set in a hello object
+ *
+ * @return 	non zero if the opcode is supported
+ */
+int emapi_hello_has(const struct emapi_hello *h, unsigned opcode);
+
+/**
+ * Append an entry to a Connect Batch or Disconnect Batch message
+ *
+ * @return 	0 upon success, non zero if the message is full
+ */
+int emapi_fill_batch_add(struct emapi_msg *m, int ppid, int dev, int flags);
+
+/* Same as emapi_fill_* but for the compact message representation */
+int emapi_sfill_conn(struct emapi_smsg *m, int ppid, int dev);
+int emapi_sfill_disconn(struct emapi_smsg *m, int ppid, int all);
+int emapi_sfill_listdev(struct emapi_smsg *m, int num, int start);
+
+/**
+ * @brief Serialize a compact EM API Message 
+ *
+ * @param[out] 	dst 		__u8* to at least EMLN_HDR + m->hdr.len bytes
+ * @param[in] 	m 			struct emapi_smsg* to serialize
+ * @return 					number of serialized bytes, -1 upon error
+ */
+int emapi_serialize_smsg(__u8 *dst, struct emapi_smsg *m);
+
+/**
+ * @brief Deserialize a compact EM API Message without copying the payload
+ *
+ * @param[out] 	m 			struct emapi_smsg* to fill
+ * @param[in] 	src 		__u8* to a serialized header + payload
+ * @return 					number of bytes consumed, -1 upon error
+ */
+int emapi_deserialize_smsg(struct emapi_smsg *m, __u8 *src);
+
+/**
+ * @brief Convert an object into Little Endian byte array format
+ * 
+ * @param[out] dst void Pointer to destination unsigned char array
+ * @param[in] src void Pointer to object to serialize
+ * @param[in] type unsigned enum _EMOB representing type of object to serialize
+ * @param[in] param void * to data needed to serialize the byte stream 
+ * (e.g. count of objects to serialize)
+ * @return number of serialized bytes, -1 if error 
+ */
+int emapi_serialize(__u8 *dst, void *src, unsigned type, void *param);
+
+/**
+ * Same as emapi_serialize() for a payload of a message of header version ver
+ *
+ * @param[in] ver unsigned header version [EMVER] of the message the object goes in
+ * @return number of serialized bytes, 0 if error 
+ */
+int emapi_serialize_ver(__u8 *dst, void *src, unsigned type, void *param, unsigned ver);
+
+/**
+ * @brief Serialize a complete List Devices response in one call
+ *
+ * @param[out] 	b 			struct emapi_buf* to serialize into
+ * @param[in] 	m 			struct emapi_msg* holding the devices
+ * @param[in] 	num 		Number of entries in m->obj.dev to serialize
+ * @param[in] 	total 		Total number of devices 
+ * @return 					length of EM API Header + payload, -1 upon error
+ */
+int emapi_serialize_listdev(struct emapi_buf *b, struct emapi_msg *m, unsigned num, unsigned total);
+
+/**
+ * @brief Serialize an EM API Message into an iovec array for writev()/sendmsg()
+ *
+ * The header is serialized into hdr. The remaining iovec entries point 
+ * directly at the objects stored in the message so no payload is copied. 
+ * The message must remain unmodified until the iovec has been sent.  
+ * m->hdr.len is updated to the serialized payload length.
+ * 
+ * A List Devices entry takes one iovec from EMVER_V2 on and two before, 
+ * so size iov for 2 * EMLN_DEV_NUM + 1 entries to send any message. 
+ * 
+ * @param[out] 	iov 		struct iovec array to fill
+ * @param[in] 	iovcnt 		Number of entries available in iov
+ * @param[out] 	hdr 		__u8 buffer of EMLN_HDR bytes to hold the serialized header
+ * @param[in] 	m 			struct emapi_msg* to serialize
+ * @param[in] 	type 		unsigned enum _EMOB of the payload object
+ * @param[in] 	num 		Number of payload objects stored in m->obj
+ * @return 					number of iovec entries used, -1 upon error
+ */
+int emapi_serialize_iov(struct iovec *iov, unsigned iovcnt, __u8 *hdr, struct emapi_msg *m, unsigned type, unsigned num);
+
+/**
+ * Print an object to the screen
+ *
+ * @param ptr A pointer to the object to print 
+ * @param type The type of object to be printed from enum _EMOB
+ */
+void emapi_prnt(void *ptr, unsigned type);        
+
+/**
+ * Format an object as one line of text or as a JSON object
+ *
+ * Does not allocate or use stdio. 
+ *
+ * @param 	buf 	Output buffer. Always NUL terminated when size > 0
+ * @param 	size 	Size of buf in bytes
+ * @param 	obj 	Object to format. One entry for EMOB_LIST_DEV and EMOB_CONN_BATCH
+ * @param 	type 	Type of the object [EMOB]
+ * @param 	flags 	Bitmask of [EMFM] flags
+ * @return 	length of the output without the NUL, -1 if it does not fit
+ */
+int emapi_fmt(char *buf, unsigned size, void *obj, unsigned type, unsigned flags);
+
+/**
+ * Format a message, its header and the objects in its payload
+ *
+ * Does not allocate or use stdio. Messages in an envelope are formatted in turn.
+ *
+ * @param 	buf 	Output buffer. Always NUL terminated when size > 0
+ * @param 	size 	Size of buf in bytes
+ * @param 	f 		struct emapi_frame* holding the message
+ * @param 	flags 	Bitmask of [EMFM] flags
+ * @return 	length of the output without the NUL, -1 if it does not fit
+ */
+int emapi_fmt_frame(char *buf, unsigned size, struct emapi_frame *f, unsigned flags);
+
+/**
+ * Configure the message and buffer pool. Optional.
+ *
+ * @param 	flags 	Bitmask of [EMPL] flags
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_pool_init(unsigned flags);
+
+/**
+ * Allocate a block of at least size bytes from the pool
+ *
+ * Sized for struct emapi_smsg, struct emapi_buf and struct emapi_msg
+ *
+ * @param 	size 	Number of bytes needed
+ * @return 	Pointer to the block, NULL upon error
+ */
+void *emapi_pool_alloc(unsigned size);
+
+/**
+ * Return a block to the pool. May be called from any thread.
+ */
+void emapi_pool_free(void *ptr);
+
+/**
+ * Return the calling thread's cached blocks to the global lists
+ */
+void emapi_pool_flush(void);
+
+/**
+ * Copy the pool statistics
+ */
+void emapi_pool_stats(struct emapi_pool_stats *s);
+
+/**
+ * Create a non-blocking listening socket
+ *
+ * @param 	addr 	"unix:<path>", "<path>", "@<abstract name>" or "[tcp:]<host>:<port>"
+ * @return 	file descriptor, -1 upon error
+ */
+int emapi_listen(const char *addr);
+
+/**
+ * Open a blocking connection to an EM API server
+ *
+ * @param 	addr 	Address in the same format as emapi_listen()
+ * @return 	file descriptor, -1 upon error
+ */
+int emapi_connect(const char *addr);
+
+/**
+ * Write all bytes to a blocking descriptor
+ *
+ * @return 0 upon success, non zero otherwise
+ */
+int emapi_write_all(int fd, __u8 *buf, unsigned len);
+
+/**
+ * Initialize a server
+ *
+ * @param 	s 		struct emapi_server* to initialize
+ * @param 	fn 		Function called for every message received
+ * @param 	arg 	Passed to the callbacks
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_server_init(struct emapi_server *s, emapi_dispatch_fn fn, void *arg);
+
+/**
+ * Create a listening socket and accept connections on it
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_server_listen(struct emapi_server *s, const char *addr);
+
+/**
+ * Accept connections on an existing non-blocking listening socket
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_server_listen_fd(struct emapi_server *s, int fd);
+
+/**
+ * Select the event loop backend used by emapi_server_run()
+ *
+ * @param 	backend [EMTB] backend. Defaults to EMTB_EPOLL
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_server_backend(struct emapi_server *s, unsigned backend);
+
+/**
+ * Run the server event loop until emapi_server_stop() is called
+ *
+ * @return 	0 upon a clean stop, non zero upon error
+ */
+int emapi_server_run(struct emapi_server *s);
+
+/**
+ * Ask a running server to return from emapi_server_run(). Thread safe.
+ */
+void emapi_server_stop(struct emapi_server *s);
+
+/**
+ * Close all connections and release the server resources
+ */
+void emapi_server_free(struct emapi_server *s);
+
+/**
+ * Queue bytes to be sent on a connection
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_conn_send(struct emapi_conn *c, __u8 *buf, unsigned len);
+
+/**
+ * Queue a response to a request
+ *
+ * @param 	c 		struct emapi_conn*
+ * @param 	req 	struct emapi_hdr* of the request being answered
+ * @param 	rc 		Return code [EMRC]
+ * @param 	a 		Immediate A
+ * @param 	b 		Immediate B
+ * @param 	payload Serialized payload or NULL
+ * @param 	len 	Length of the payload
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_conn_reply(struct emapi_conn *c, struct emapi_hdr *req, __u8 rc, __u16 a, __u32 b, __u8 *payload, __u16 len);
+
+/**
+ * Queue a response to be sent after a delay without blocking the event loop
+ *
+ * Replies on a connection with the same delay keep their order. The reply 
+ * is dropped if the connection closes first.
+ *
+ * @param 	ns 		Delay in nanoseconds, 0 to reply now
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_conn_reply_delay(struct emapi_conn *c, struct emapi_hdr *req, __u8 rc, __u16 a, __u32 b, __u8 *payload, __u16 len, __u64 ns);
+
+/**
+ * Feed received bytes to a connection and dispatch complete messages
+ *
+ * @return 	0 upon success, non zero if the connection was closed
+ */
+int emapi_conn_input(struct emapi_conn *c, __u8 *buf, unsigned len);
+
+/**
+ * Close a connection. It is released at the end of the event loop pass.
+ */
+void emapi_conn_close(struct emapi_conn *c);
+
+/* Used by the event loop backends */
+struct emapi_conn *emapi_conn_new(struct emapi_server *s, int fd);
+void emapi_server_flush(struct emapi_server *s);
+void emapi_server_reap(struct emapi_server *s);
+void emapi_server_timer(struct emapi_server *s);
+
+/**
+ * Run the server event loop on io_uring
+ *
+ * @return 	0 upon a clean stop, EMTB_UNAVAILABLE if the kernel lacks support,
+ * 			other non zero values upon error
+ */
+int emapi_uring_run(struct emapi_server *s);
+
+/**
+ * Clear an opcode handler table. EMOP_HELLO is answered from the table and
+ * every other opcode answers EMRC_UNSUPPORTED.
+ */
+void emapi_ops_init(struct emapi_ops *t);
+
+/**
+ * Register a handler for an opcode
+ *
+ * @param 	t 		struct emapi_ops* table
+ * @param 	opcode 	Opcode to handle [EMOP]. Values above EMOP_MAX are allowed
+ * @param 	fn 		Handler
+ * @param 	arg 	Passed to fn
+ * @param 	info 	Validation rules, NULL to use the rules of a built-in opcode
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_ops_register(struct emapi_ops *t, unsigned opcode, emapi_op_fn fn, void *arg, const struct emapi_opinfo *info);
+
+/**
+ * Validate a request and call the handler registered for its opcode
+ *
+ * Matches emapi_dispatch_fn so it can be passed to emapi_server_init() with 
+ * the table as arg. Invalid requests are answered with EMRC_INVALID_INPUT 
+ * and unregistered opcodes with EMRC_UNSUPPORTED.
+ */
+void emapi_ops_dispatch(struct emapi_conn *c, struct emapi_frame *f, void *arg);
+
+/**
+ * Initialize a client on an already connected socket
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_client_init(struct emapi_client *c, int fd);
+
+/**
+ * Connect to a server and initialize a client
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_client_open(struct emapi_client *c, const char *addr);
+
+/**
+ * Close the connection. Requests in flight complete with a NULL response.
+ * Must not be called from a completion callback.
+ */
+void emapi_client_close(struct emapi_client *c);
+
+/**
+ * Queue a request and assign it a tag
+ *
+ * @param 	c 		struct emapi_client*
+ * @param 	h 		struct emapi_hdr* of the request. h->len must be the payload length
+ * @param 	payload Serialized payload or NULL if h->len is 0
+ * @param 	fn 		Called with the response
+ * @param 	arg 	Passed to fn
+ * @return 	tag assigned to the request, -1 upon error (errno EBUSY if all tags are in use)
+ */
+int emapi_client_submit(struct emapi_client *c, struct emapi_hdr *h, __u8 *payload, emapi_cb_fn fn, void *arg);
+
+/**
+ * Write as much of the queued requests as the socket accepts
+ *
+ * @return 	0 upon success, non zero if the connection failed
+ */
+int emapi_client_flush(struct emapi_client *c);
+
+/**
+ * Send queued requests and deliver all responses received so far. Does not block.
+ *
+ * @return 	number of responses delivered, -1 if the connection failed
+ */
+int emapi_client_process(struct emapi_client *c);
+
+/**
+ * Wait up to timeout_ms for the connection to become ready, then process it
+ *
+ * @return 	number of responses delivered, -1 if the connection failed
+ */
+int emapi_client_poll(struct emapi_client *c, int timeout_ms);
+
+/**
+ * Block until every request in flight has completed
+ *
+ * @return 	0 upon success, non zero if the connection failed
+ */
+int emapi_client_wait(struct emapi_client *c);
+
+/**
+ * Exchange features with the server and store the common set in c->peer
+ *
+ * Blocks until the response arrives. Call before other requests are submitted. 
+ * A server that does not answer EMOP_HELLO is assumed to be EMVER_V0 with 
+ * only the List Devices, Connect and Disconnect opcodes.
+ *
+ * @param 	c 		struct emapi_client*
+ * @param 	own 	Features of this end, NULL for those of this library
+ * @return 	0 upon success, EMRC_UNSUPPORTED if the server does not answer 
+ * 			EMOP_HELLO, other non zero values upon error
+ */
+int emapi_client_hello(struct emapi_client *c, const struct emapi_hello *own);
+
+/**
+ * Descriptor to poll. Poll for POLLOUT while emapi_client_pending() is non zero.
+ */
+int emapi_client_fd(struct emapi_client *c);
+
+/**
+ * Number of bytes queued but not yet written
+ */
+unsigned emapi_client_pending(struct emapi_client *c);
+
+/**
+ * Create a pair of shared memory rings
+ *
+ * @param 	size 	Bytes per direction, a power of 2. 0 for EMLN_SHM_RING
+ * @param 	flags 	Bitmask of [EMSH] flags
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_shm_create(struct emapi_shm *m, unsigned size, unsigned flags);
+
+/**
+ * Pass the rings to the peer over a Unix domain socket
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_shm_share(struct emapi_shm *m, int sock);
+
+/**
+ * Attach to rings passed by the peer with emapi_shm_share()
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_shm_join(struct emapi_shm *m, int sock);
+
+/**
+ * Copy a message into the ring. Does not block.
+ *
+ * @param 	h 		struct emapi_hdr* of the message. h->len must be the payload length
+ * @param 	payload Serialized payload or NULL if h->len is 0
+ * @return 	0 upon success, non zero otherwise (errno EAGAIN if the ring is full)
+ */
+int emapi_shm_send(struct emapi_shm *m, struct emapi_hdr *h, __u8 *payload);
+
+/**
+ * Receive the next message without copying it out of the ring
+ *
+ * The frame stays valid until emapi_shm_release() is called.
+ *
+ * @param 	timeout_ms 	Milliseconds to wait, -1 to wait forever, 0 to not block
+ * @return 	1 if a message was received, 0 upon timeout, -1 upon error
+ */
+int emapi_shm_recv(struct emapi_shm *m, struct emapi_frame *f, int timeout_ms);
+
+/**
+ * Hand the space of every message received so far back to the sender
+ */
+void emapi_shm_release(struct emapi_shm *m);
+
+/**
+ * Descriptor to poll. Becomes readable when the peer sends after
+ * emapi_shm_recv() found the ring empty.
+ */
+int emapi_shm_fd(struct emapi_shm *m);
+
+/**
+ * Unmap the rings and close the descriptors 
+ */
+void emapi_shm_close(struct emapi_shm *m);
+
+/**
+ * Monotonic clock in nanoseconds
+ */
+__u64 emapi_now_ns(void);
+
+/**
+ * Turn latency recording on or off for all threads
+ */
+void emapi_stats_enable(int on);
+
+/**
+ * Record a latency sample in the histograms of the calling thread
+ *
+ * @param 	kind 	[EMSK] source of the sample
+ * @param 	opcode 	Opcode [EMOP]
+ * @param 	rc 		Return code [EMRC], EMST_RC_NONE if unknown
+ * @param 	ns 		Latency in nanoseconds
+ */
+void emapi_stats_record(unsigned kind, unsigned opcode, unsigned rc, __u64 ns);
+
+/**
+ * Sum the histograms of every thread
+ *
+ * @param[out] 	s 	struct emapi_stats* to fill
+ */
+void emapi_stats_snapshot(struct emapi_stats *s);
+
+/**
+ * Add the histograms of src to dst
+ */
+void emapi_stats_merge(struct emapi_stats *dst, struct emapi_stats *src);
+
+/**
+ * Clear the histograms of every thread
+ */
+void emapi_stats_reset(void);
+
+/**
+ * Estimate a percentile of a histogram
+ *
+ * @param 	pct 	Percentile between 0 and 100
+ * @return 	latency in nanoseconds, 0 if the histogram is empty
+ */
+__u64 emapi_hist_pct(struct emapi_hist *h, double pct);
+
+/**
+ * Allocate the capture ring and start capturing
+ *
+ * @param 	slots 	Frames kept, rounded up to a power of 2
+ * @param 	snaplen Bytes of each frame kept. 0 for EMLN_CAP_SNAP
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_capture_init(unsigned slots, unsigned snaplen);
+
+/**
+ * Pause or resume capturing
+ */
+void emapi_capture_enable(int on);
+
+/**
+ * Store a frame in the capture ring. Only call while emapi_capture_on is set.
+ *
+ * @param 	side 	[EMSK] client or server
+ * @param 	conn 	Connection identifier
+ * @param 	dir 	[EMCD] direction
+ * @param 	hdr 	Serialized header
+ * @param 	payload Serialized payload
+ * @param 	len 	Length of the payload
+ */
+void emapi_capture(unsigned side, unsigned conn, unsigned dir, __u8 *hdr, __u8 *payload, unsigned len);
+
+/**
+ * Write the frames held by the capture ring to a file, oldest first
+ *
+ * @return 	number of records written, -1 upon error
+ */
+long emapi_capture_dump(const char *path);
+
+/**
+ * Stop capturing and release the capture ring
+ */
+void emapi_capture_free(void);
+
+/**
+ * Map a capture file for reading
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_capfile_open(struct emapi_capfile *f, const char *path);
+
+/**
+ * Advance to the next record of a capture file
+ *
+ * @param[out] 	r 		Set to the record. The frame follows it
+ * @return 		1 if a record was returned, 0 at the end, -1 if the file is corrupt
+ */
+int emapi_capfile_next(struct emapi_capfile *f, struct emapi_cap_rec **r);
+
+/**
+ * Unmap a capture file
+ */
+void emapi_capfile_close(struct emapi_capfile *f);
+
+/**
+ * Create an emulated CSE with no devices connected
+ *
+ * @param 	devs 	Number of devices
+ * @param 	ports 	Number of ports, at most 65536
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_mock_init(struct emapi_mock *m, unsigned devs, unsigned ports);
+
+/**
+ * Register the handlers of an emulated CSE in an opcode table
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_mock_register(struct emapi_mock *m, struct emapi_ops *t);
+
+/**
+ * Release an emulated CSE
+ */
+void emapi_mock_free(struct emapi_mock *m);
+
+/* Functions to return a string representation of an object*/
+const char *emmt(unsigned u);
+const char *emob(unsigned u);
+const char *emop(unsigned u);
+const char *emrc(unsigned u);
+
+/* Header only codec used by the functions above */
+#include "emapi_inline.h"
 
+#ifdef __cplusplus
+}
+#endif
 
 #endif //ifndef _EMAPI_H
@@ -0,0 +1,253 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		mock.c
+ *
+ * @brief 		Code file for an emulated CSE used as a test and benchmark target
+ *
+ * @details 	The emulated switch has a configurable number of devices and
+ *              ports. EMOP_LIST_DEV pages through the devices, so the count
+ *              is not limited to EMLN_DEV_NUM. EMOP_CONN_DEV and
+ *              EMOP_DISCON_DEV bind and unbind devices to ports. Port state
+ *              is updated with atomics so one emulated switch can be shared
+ *              by servers running on several threads.
+ *
+ *              Each reply can be held back for a fixed service time and
+ *              requests answered with EMRC_BUSY or EMRC_INTERNAL_ERROR at
+ *              configurable rates. Held back replies wait on the server's
+ *              timer, so the server thread keeps serving other requests.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* snprintf()
+ */
+#include <stdio.h>
+
+/* calloc(), free()
+ */
+#include <stdlib.h>
+
+/* memset()
+ */
+#include <string.h>
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+
+/* ENUMERATIONS ==============================================================*/
+
+/* STRUCTS ===================================================================*/
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+static __thread __u64 emmk_seed;
+
+/* PROTOTYPES ================================================================*/
+
+/* FUNCTIONS =================================================================*/
+
+/**
+ * Per thread xorshift generator
+ */
+static inline unsigned emmk_rand(void)
+{
+	__u64 x = emmk_seed;
+
+	if (x == 0)
+		x = emapi_now_ns() ^ (__u64) (unsigned long) &emmk_seed;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	emmk_seed = x;
+	return (unsigned) (x >> 32);
+}
+
+/**
+ * Reply once the service time has passed
+ */
+static inline void emmk_reply(struct emapi_mock *m, struct emapi_conn *c, struct emapi_frame *f, __u8 rc, __u16 a, __u32 b, __u8 *payload, __u16 len)
+{
+	emapi_conn_reply_delay(c, &f->hdr, rc, a, b, payload, len, m->lat_ns);
+}
+
+/**
+ * Apply the injected errors
+ *
+ * @return 	1 if the request was answered, 0 if the handler should answer it
+ */
+static int emmk_prologue(struct emapi_mock *m, struct emapi_conn *c, struct emapi_frame *f)
+{
+	unsigned r;
+
+	if (m->busy_ppm == 0 && m->err_ppm == 0)
+		return 0;
+
+	r = emmk_rand() % 1000000;
+	if (r < m->busy_ppm)
+	{
+		emmk_reply(m, c, f, EMRC_BUSY, 0, 0, NULL, 0);
+		return 1;
+	}
+	if (r < m->busy_ppm + m->err_ppm)
+	{
+		emmk_reply(m, c, f, EMRC_INTERNAL_ERROR, 0, 0, NULL, 0);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * EMOP_LIST_DEV: Immediate A is the most entries wanted, 0 for as many as
+ * fit, and Immediate B the first device. The response carries the number of
+ * entries in Immediate A and the total number of devices in Immediate B.
+ *
+ * The device ID of an entry is B plus the entry index. Before EMVER_V2 the
+ * IDs on the wire are 8 bits and carry only the low 8 bits of that number.
+ */
+static void emmk_list(struct emapi_conn *c, struct emapi_frame *f, void *arg)
+{
+	struct emapi_mock *m = (struct emapi_mock*) arg;
+	struct emapi_dev dev[EMLN_DEV_NUM];
+	__u8 buf[EMLN_PAYLOAD];
+	unsigned i, num, max;
+	int len;
+
+	if (emmk_prologue(m, c, f))
+		return;
+
+	max = f->hdr.a;
+	if (max == 0 || max > EMLN_DEV_NUM)
+		max = EMLN_DEV_NUM;
+
+	num = 0;
+	if (f->hdr.b < m->devs)
+		num = m->devs - f->hdr.b;
+	if (num > max)
+		num = max;
+
+	for ( i = 0 ; i < num ; i++ )
+	{
+		dev[i].id = f->hdr.b + i;
+		dev[i].len = snprintf(dev[i].name, EMLN_DEV_NAME, "Mock Device %u", f->hdr.b + i) + 1;
+	}
+
+	len = emapi_serialize_ver(buf, dev, EMOB_LIST_DEV, &num, f->hdr.ver);
+	emmk_reply(m, c, f, EMRC_SUCCESS, num, m->devs, buf, len);
+}
+
+/**
+ * EMOP_CONN_DEV: Connect device B to port A
+ *
+ * Connecting a port to the device it is already connected to succeeds.
+ * Connecting a port that holds another device fails.
+ */
+static void emmk_conn(struct emapi_conn *c, struct emapi_frame *f, void *arg)
+{
+	struct emapi_mock *m = (struct emapi_mock*) arg;
+	__u32 cur;
+	__u8 rc;
+
+	if (emmk_prologue(m, c, f))
+		return;
+
+	rc = EMRC_INVALID_INPUT;
+	if (f->hdr.a >= m->ports || f->hdr.b >= m->devs)
+		goto end;
+
+	cur = 0;
+	if (__atomic_compare_exchange_n(&m->bind[f->hdr.a], &cur, f->hdr.b + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+		|| cur == f->hdr.b + 1)
+		rc = EMRC_SUCCESS;
+
+end:
+
+	emmk_reply(m, c, f, rc, 0, 0, NULL, 0);
+}
+
+/**
+ * EMOP_DISCON_DEV: Disconnect port A, or every port if B is set
+ */
+static void emmk_disconn(struct emapi_conn *c, struct emapi_frame *f, void *arg)
+{
+	struct emapi_mock *m = (struct emapi_mock*) arg;
+	unsigned i;
+
+	if (emmk_prologue(m, c, f))
+		return;
+
+	if (f->hdr.b)
+	{
+		for ( i = 0 ; i < m->ports ; i++ )
+			__atomic_store_n(&m->bind[i], 0, __ATOMIC_RELAXED);
+	}
+	else if (f->hdr.a < m->ports)
+		__atomic_store_n(&m->bind[f->hdr.a], 0, __ATOMIC_RELAXED);
+	else
+	{
+		emmk_reply(m, c, f, EMRC_INVALID_INPUT, 0, 0, NULL, 0);
+		return;
+	}
+
+	emmk_reply(m, c, f, EMRC_SUCCESS, 0, 0, NULL, 0);
+}
+
+/**
+ * Create an emulated CSE with no devices connected
+ *
+ * The service time and error rates start at 0 and may be set in the struct
+ * before servers are started.
+ *
+ * @param 	m 		struct emapi_mock* to initialize
+ * @param 	devs 	Number of devices
+ * @param 	ports 	Number of ports, at most 65536 since ports are addressed
+ * 					by Immediate A. Only the first 256 are reachable before
+ * 					EMVER_V2
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_mock_init(struct emapi_mock *m, unsigned devs, unsigned ports)
+{
+	memset(m, 0, sizeof(*m));
+
+	if (ports == 0 || ports > 65536)
+		return 1;
+
+	m->bind = (__u32*) calloc(ports, sizeof(__u32));
+	if (m->bind == NULL)
+		return 1;
+
+	m->devs = devs;
+	m->ports = ports;
+	return 0;
+}
+
+/**
+ * Register the handlers of an emulated CSE in an opcode table
+ *
+ * @param 	m 		struct emapi_mock*
+ * @param 	t 		struct emapi_ops* table, usually passed to several servers
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_mock_register(struct emapi_mock *m, struct emapi_ops *t)
+{
+	return emapi_ops_register(t, EMOP_LIST_DEV, emmk_list, m, NULL)
+		|| emapi_ops_register(t, EMOP_CONN_DEV, emmk_conn, m, NULL)
+		|| emapi_ops_register(t, EMOP_DISCON_DEV, emmk_disconn, m, NULL);
+}
+
+/**
+ * Release an emulated CSE
+ *
+ * @param 	m 		struct emapi_mock*
+ */
+void emapi_mock_free(struct emapi_mock *m)
+{
+	free(m->bind);
+	memset(m, 0, sizeof(*m));
+}
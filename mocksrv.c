@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		mocksrv.c
+ *
+ * @brief 		Emulated CSE server used as a target for client benchmarks
+ *
+ * @details 	Serves one emulated switch (see mock.c) from a number of
+ *              server threads that share a listening socket. Runs until
+ *              SIGINT or SIGTERM.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* printf()
+ */
+#include <stdio.h>
+
+/* malloc(), calloc(), free(), atoi(), atof()
+ */
+#include <stdlib.h>
+
+/* getopt(), dup(), close()
+ */
+#include <unistd.h>
+
+/* sigwait()
+ */
+#include <signal.h>
+
+/* pthread_create(), pthread_sigmask()
+ */
+#include <pthread.h>
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+#define MS_ADDR 					"@emapi-mock"
+#define MS_DEVS 					4096
+#define MS_PORTS 					256
+#define MS_THREADS 					64 		//!< Most server threads
+
+/* ENUMERATIONS ==============================================================*/
+
+/* STRUCTS ===================================================================*/
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+/* PROTOTYPES ================================================================*/
+
+/* FUNCTIONS =================================================================*/
+
+static void *ms_thread(void *arg)
+{
+	emapi_server_run((struct emapi_server*) arg);
+	return NULL;
+}
+
+/**
+ * Print the server side handling time per opcode and the return codes
+ */
+static void ms_report(void)
+{
+	struct emapi_stats *st;
+	struct emapi_hist *h;
+	unsigned i;
+
+	st = (struct emapi_stats*) malloc(sizeof(*st));
+	if (st == NULL)
+		return;
+	emapi_stats_snapshot(st);
+
+	printf("%-22s %10s %10s %10s %10s\n", "handler (us)", "count", "p50", "p99", "max");
+	for ( i = 0 ; i < EMOP_MAX ; i++ )
+	{
+		h = &st->op[EMSK_SERVER][i];
+		if (h->count > 0)
+			printf("%-22s %10llu %10.1f %10.1f %10.1f\n", emop(i), (unsigned long long) h->count,
+				emapi_hist_pct(h, 50) / 1e3, emapi_hist_pct(h, 99) / 1e3, h->max / 1e3);
+	}
+	for ( i = 0 ; i < EMRC_MAX ; i++ )
+	{
+		h = &st->rc[EMSK_SERVER][i];
+		if (h->count > 0)
+			printf("rc %-19s %10llu\n", emrc(i), (unsigned long long) h->count);
+	}
+	free(st);
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-a addr] [-d devs] [-p ports] [-t threads] [-l us] [-b pct] [-e pct] [-u] [-s]\n", prog);
+	printf("  -a  Listen address (default %s)\n", MS_ADDR);
+	printf("  -d  Number of devices (default %d)\n", MS_DEVS);
+	printf("  -p  Number of ports, at most 65536 (default %d)\n", MS_PORTS);
+	printf("  -t  Server threads sharing the listening socket (default 1)\n");
+	printf("  -l  Service time of each request in microseconds (default 0)\n");
+	printf("  -b  Percent of requests answered Busy\n");
+	printf("  -e  Percent of requests answered Internal Error\n");
+	printf("  -u  Use the io_uring backend\n");
+	printf("  -s  Print handler times and return codes on exit\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct emapi_server *srv;
+	struct emapi_mock mock;
+	struct emapi_ops *ops;
+	const char *addr;
+	unsigned devs, ports, threads, lat_us, backend, stats, i, up;
+	double busy, err;
+	pthread_t t[MS_THREADS];
+	sigset_t set;
+	int opt, lfd, sig, rv;
+
+	// Initialize variables
+	addr = MS_ADDR;
+	devs = MS_DEVS;
+	ports = MS_PORTS;
+	threads = 1;
+	lat_us = 0;
+	busy = err = 0;
+	backend = EMTB_EPOLL;
+	stats = 0;
+	rv = 1;
+	up = 0;
+	srv = NULL;
+	ops = NULL;
+
+	while ( (opt = getopt(argc, argv, "a:d:p:t:l:b:e:ush")) != -1 )
+	{
+		switch (opt)
+		{
+			case 'a': addr = optarg; 				break;
+			case 'd': devs = atoi(optarg); 			break;
+			case 'p': ports = atoi(optarg); 		break;
+			case 't': threads = atoi(optarg); 		break;
+			case 'l': lat_us = atoi(optarg); 		break;
+			case 'b': busy = atof(optarg); 			break;
+			case 'e': err = atof(optarg); 			break;
+			case 'u': backend = EMTB_URING; 		break;
+			case 's': stats = 1; 					break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (threads == 0 || threads > MS_THREADS || busy < 0 || err < 0 || busy + err > 100)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (emapi_mock_init(&mock, devs, ports))
+	{
+		printf("invalid port count %u\n", ports);
+		return 1;
+	}
+	mock.lat_ns = lat_us * 1000;
+	mock.busy_ppm = busy * 10000;
+	mock.err_ppm = err * 10000;
+
+	ops = (struct emapi_ops*) malloc(sizeof(*ops));
+	srv = (struct emapi_server*) calloc(threads, sizeof(*srv));
+	if (ops == NULL || srv == NULL)
+		goto end;
+	emapi_ops_init(ops);
+	emapi_mock_register(&mock, ops);
+	if (stats)
+		emapi_stats_enable(1);
+
+	lfd = emapi_listen(addr);
+	if (lfd < 0)
+	{
+		printf("listen %s: failed\n", addr);
+		goto end;
+	}
+
+	// Handle signals on this thread only
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	for ( i = 0 ; i < threads ; i++ )
+	{
+		if (emapi_server_init(&srv[i], emapi_ops_dispatch, ops) || emapi_server_backend(&srv[i], backend)
+			|| emapi_server_listen_fd(&srv[i], i == 0 ? lfd : dup(lfd)))
+		{
+			printf("server %u: failed\n", i);
+			if (i == 0)
+				close(lfd);
+			goto stop;
+		}
+		pthread_create(&t[i], NULL, ms_thread, &srv[i]);
+		up++;
+	}
+
+	printf("%s: %u devices, %u ports, %u threads, %u us, %.2f%% busy, %.2f%% error\n", addr, devs, ports,
+		threads, lat_us, busy, err);
+	fflush(stdout);
+
+	sigwait(&set, &sig);
+	rv = 0;
+
+stop:
+
+	for ( i = 0 ; i < up ; i++ )
+		emapi_server_stop(&srv[i]);
+	for ( i = 0 ; i < up ; i++ )
+	{
+		pthread_join(t[i], NULL);
+		emapi_server_free(&srv[i]);
+	}
+	if (stats && rv == 0)
+		ms_report();
+
+end:
+
+	free(srv);
+	free(ops);
+	emapi_mock_free(&mock);
+	return rv;
+}
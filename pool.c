@@ -0,0 +1,395 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		pool.c
+ *
+ * @brief 		Code file for the EM API message and buffer pool
+ *
+ * @details 	Blocks are carved out of large slabs and kept on a free list
+ *              per size class. Each thread keeps a small cache of blocks per
+ *              size class so that steady state allocation and release do
+ *              not take a lock or call into the heap. Blocks move between
+ *              the thread caches and the global lists in batches.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* memset()
+ */
+#include <string.h>
+
+/* mmap(), madvise()
+ */
+#include <sys/mman.h>
+
+/* pthread_mutex_t, pthread_once(), pthread_key_create()
+ */
+#include <pthread.h>
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+#define EMPL_BLK_HDR 				16 			//!< Bytes reserved before each block for its header
+#define EMPL_BLK_ALIGN 				64 			//!< Block stride alignment
+#define EMPL_SLAB 					(256*1024)	//!< Size of a slab of normal pages
+#define EMPL_SLAB_HUGE 				(2*1024*1024) //!< Size of a slab of huge pages
+#define EMPL_BATCH 					32 			//!< Blocks moved between thread cache and global list
+#define EMPL_CACHE_MAX 				(2*EMPL_BATCH) //!< Blocks a thread cache holds before spilling
+
+#define EMPL_MAGIC 					0x454D504C 	//!< "EMPL" marks a block owned by the pool
+
+/* ENUMERATIONS ==============================================================*/
+
+/* STRUCTS ===================================================================*/
+
+/**
+ * Header stored in front of each block
+ */
+struct emapi_pool_blk
+{
+	__u32 magic;					//!< EMPL_MAGIC
+	__u32 cls;						//!< Size class [EMPC]
+	struct emapi_pool_blk *next;	//!< Next block on a free list
+};
+
+/**
+ * Per thread cache of free blocks
+ */
+struct emapi_pool_cache
+{
+	struct emapi_pool_blk *head[EMPC_MAX];	//!< Free list per size class
+	unsigned cnt[EMPC_MAX];					//!< Number of blocks on each free list
+	__u64 alloc[EMPC_MAX];					//!< Allocations not yet folded into the global stats
+	__u64 free[EMPC_MAX];					//!< Releases not yet folded into the global stats
+	int registered;							//!< Thread exit destructor installed
+};
+
+/**
+ * Global pool state
+ */
+struct emapi_pool
+{
+	pthread_mutex_t lock;
+	unsigned flags;							//!< [EMPL] flags
+	struct emapi_pool_blk *head[EMPC_MAX];	//!< Free list per size class
+	unsigned size[EMPC_MAX];				//!< Usable bytes per block for each size class
+	unsigned stride[EMPC_MAX];				//!< Bytes between blocks for each size class
+	struct emapi_pool_stats stats;
+};
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+static struct emapi_pool pool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+static pthread_key_t pool_key;
+
+static __thread struct emapi_pool_cache tcache;
+
+/* PROTOTYPES ================================================================*/
+
+static void pool_thread_exit(void *arg);
+
+/* FUNCTIONS =================================================================*/
+
+/**
+ * One time setup of the size classes
+ */
+static void pool_setup(void)
+{
+	unsigned i, msg;
+
+	msg = sizeof(struct emapi_msg) > EMLN_MSG ? sizeof(struct emapi_msg) : EMLN_MSG;
+
+	pool.size[EMPC_HDR] 	= EMPL_SIZE_HDR;
+	pool.size[EMPC_SMALL] 	= EMPL_SIZE_SMALL;
+	pool.size[EMPC_MSG] 	= msg;
+
+	for ( i = 0 ; i < EMPC_MAX ; i++ )
+		pool.stride[i] = (EMPL_BLK_HDR + pool.size[i] + EMPL_BLK_ALIGN - 1) & ~(EMPL_BLK_ALIGN - 1);
+
+	pthread_key_create(&pool_key, pool_thread_exit);
+}
+
+/**
+ * Map a new slab and carve it into blocks of one size class
+ *
+ * Must be called with the pool lock held
+ *
+ * @return 0 upon success, non zero otherwise
+ */
+static int pool_grow(unsigned cls)
+{
+	struct emapi_pool_blk *b;
+	unsigned long len, off;
+	__u8 *slab;
+	int huge;
+
+	huge = 0;
+	slab = MAP_FAILED;
+	len = EMPL_SLAB;
+
+	if (pool.flags & EMPL_HUGEPAGE)
+	{
+		len = EMPL_SLAB_HUGE;
+		slab = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (slab != MAP_FAILED)
+			huge = 1;
+		else
+		{
+			// No reserved huge pages, ask for transparent huge pages instead
+			slab = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (slab != MAP_FAILED)
+				madvise(slab, len, MADV_HUGEPAGE);
+		}
+	}
+	else
+		slab = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (slab == MAP_FAILED)
+		return 1;
+
+	for ( off = 0 ; off + pool.stride[cls] <= len ; off += pool.stride[cls] )
+	{
+		b = (struct emapi_pool_blk*) &slab[off];
+		b->magic = EMPL_MAGIC;
+		b->cls = cls;
+		b->next = pool.head[cls];
+		pool.head[cls] = b;
+	}
+
+	pool.stats.slabs++;
+	pool.stats.bytes += len;
+	if (huge)
+		pool.stats.huge++;
+
+	return 0;
+}
+
+/**
+ * Fold the thread counters into the global stats
+ *
+ * Must be called with the pool lock held
+ */
+static void pool_fold(struct emapi_pool_cache *c, unsigned cls)
+{
+	pool.stats.alloc[cls] += c->alloc[cls];
+	pool.stats.free[cls] += c->free[cls];
+	c->alloc[cls] = 0;
+	c->free[cls] = 0;
+}
+
+/**
+ * Move a batch of blocks from the global list to the thread cache
+ *
+ * @return 0 upon success, non zero otherwise
+ */
+static int pool_refill(struct emapi_pool_cache *c, unsigned cls)
+{
+	struct emapi_pool_blk *b;
+	unsigned i;
+	int rv;
+
+	rv = 1;
+
+	if (!c->registered)
+	{
+		pthread_setspecific(pool_key, c);
+		c->registered = 1;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+
+	for ( i = 0 ; i < EMPL_BATCH ; i++ )
+	{
+		if (pool.head[cls] == NULL && pool_grow(cls))
+			break;
+		b = pool.head[cls];
+		pool.head[cls] = b->next;
+		b->next = c->head[cls];
+		c->head[cls] = b;
+		c->cnt[cls]++;
+	}
+
+	if (i > 0)
+	{
+		pool.stats.refill[cls]++;
+		rv = 0;
+	}
+
+	pool_fold(c, cls);
+
+	pthread_mutex_unlock(&pool.lock);
+
+	return rv;
+}
+
+/**
+ * Move blocks from the thread cache back to the global list
+ *
+ * @param num Number of blocks to move
+ */
+static void pool_spill(struct emapi_pool_cache *c, unsigned cls, unsigned num)
+{
+	struct emapi_pool_blk *b;
+	unsigned i;
+
+	pthread_mutex_lock(&pool.lock);
+
+	for ( i = 0 ; i < num && c->head[cls] != NULL ; i++ )
+	{
+		b = c->head[cls];
+		c->head[cls] = b->next;
+		c->cnt[cls]--;
+		b->next = pool.head[cls];
+		pool.head[cls] = b;
+	}
+
+	pool_fold(c, cls);
+
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * Return the cache of an exiting thread to the global lists
+ */
+static void pool_thread_exit(void *arg)
+{
+	struct emapi_pool_cache *c = (struct emapi_pool_cache*) arg;
+	unsigned i;
+
+	for ( i = 0 ; i < EMPC_MAX ; i++ )
+		pool_spill(c, i, c->cnt[i]);
+	c->registered = 0;
+}
+
+/**
+ * Configure the pool
+ *
+ * Calling this is optional. The pool initializes itself on first use with
+ * no flags set. Flags only affect slabs mapped after the call.
+ *
+ * @param 	flags 	Bitmask of [EMPL] flags
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_pool_init(unsigned flags)
+{
+	pthread_once(&pool_once, pool_setup);
+
+	pthread_mutex_lock(&pool.lock);
+	pool.flags = flags;
+	pthread_mutex_unlock(&pool.lock);
+
+	return 0;
+}
+
+/**
+ * Allocate a block of at least size bytes
+ *
+ * @param 	size 	Number of bytes needed
+ * @return 	Pointer to the block, NULL if size exceeds the largest class or
+ * 			no memory is available
+ */
+void *emapi_pool_alloc(unsigned size)
+{
+	struct emapi_pool_cache *c;
+	struct emapi_pool_blk *b;
+	unsigned cls;
+
+	pthread_once(&pool_once, pool_setup);
+
+	for ( cls = 0 ; cls < EMPC_MAX ; cls++ )
+		if (size <= pool.size[cls])
+			break;
+	if (cls >= EMPC_MAX)
+		return NULL;
+
+	c = &tcache;
+	if (c->head[cls] == NULL && pool_refill(c, cls))
+		return NULL;
+
+	b = c->head[cls];
+	c->head[cls] = b->next;
+	c->cnt[cls]--;
+	c->alloc[cls]++;
+
+	return (__u8*) b + EMPL_BLK_HDR;
+}
+
+/**
+ * Return a block to the pool
+ *
+ * The block may be released by a different thread than allocated it.
+ *
+ * @param 	ptr 	Block returned by emapi_pool_alloc(). NULL is ignored.
+ */
+void emapi_pool_free(void *ptr)
+{
+	struct emapi_pool_cache *c;
+	struct emapi_pool_blk *b;
+	unsigned cls;
+
+	if (ptr == NULL)
+		return;
+
+	b = (struct emapi_pool_blk*) ((__u8*) ptr - EMPL_BLK_HDR);
+	if (b->magic != EMPL_MAGIC)
+		return;
+
+	cls = b->cls;
+	c = &tcache;
+
+	if (!c->registered)
+	{
+		pthread_setspecific(pool_key, c);
+		c->registered = 1;
+	}
+
+	b->next = c->head[cls];
+	c->head[cls] = b;
+	c->cnt[cls]++;
+	c->free[cls]++;
+
+	if (c->cnt[cls] > EMPL_CACHE_MAX)
+		pool_spill(c, cls, EMPL_BATCH);
+}
+
+/**
+ * Return the calling thread's cached blocks to the global lists
+ */
+void emapi_pool_flush(void)
+{
+	unsigned i;
+
+	pthread_once(&pool_once, pool_setup);
+
+	for ( i = 0 ; i < EMPC_MAX ; i++ )
+		pool_spill(&tcache, i, tcache.cnt[i]);
+}
+
+/**
+ * Copy the pool statistics
+ *
+ * Allocation and release counts of other threads are folded in when those
+ * threads refill or spill their caches, so they may lag by up to a batch.
+ *
+ * @param[out] 	s 	struct emapi_pool_stats* to fill
+ */
+void emapi_pool_stats(struct emapi_pool_stats *s)
+{
+	unsigned i;
+
+	pthread_once(&pool_once, pool_setup);
+
+	pthread_mutex_lock(&pool.lock);
+	for ( i = 0 ; i < EMPC_MAX ; i++ )
+		pool_fold(&tcache, i);
+	memcpy(s, &pool.stats, sizeof(*s));
+	pthread_mutex_unlock(&pool.lock);
+}
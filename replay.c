@@ -0,0 +1,544 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		replay.c
+ *
+ * @brief 		Replays the requests of an EM API capture file against a server
+ *
+ * @details 	Requests are read from a capture file written by
+ *              emapi_capture_dump() and sent again through the asynchronous
+ *              client, which assigns new tags. Requests are sent at their
+ *              original timing, scaled by a speed factor, or as fast as the
+ *              connections accept them.
+ *
+ *              Latency is measured from the time a request was scheduled to
+ *              be sent, so a server that falls behind shows up in the
+ *              percentiles instead of slowing the replay down. Without -a an
+ *              in-process emulated CSE (see mock.c) answers the requests.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* ppoll()
+ */
+#define _GNU_SOURCE
+
+/* printf(), snprintf()
+ */
+#include <stdio.h>
+
+/* malloc(), calloc(), free(), atoi(), atof()
+ */
+#include <stdlib.h>
+
+/* memset(), memcpy()
+ */
+#include <string.h>
+
+/* getopt(), getpid()
+ */
+#include <unistd.h>
+
+/* ppoll()
+ */
+#include <poll.h>
+
+/* struct timespec
+ */
+#include <time.h>
+
+/* pthread_create()
+ */
+#include <pthread.h>
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+#define RP_CONNS 					64 		//!< Most connections replayed at once
+#define RP_STANDIN_DEVS 			256 	//!< Devices of the stand-in server
+#define RP_STANDIN_PORTS 			256 	//!< Ports of the stand-in server
+
+/* ENUMERATIONS ==============================================================*/
+
+/* STRUCTS ===================================================================*/
+
+/**
+ * Request read from the capture
+ */
+struct rp_req
+{
+	__u64 ts;						//!< Capture timestamp in ns
+	__u64 sched;					//!< Time the request is due to be sent
+	unsigned conn;					//!< Original connection identifier
+	struct emapi_hdr hdr;			//!< Request header
+	__u8 *payload;					//!< Request payload in the capture file
+};
+
+/**
+ * Connection replaying a subset of the requests in order
+ */
+struct rp_conn
+{
+	struct emapi_client cl;
+	unsigned *idx;					//!< Requests sent on this connection
+	unsigned num;					//!< Number of entries in idx
+	unsigned next;					//!< Next entry of idx to send
+};
+
+/**
+ * Replay state
+ */
+struct rp
+{
+	struct rp_req *req;				//!< Requests in capture order
+	unsigned num;					//!< Number of requests
+	struct rp_conn *conn;			//!< Connections
+	unsigned nconn;					//!< Number of connections
+	double speed;					//!< Timing factor. 0 sends as fast as possible
+	__u64 ts_min;					//!< Earliest capture time of a request
+	__u64 ts_max;					//!< Latest capture time of a request
+	__u64 start;					//!< Time the replay started
+	__u64 done;						//!< Responses received
+	__u64 failed;					//!< Requests that got no response
+	__u64 lag;						//!< Largest delay between scheduled and actual send
+};
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+/* PROTOTYPES ================================================================*/
+
+/* FUNCTIONS =================================================================*/
+
+static void *rp_standin_thread(void *arg)
+{
+	emapi_server_run((struct emapi_server*) arg);
+	return NULL;
+}
+
+/**
+ * Add one request to the list
+ */
+static void rp_add(struct rp *r, __u64 ts, unsigned conn, struct emapi_frame *f)
+{
+	struct rp_req *q = &r->req[r->num];
+
+	// Concurrent writers can leave records slightly out of time order
+	if (r->num == 0 || ts < r->ts_min)
+		r->ts_min = ts;
+	if (r->num == 0 || ts > r->ts_max)
+		r->ts_max = ts;
+	r->num++;
+
+	q->ts = ts;
+	q->conn = conn;
+	memcpy(&q->hdr, &f->hdr, sizeof(q->hdr));
+	q->payload = f->payload;
+}
+
+/**
+ * Read the requests of a capture file
+ *
+ * Requests sent by a client are used. A capture taken only on the server
+ * side uses the requests the server received instead. Envelopes are
+ * replayed as their individual messages.
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+static int rp_load(struct rp *r, struct emapi_capfile *cf)
+{
+	struct emapi_cap_rec *rec;
+	struct emapi_env_view v;
+	struct emapi_frame f, inner;
+	unsigned side, max, trunc;
+	int rv;
+
+	// Use the client side of the capture if there is one
+	side = EMSK_SERVER;
+	max = 0;
+	while ( (rv = emapi_capfile_next(cf, &rec)) == 1 )
+	{
+		if (rec->side == EMSK_CLIENT && rec->dir == EMCD_TX)
+			side = EMSK_CLIENT;
+		if (rec->len >= EMLN_HDR)
+			max += (rec->len - EMLN_HDR) / EMLN_HDR + 1;
+	}
+	if (rv < 0)
+		return 1;
+
+	r->req = (struct rp_req*) calloc(max + 1, sizeof(struct rp_req));
+	if (r->req == NULL)
+		return 1;
+
+	cf->off = sizeof(struct emapi_cap_hdr);
+	cf->idx = 0;
+	trunc = 0;
+	while ( (rv = emapi_capfile_next(cf, &rec)) == 1 )
+	{
+		if (rec->side != side || rec->dir != (side == EMSK_CLIENT ? EMCD_TX : EMCD_RX))
+			continue;
+
+		// Frames cut at the snap length cannot be sent again
+		if (rec->caplen < rec->len || rec->len < EMLN_HDR)
+		{
+			trunc++;
+			continue;
+		}
+
+		f.buf = (__u8*) (rec + 1);
+		f.payload = f.buf + EMLN_HDR;
+		f.len = rec->len;
+		emapi_deserialize(&f.hdr, f.buf, EMOB_HDR, NULL);
+		if (f.hdr.type != EMMT_REQ || (unsigned) f.hdr.len + EMLN_HDR != rec->len)
+			continue;
+
+		if (f.hdr.opcode != EMOP_ENVELOPE)
+		{
+			rp_add(r, rec->ts, rec->conn, &f);
+			continue;
+		}
+
+		if (emapi_env_view_init(&v, &f))
+			continue;
+		while (emapi_env_next(&v, &inner) == 1)
+			if (inner.hdr.type == EMMT_REQ)
+				rp_add(r, rec->ts, rec->conn, &inner);
+	}
+	if (rv < 0)
+		return 1;
+
+	if (trunc > 0)
+		printf("skipped %u requests truncated by the snap length %u\n", trunc, cf->hdr->snaplen);
+	return 0;
+}
+
+/**
+ * Assign requests to connections
+ *
+ * With nconn 0 every connection of the capture gets its own connection, so
+ * requests keep their original order per connection. Otherwise requests are
+ * spread over nconn connections in turn.
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+static int rp_assign(struct rp *r, unsigned nconn)
+{
+	unsigned ids[RP_CONNS], map, i, k;
+
+	map = nconn == 0;
+	if (map)
+	{
+		for ( i = 0 ; i < r->num ; i++ )
+		{
+			for ( k = 0 ; k < nconn && ids[k] != r->req[i].conn ; k++ )
+				;
+			if (k == nconn && nconn < RP_CONNS)
+				ids[nconn++] = r->req[i].conn;
+		}
+		if (nconn == 0)
+			nconn = 1;
+	}
+
+	r->nconn = nconn;
+	r->conn = (struct rp_conn*) calloc(nconn, sizeof(struct rp_conn));
+	if (r->conn == NULL)
+		return 1;
+	for ( k = 0 ; k < nconn ; k++ )
+	{
+		r->conn[k].cl.fd = -1;
+		r->conn[k].idx = (unsigned*) malloc((r->num + 1) * sizeof(unsigned));
+		if (r->conn[k].idx == NULL)
+			return 1;
+	}
+
+	for ( i = 0 ; i < r->num ; i++ )
+	{
+		k = i % nconn;
+		if (map)
+			for ( k = 0 ; k < nconn - 1 && ids[k] != r->req[i].conn ; k++ )
+				;
+		r->conn[k].idx[r->conn[k].num++] = i;
+	}
+	return 0;
+}
+
+/**
+ * Response callback. Records the latency from the scheduled send time.
+ */
+static void rp_done(struct emapi_client *c, struct emapi_frame *rsp, void *arg)
+{
+	struct rp_req *q = (struct rp_req*) arg;
+	struct rp *r = (struct rp*) c->priv;
+
+	if (rsp == NULL)
+	{
+		r->failed++;
+		return;
+	}
+	r->done++;
+	emapi_stats_record(EMSK_CLIENT, q->hdr.opcode, rsp->hdr.rc, emapi_now_ns() - q->sched);
+}
+
+/**
+ * Send every request that is due on a connection
+ *
+ * @return 	time the next request is due, 0 if none is waiting for its time
+ */
+static __u64 rp_send(struct rp *r, struct rp_conn *pc, __u64 now)
+{
+	struct rp_req *q;
+	struct emapi_hdr h;
+
+	while (pc->next < pc->num && pc->cl.fd >= 0)
+	{
+		q = &r->req[pc->idx[pc->next]];
+		if (r->speed > 0)
+		{
+			q->sched = r->start + (__u64) ((q->ts - r->ts_min) / r->speed);
+			if (q->sched > now)
+				return q->sched;
+		}
+		else
+			q->sched = now;
+
+		memcpy(&h, &q->hdr, sizeof(h));
+		if (emapi_client_submit(&pc->cl, &h, q->payload, rp_done, q) < 0)
+			break;
+		if (now - q->sched > r->lag)
+			r->lag = now - q->sched;
+		pc->next++;
+	}
+	return 0;
+}
+
+/**
+ * Replay all requests and wait for the responses
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+static int rp_run(struct rp *r, const char *addr)
+{
+	struct pollfd *p;
+	struct rp_conn *pc;
+	struct timespec ts;
+	__u64 now, due, t;
+	unsigned k, busy;
+	int rv;
+
+	// Initialize variables
+	rv = 1;
+	p = (struct pollfd*) calloc(r->nconn, sizeof(struct pollfd));
+	if (p == NULL)
+		return 1;
+
+	for ( k = 0 ; k < r->nconn ; k++ )
+	{
+		if (emapi_client_open(&r->conn[k].cl, addr))
+		{
+			printf("connect %s: failed\n", addr);
+			goto end;
+		}
+		r->conn[k].cl.priv = r;
+	}
+
+	r->start = emapi_now_ns();
+	for (;;)
+	{
+		now = emapi_now_ns();
+		due = 0;
+		busy = 0;
+		for ( k = 0 ; k < r->nconn ; k++ )
+		{
+			pc = &r->conn[k];
+			t = rp_send(r, pc, now);
+			if (t != 0 && (due == 0 || t < due))
+				due = t;
+
+			p[k].fd = pc->cl.fd;
+			p[k].events = POLLIN | (emapi_client_pending(&pc->cl) ? POLLOUT : 0);
+			p[k].revents = 0;
+			if (pc->cl.fd >= 0 && (pc->next < pc->num || pc->cl.inflight > 0))
+				busy = 1;
+		}
+		if (!busy)
+			break;
+
+		// Sleep until a response arrives or the next request is due
+		if (due != 0)
+		{
+			t = due > now ? due - now : 0;
+			ts.tv_sec = t / 1000000000ull;
+			ts.tv_nsec = t % 1000000000ull;
+		}
+		if (ppoll(p, r->nconn, due != 0 ? &ts : NULL, NULL) < 0)
+			continue;
+
+		for ( k = 0 ; k < r->nconn ; k++ )
+			if (p[k].revents)
+				emapi_client_process(&r->conn[k].cl);
+	}
+	rv = 0;
+
+end:
+
+	for ( k = 0 ; k < r->nconn ; k++ )
+		emapi_client_close(&r->conn[k].cl);
+	free(p);
+	return rv;
+}
+
+/**
+ * Print the achieved rate and latency percentiles
+ */
+static void rp_report(struct rp *r, __u64 elapsed)
+{
+	struct emapi_stats *st;
+	struct emapi_hist *h;
+	double span;
+	unsigned i;
+
+	span = r->num > 1 ? (r->ts_max - r->ts_min) / 1e9 : 0;
+	printf("requests %u connections %u responses %llu failed %llu\n", r->num, r->nconn,
+		(unsigned long long) r->done, (unsigned long long) r->failed);
+	printf("elapsed %.3f s rate %.0f req/s (captured %.3f s %.0f req/s) max send lag %.1f us\n",
+		elapsed / 1e9, elapsed ? r->done / (elapsed / 1e9) : 0, span, span > 0 ? r->num / span : 0,
+		r->lag / 1e3);
+
+	st = (struct emapi_stats*) malloc(sizeof(*st));
+	if (st == NULL)
+		return;
+	emapi_stats_snapshot(st);
+
+	printf("%-22s %10s %10s %10s %10s %10s %10s\n", "latency (us)", "count", "p50", "p90", "p99", "p99.9", "max");
+	for ( i = 0 ; i < EMST_OPS ; i++ )
+	{
+		h = &st->op[EMSK_CLIENT][i];
+		if (h->count == 0)
+			continue;
+		printf("%-22s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", i < EMOP_MAX ? emop(i) : "other",
+			(unsigned long long) h->count, emapi_hist_pct(h, 50) / 1e3, emapi_hist_pct(h, 90) / 1e3,
+			emapi_hist_pct(h, 99) / 1e3, emapi_hist_pct(h, 99.9) / 1e3, h->max / 1e3);
+	}
+	for ( i = 0 ; i < EMST_RCS ; i++ )
+	{
+		h = &st->rc[EMSK_CLIENT][i];
+		if (h->count > 0)
+			printf("rc %-19s %10llu\n", emrc(i), (unsigned long long) h->count);
+	}
+	free(st);
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-a addr] [-s speed | -m] [-c conns] capture\n", prog);
+	printf("  -a  Server address (default: in-process stand-in server)\n");
+	printf("  -s  Timing factor, 2 replays twice as fast as captured (default 1)\n");
+	printf("  -m  Send as fast as possible\n");
+	printf("  -c  Spread requests over this many connections (default: one per captured connection)\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct emapi_server *srv;
+	struct emapi_mock mock;
+	struct emapi_ops ops;
+	struct emapi_capfile cf;
+	struct rp r;
+	const char *addr;
+	char name[64];
+	pthread_t t;
+	unsigned nconn;
+	__u64 t0;
+	int opt, rv;
+
+	// Initialize variables
+	memset(&r, 0, sizeof(r));
+	memset(&mock, 0, sizeof(mock));
+	r.speed = 1;
+	addr = NULL;
+	nconn = 0;
+	srv = NULL;
+	rv = 1;
+
+	while ( (opt = getopt(argc, argv, "a:s:mc:h")) != -1 )
+	{
+		switch (opt)
+		{
+			case 'a': addr = optarg; 					break;
+			case 's': r.speed = atof(optarg); 			break;
+			case 'm': r.speed = 0; 						break;
+			case 'c': nconn = atoi(optarg); 			break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (optind >= argc || r.speed < 0 || nconn > RP_CONNS)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (emapi_capfile_open(&cf, argv[optind]))
+	{
+		printf("%s: not a capture file\n", argv[optind]);
+		return 1;
+	}
+	if (rp_load(&r, &cf) || rp_assign(&r, nconn))
+	{
+		printf("%s: corrupt capture file\n", argv[optind]);
+		goto end;
+	}
+	if (r.num == 0)
+	{
+		printf("%s: no requests to replay\n", argv[optind]);
+		goto end;
+	}
+
+	// Start the stand-in server
+	if (addr == NULL)
+	{
+		snprintf(name, sizeof(name), "@emapi-replay-%d", (int) getpid());
+		addr = name;
+		srv = (struct emapi_server*) malloc(sizeof(*srv));
+		emapi_ops_init(&ops);
+		if (srv == NULL || emapi_mock_init(&mock, RP_STANDIN_DEVS, RP_STANDIN_PORTS) || emapi_mock_register(&mock, &ops)
+			|| emapi_server_init(srv, emapi_ops_dispatch, &ops) || emapi_server_listen(srv, addr))
+		{
+			printf("stand-in server: failed\n");
+			emapi_mock_free(&mock);
+			free(srv);
+			srv = NULL;
+			goto end;
+		}
+		pthread_create(&t, NULL, rp_standin_thread, srv);
+	}
+
+	t0 = emapi_now_ns();
+	rv = rp_run(&r, addr);
+	if (rv == 0)
+		rp_report(&r, emapi_now_ns() - t0);
+
+	if (srv != NULL)
+	{
+		emapi_server_stop(srv);
+		pthread_join(t, NULL);
+		emapi_server_free(srv);
+		emapi_mock_free(&mock);
+		free(srv);
+	}
+
+end:
+
+	if (r.conn != NULL)
+		for ( nconn = 0 ; nconn < r.nconn ; nconn++ )
+			free(r.conn[nconn].idx);
+	free(r.conn);
+	free(r.req);
+	emapi_capfile_close(&cf);
+	return rv;
+}
@@ -0,0 +1,581 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		shmring.c
+ *
+ * @brief 		Code file for the EM API shared memory ring transport
+ *
+ * @details 	Carries serialized messages between processes on the same host
+ *              through two single producer / single consumer rings, one per
+ *              direction, in a memfd mapped by both ends. A message is a
+ *              32 bit length followed by the serialized header and payload,
+ *              padded to 8 bytes, and never wraps so the receiver parses it
+ *              in place. The producer and consumer positions are free
+ *              running byte counts published with release / acquire
+ *              ordering, so the fast path takes no lock and no system call.
+ *
+ *              A receiver that finds its ring empty may spin for a while and
+ *              then sets a waiting flag and sleeps on an eventfd. A sender
+ *              only writes the eventfd when that flag is set.
+ *
+ *              With EMSH_MPSC several threads or processes may send on the
+ *              same end without a lock. A sender reserves space by advancing
+ *              the tail with a compare and swap, copies the message, and
+ *              commits it by storing the length word last. The receiver
+ *              follows the length words instead of the tail, stops at the
+ *              first one still zero, and zeroes the space it releases. A
+ *              sender that dies between reserving and committing blocks the
+ *              receiver at that message, but never other senders' progress
+ *              through the reservation. There is always a single receiver.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* memfd_create()
+ */
+#define _GNU_SOURCE
+
+/* memset(), memcpy()
+ */
+#include <string.h>
+
+/* Return error codes from functions
+ */
+#include <errno.h>
+
+/* read(), write(), close(), ftruncate()
+ */
+#include <unistd.h>
+
+/* mmap(), munmap(), memfd_create()
+ */
+#include <sys/mman.h>
+
+/* fstat()
+ */
+#include <sys/stat.h>
+
+/* sendmsg(), recvmsg()
+ */
+#include <sys/socket.h>
+
+/* eventfd()
+ */
+#include <sys/eventfd.h>
+
+/* poll()
+ */
+#include <poll.h>
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+#define EMSH_MAGIC 					0x454D5348 	//!< "EMSH" marks an initialized ring
+#define EMSH_PAD 					0xFFFFFFFF 	//!< Length marking the unused end of the ring
+#define EMSH_HDR_SIZE 				192 		//!< Bytes of ring header before the data
+#define EMSH_ALIGN(x) 				(((x) + 7) & ~7u)
+
+#if defined(__x86_64__) || defined(__i386__)
+ #define emsh_relax() 				__builtin_ia32_pause()
+#else
+ #define emsh_relax() 				__asm__ __volatile__("" ::: "memory")
+#endif
+
+/* ENUMERATIONS ==============================================================*/
+
+/* STRUCTS ===================================================================*/
+
+/**
+ * Ring header in shared memory
+ *
+ * Producer and consumer fields sit on separate cache lines
+ */
+struct emsh_ring
+{
+	__u32 magic;					//!< EMSH_MAGIC
+	__u32 size;						//!< Bytes of data, a power of 2
+	__u32 flags;					//!< [EMSH] flags
+	__u8 rsvd0[52];
+
+	__u64 tail;						//!< Bytes written by the producer, reserved when EMSH_MPSC is set
+	__u8 rsvd1[56];
+
+	__u64 head;						//!< Bytes released by the consumer
+	__u32 waiting;					//!< Consumer is asleep on the doorbell
+	__u8 rsvd2[52];
+
+	__u8 data[];
+};
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+/* PROTOTYPES ================================================================*/
+
+/* FUNCTIONS =================================================================*/
+
+/**
+ * Check a ring size. A message must always fit with room to spare for the wrap.
+ */
+static int emsh_size_ok(unsigned long size)
+{
+	return !(size & (size - 1)) && size >= 2 * (EMLN_MSG + 8);
+}
+
+/**
+ * Point the tx and rx rings at the mapping for the given side
+ */
+static void emsh_attach(struct emapi_shm *m, int side)
+{
+	__u8 *base = (__u8*) m->base;
+
+	m->side = side;
+	m->tx = base + (side ? m->size / 2 : 0);
+	m->rx = base + (side ? 0 : m->size / 2);
+	m->rx_pos = __atomic_load_n(&((struct emsh_ring*) m->rx)->head, __ATOMIC_ACQUIRE);
+	m->tx_head = __atomic_load_n(&((struct emsh_ring*) m->tx)->head, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Create a pair of shared memory rings
+ *
+ * The creating end sends on the first ring and receives on the second.
+ *
+ * @param 	m 		struct emapi_shm* to initialize
+ * @param 	size 	Bytes per direction, a power of 2. 0 for EMLN_SHM_RING
+ * @param 	flags 	Bitmask of [EMSH] flags
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_shm_create(struct emapi_shm *m, unsigned size, unsigned flags)
+{
+	struct emsh_ring *r;
+	unsigned long half;
+	unsigned i;
+
+	memset(m, 0, sizeof(*m));
+	m->fd = m->efd[0] = m->efd[1] = -1;
+
+	if (size == 0)
+		size = EMLN_SHM_RING;
+
+	if (!emsh_size_ok(size))
+		return 1;
+
+	half = (EMSH_HDR_SIZE + size + 4095) & ~4095ul;
+	m->size = 2 * half;
+
+	m->fd = memfd_create("emapi-shm", MFD_CLOEXEC);
+	if (m->fd < 0 || ftruncate(m->fd, m->size))
+		goto fail;
+
+	for ( i = 0 ; i < 2 ; i++ )
+	{
+		m->efd[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (m->efd[i] < 0)
+			goto fail;
+	}
+
+	m->base = mmap(NULL, m->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m->fd, 0);
+	if (m->base == MAP_FAILED)
+	{
+		m->base = NULL;
+		goto fail;
+	}
+
+	// ftruncate() zeroed the positions
+	for ( i = 0 ; i < 2 ; i++ )
+	{
+		r = (struct emsh_ring*) ((__u8*) m->base + i * half);
+		r->size = size;
+		r->flags = flags;
+		__atomic_store_n(&r->magic, EMSH_MAGIC, __ATOMIC_RELEASE);
+	}
+
+	emsh_attach(m, 0);
+	return 0;
+
+fail:
+
+	emapi_shm_close(m);
+	return 1;
+}
+
+/**
+ * Pass the rings to the peer over a Unix domain socket
+ *
+ * The memfd and both doorbells are sent with SCM_RIGHTS.
+ *
+ * @param 	m 		struct emapi_shm* created with emapi_shm_create()
+ * @param 	sock 	Connected Unix domain socket
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_shm_share(struct emapi_shm *m, int sock)
+{
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(3 * sizeof(int))];
+	} u;
+	struct cmsghdr *cm;
+	struct msghdr msg;
+	struct iovec iov;
+	int fds[3];
+	char c;
+
+	if (m->base == NULL || m->side != 0)
+		return 1;
+
+	c = 'S';
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(&u, 0, sizeof(u));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = u.buf;
+	msg.msg_controllen = sizeof(u.buf);
+
+	fds[0] = m->fd;
+	fds[1] = m->efd[0];
+	fds[2] = m->efd[1];
+	cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+	while (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0)
+		if (errno != EINTR)
+			return 1;
+	return 0;
+}
+
+/**
+ * Attach to rings passed by the peer with emapi_shm_share()
+ *
+ * The joining end sends on the second ring and receives on the first.
+ *
+ * @param 	m 		struct emapi_shm* to initialize
+ * @param 	sock 	Connected Unix domain socket
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_shm_join(struct emapi_shm *m, int sock)
+{
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(3 * sizeof(int))];
+	} u;
+	struct emsh_ring *r;
+	struct cmsghdr *cm;
+	struct msghdr msg;
+	struct iovec iov;
+	struct stat st;
+	int fds[3];
+	ssize_t n;
+	char c;
+
+	memset(m, 0, sizeof(*m));
+	m->fd = m->efd[0] = m->efd[1] = -1;
+
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = u.buf;
+	msg.msg_controllen = sizeof(u.buf);
+
+	while ( (n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 )
+		if (errno != EINTR)
+			return 1;
+
+	cm = CMSG_FIRSTHDR(&msg);
+	if (n != 1 || c != 'S' || cm == NULL || cm->cmsg_level != SOL_SOCKET
+		|| cm->cmsg_type != SCM_RIGHTS || cm->cmsg_len != CMSG_LEN(sizeof(fds)))
+		return 1;
+	memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+	m->fd = fds[0];
+	m->efd[0] = fds[1];
+	m->efd[1] = fds[2];
+
+	if (fstat(m->fd, &st) || st.st_size <= 0 || (st.st_size & 8191))
+		goto fail;
+	m->size = st.st_size;
+
+	m->base = mmap(NULL, m->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m->fd, 0);
+	if (m->base == MAP_FAILED)
+	{
+		m->base = NULL;
+		goto fail;
+	}
+
+	// Validate both rings before trusting their size
+	emsh_attach(m, 1);
+	r = (struct emsh_ring*) m->tx;
+	if (r->magic != EMSH_MAGIC || !emsh_size_ok(r->size) || EMSH_HDR_SIZE + (unsigned long) r->size > m->size / 2)
+		goto fail;
+	r = (struct emsh_ring*) m->rx;
+	if (r->magic != EMSH_MAGIC || !emsh_size_ok(r->size) || EMSH_HDR_SIZE + (unsigned long) r->size > m->size / 2)
+		goto fail;
+
+	return 0;
+
+fail:
+
+	emapi_shm_close(m);
+	return 1;
+}
+
+/**
+ * Copy a message into the ring
+ *
+ * Does not block. Wakes the receiver if it is asleep.
+ *
+ * @param 	m 		struct emapi_shm*
+ * @param 	h 		struct emapi_hdr* of the message. h->len must be the payload length
+ * @param 	payload Serialized payload or NULL if h->len is 0
+ * @return 	0 upon success, non zero otherwise (errno EAGAIN if the ring is full)
+ */
+int emapi_shm_send(struct emapi_shm *m, struct emapi_hdr *h, __u8 *payload)
+{
+	struct emsh_ring *r = (struct emsh_ring*) m->tx;
+	unsigned need, off, contig, total, len, mpsc;
+	__u64 v, tail, head;
+	__u8 *p;
+
+	// Validate Inputs
+	if (m->base == NULL || h->len > EMLN_PAYLOAD || (h->len > 0 && payload == NULL))
+	{
+		errno = EINVAL;
+		return 1;
+	}
+
+	// Initialize variables
+	len = EMLN_HDR + h->len;
+	need = EMSH_ALIGN(4 + len);
+	mpsc = r->flags & EMSH_MPSC;
+
+	// Reserve space. Retried when another sender moved the tail first.
+	tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	do 
+	{
+		off = tail & (r->size - 1);
+		contig = r->size - off;
+		total = contig < need ? contig + need : need;
+
+		// Only look at the consumer position when the cached one is not enough
+		head = __atomic_load_n(&m->tx_head, __ATOMIC_RELAXED);
+		if (tail + total - head > r->size)
+		{
+			head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+			__atomic_store_n(&m->tx_head, head, __ATOMIC_RELAXED);
+			if (tail + total - head > r->size)
+			{
+				errno = EAGAIN;
+				return 1;
+			}
+		}
+	} 
+	while (mpsc && !__atomic_compare_exchange_n(&r->tail, &tail, tail + total, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+	// Messages never wrap. Mark the rest of the ring unused.
+	if (contig < need)
+	{
+		__atomic_store_n((__u32*) &r->data[off], EMSH_PAD, __ATOMIC_RELEASE);
+		off = 0;
+	}
+
+	p = &r->data[off];
+	emapi_enc_hdr(p + 4, h);
+	if (h->len > 0)
+		memcpy(p + 4 + EMLN_HDR, payload, h->len);
+
+	// Commit. The receiver of a MPSC ring follows the length words.
+	if (mpsc)
+		__atomic_store_n((__u32*) p, len, __ATOMIC_RELEASE);
+	else
+	{
+		*(__u32*) p = len;
+		__atomic_store_n(&r->tail, tail + total, __ATOMIC_RELEASE);
+	}
+
+	// Order the commit before the check of the waiting flag
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&r->waiting, __ATOMIC_RELAXED) && __atomic_exchange_n(&r->waiting, 0, __ATOMIC_ACQ_REL))
+	{
+		v = 1;
+		if (write(m->efd[m->side], &v, sizeof(v)) < 0)
+			return 0;
+	}
+
+	return 0;
+}
+
+/**
+ * Parse the next message if one is available
+ *
+ * @return 1 if a message was parsed, 0 if the ring is empty, -1 if corrupt
+ */
+static int emsh_next(struct emapi_shm *m, struct emapi_frame *f)
+{
+	struct emsh_ring *r = (struct emsh_ring*) m->rx;
+	unsigned off, len, mpsc;
+	__u64 tail;
+	__u8 *p;
+
+	mpsc = r->flags & EMSH_MPSC;
+	tail = mpsc ? 0 : __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+	while (mpsc || m->rx_pos != tail)
+	{
+		off = m->rx_pos & (r->size - 1);
+		len = __atomic_load_n((__u32*) &r->data[off], __ATOMIC_ACQUIRE);
+		if (len == 0 && mpsc)
+			return 0;
+		if (len == EMSH_PAD)
+		{
+			m->rx_pos += r->size - off;
+			continue;
+		}
+
+		if (len < EMLN_HDR || len > EMLN_MSG || off + 4 + len > r->size)
+			return -1;
+
+		p = &r->data[off + 4];
+		emapi_dec_hdr(&f->hdr, p);
+		f->buf = p;
+		f->payload = p + EMLN_HDR;
+		f->len = len;
+		m->rx_pos += EMSH_ALIGN(4 + len);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Receive the next message without copying it out of the ring
+ *
+ * Spins m->spin times on an empty ring, then sleeps on the doorbell. The
+ * frame stays valid until emapi_shm_release() is called.
+ *
+ * @param 	m 			struct emapi_shm*
+ * @param[out] 	f 		struct emapi_frame* to fill
+ * @param 	timeout_ms 	Milliseconds to wait, -1 to wait forever, 0 to not block
+ * @return 	1 if a message was received, 0 upon timeout, -1 upon error
+ */
+int emapi_shm_recv(struct emapi_shm *m, struct emapi_frame *f, int timeout_ms)
+{
+	struct emsh_ring *r = (struct emsh_ring*) m->rx;
+	struct pollfd pfd;
+	unsigned i;
+	__u64 v;
+	int rv, efd;
+
+	if (m->base == NULL)
+		return -1;
+
+	// Busy poll
+	for ( i = 0 ; ; i++ )
+	{
+		rv = emsh_next(m, f);
+		if (rv != 0 || i >= m->spin)
+			break;
+		emsh_relax();
+	}
+	if (rv != 0)
+		return rv;
+
+	efd = m->efd[!m->side];
+
+	for (;;)
+	{
+		// Announce the sleep, then look again so a send is not missed
+		__atomic_store_n(&r->waiting, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		rv = emsh_next(m, f);
+		if (rv != 0 || timeout_ms == 0)
+			return rv;
+
+		pfd.fd = efd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		rv = poll(&pfd, 1, timeout_ms);
+		if (rv < 0 && errno != EINTR)
+			return -1;
+		if (rv == 0)
+			return 0;
+		if (read(efd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+			return -1;
+	}
+}
+
+/**
+ * Hand the space of every message received so far back to the sender
+ *
+ * On a MPSC ring the space is zeroed first, so a length word the receiver
+ * finds later was written by a sender that committed.
+ *
+ * @param 	m 		struct emapi_shm*
+ */
+void emapi_shm_release(struct emapi_shm *m)
+{
+	struct emsh_ring *r = (struct emsh_ring*) m->rx;
+	unsigned off, n;
+	__u64 head;
+
+	if (m->base == NULL)
+		return;
+
+	if (r->flags & EMSH_MPSC)
+	{
+		for ( head = r->head ; head != m->rx_pos ; head += n )
+		{
+			off = head & (r->size - 1);
+			n = r->size - off;
+			if (n > m->rx_pos - head)
+				n = m->rx_pos - head;
+			memset(&r->data[off], 0, n);
+		}
+	}
+
+	__atomic_store_n(&r->head, m->rx_pos, __ATOMIC_RELEASE);
+}
+
+/**
+ * Descriptor to poll for messages
+ *
+ * Becomes readable when the peer sends after emapi_shm_recv() found the
+ * ring empty. Call emapi_shm_recv() with a timeout of 0 when it is ready.
+ *
+ * @param 	m 		struct emapi_shm*
+ * @return 	file descriptor
+ */
+int emapi_shm_fd(struct emapi_shm *m)
+{
+	return m->efd[!m->side];
+}
+
+/**
+ * Unmap the rings and close the descriptors
+ *
+ * @param 	m 		struct emapi_shm*
+ */
+void emapi_shm_close(struct emapi_shm *m)
+{
+	if (m->base != NULL)
+		munmap(m->base, m->size);
+	if (m->fd >= 0)
+		close(m->fd);
+	if (m->efd[0] >= 0)
+		close(m->efd[0]);
+	if (m->efd[1] >= 0)
+		close(m->efd[1]);
+	m->base = m->tx = m->rx = NULL;
+	m->fd = m->efd[0] = m->efd[1] = -1;
+}
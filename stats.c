@@ -0,0 +1,363 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		stats.c
+ *
+ * @brief 		Code file for the EM API latency histograms
+ *
+ * @details 	Each thread records into its own block of histograms, so
+ *              recording a sample takes no lock and no atomic read-modify-
+ *              write. The blocks are kept on a global list that snapshots
+ *              walk and sum. Blocks of exiting threads are folded into a
+ *              retired block.
+ *
+ *              A reset bumps a generation number instead of touching the
+ *              blocks of other threads. A thread clears its own block the
+ *              next time it records, and snapshots skip blocks that are
+ *              still from an older generation.
+ *
+ *              Buckets are log-linear: 2^EMST_SUB_BITS linear buckets per
+ *              power of 2, which bounds the relative error to 12.5%.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* calloc(), free()
+ */
+#include <stdlib.h>
+
+/* memset()
+ */
+#include <string.h>
+
+/* clock_gettime()
+ */
+#include <time.h>
+
+/* pthread_mutex_t, pthread_once(), pthread_key_create()
+ */
+#include <pthread.h>
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+#define EMST_SUB 					(1 << EMST_SUB_BITS)
+#define EMST_MAX_NS 				((1ull << 41) - 1) 	//!< Larger samples are counted as this
+
+/* ENUMERATIONS ==============================================================*/
+
+/* STRUCTS ===================================================================*/
+
+/**
+ * Histograms of one thread
+ */
+struct emst_block
+{
+	struct emapi_stats s;
+	unsigned gen;					//!< Reset generation the contents belong to
+	struct emst_block *next;		//!< Next block on the global list
+};
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+int emapi_stats_on;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+
+static pthread_key_t stats_key;
+
+static struct emst_block *stats_head;
+
+static struct emapi_stats stats_retired;
+
+static unsigned stats_gen;
+
+static __thread struct emst_block *tblock;
+
+/* PROTOTYPES ================================================================*/
+
+static void stats_thread_exit(void *arg);
+
+/* FUNCTIONS =================================================================*/
+
+static void stats_setup(void)
+{
+	pthread_key_create(&stats_key, stats_thread_exit);
+}
+
+/**
+ * Monotonic clock in nanoseconds
+ */
+__u64 emapi_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (__u64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Turn latency recording on or off for all threads
+ *
+ * @param 	on 		Non zero to record
+ */
+void emapi_stats_enable(int on)
+{
+	pthread_once(&stats_once, stats_setup);
+	__atomic_store_n(&emapi_stats_on, on ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * Bucket a sample falls in
+ */
+static inline unsigned emst_bucket(__u64 v)
+{
+	unsigned msb;
+
+	if (v < EMST_SUB)
+		return v;
+	if (v > EMST_MAX_NS)
+		v = EMST_MAX_NS;
+
+	msb = 63 - __builtin_clzll(v);
+	return (msb - EMST_SUB_BITS + 1) * EMST_SUB + ((v >> (msb - EMST_SUB_BITS)) & (EMST_SUB - 1));
+}
+
+/**
+ * Smallest sample that falls in a bucket
+ */
+static inline __u64 emst_lower(unsigned b)
+{
+	if (b < EMST_SUB)
+		return b;
+	return (__u64) (EMST_SUB + (b & (EMST_SUB - 1))) << ((b / EMST_SUB) - 1);
+}
+
+/**
+ * Add a sample to a histogram owned by the calling thread
+ *
+ * Relaxed stores keep concurrent snapshots from reading torn values
+ */
+static inline void emst_add(struct emapi_hist *h, unsigned b, __u64 ns)
+{
+	__atomic_store_n(&h->bucket[b], h->bucket[b] + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->sum, h->sum + ns, __ATOMIC_RELAXED);
+	if (h->count == 0 || ns < h->min)
+		__atomic_store_n(&h->min, ns, __ATOMIC_RELAXED);
+	if (ns > h->max)
+		__atomic_store_n(&h->max, ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Allocate the block of the calling thread and add it to the global list
+ */
+static struct emst_block *emst_block_new(void)
+{
+	struct emst_block *b;
+
+	pthread_once(&stats_once, stats_setup);
+
+	b = (struct emst_block*) calloc(1, sizeof(*b));
+	if (b == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&stats_lock);
+	b->gen = stats_gen;
+	b->next = stats_head;
+	stats_head = b;
+	pthread_mutex_unlock(&stats_lock);
+
+	pthread_setspecific(stats_key, b);
+	tblock = b;
+	return b;
+}
+
+/**
+ * Record a latency sample in the histograms of the calling thread
+ *
+ * @param 	kind 	[EMSK] source of the sample
+ * @param 	opcode 	Opcode [EMOP]
+ * @param 	rc 		Return code [EMRC], EMST_RC_NONE if unknown
+ * @param 	ns 		Latency in nanoseconds
+ */
+void emapi_stats_record(unsigned kind, unsigned opcode, unsigned rc, __u64 ns)
+{
+	struct emst_block *b;
+	unsigned k, gen;
+
+	if (kind >= EMSK_MAX)
+		return;
+
+	b = tblock;
+	if (b == NULL && (b = emst_block_new()) == NULL)
+		return;
+
+	// Clear the block if a reset happened since the last sample
+	gen = __atomic_load_n(&stats_gen, __ATOMIC_ACQUIRE);
+	if (b->gen != gen)
+	{
+		memset(&b->s, 0, sizeof(b->s));
+		__atomic_store_n(&b->gen, gen, __ATOMIC_RELEASE);
+	}
+
+	k = emst_bucket(ns);
+	emst_add(&b->s.op[kind][opcode < EMST_OPS ? opcode : EMST_OPS - 1], k, ns);
+	if (rc != EMST_RC_NONE)
+		emst_add(&b->s.rc[kind][rc < EMST_RCS ? rc : EMST_RCS - 1], k, ns);
+}
+
+/**
+ * Add one histogram to another
+ */
+static void emst_hist_merge(struct emapi_hist *d, struct emapi_hist *s)
+{
+	__u64 cnt, v;
+	unsigned i;
+
+	cnt = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+	if (cnt == 0)
+		return;
+
+	v = __atomic_load_n(&s->min, __ATOMIC_RELAXED);
+	if (d->count == 0 || v < d->min)
+		d->min = v;
+	v = __atomic_load_n(&s->max, __ATOMIC_RELAXED);
+	if (v > d->max)
+		d->max = v;
+	d->sum += __atomic_load_n(&s->sum, __ATOMIC_RELAXED);
+	d->count += cnt;
+
+	for ( i = 0 ; i < EMST_BUCKETS ; i++ )
+		d->bucket[i] += __atomic_load_n(&s->bucket[i], __ATOMIC_RELAXED);
+}
+
+/**
+ * Add the histograms of src to dst
+ *
+ * @param 	dst 	struct emapi_stats* to add to
+ * @param 	src 	struct emapi_stats* to add
+ */
+void emapi_stats_merge(struct emapi_stats *dst, struct emapi_stats *src)
+{
+	unsigned k, i;
+
+	for ( k = 0 ; k < EMSK_MAX ; k++ )
+	{
+		for ( i = 0 ; i < EMST_OPS ; i++ )
+			emst_hist_merge(&dst->op[k][i], &src->op[k][i]);
+		for ( i = 0 ; i < EMST_RCS ; i++ )
+			emst_hist_merge(&dst->rc[k][i], &src->rc[k][i]);
+	}
+}
+
+/**
+ * Fold the block of an exiting thread into the retired histograms
+ */
+static void stats_thread_exit(void *arg)
+{
+	struct emst_block *b = (struct emst_block*) arg, **pp;
+
+	pthread_mutex_lock(&stats_lock);
+	for ( pp = &stats_head ; *pp != NULL ; pp = &(*pp)->next )
+	{
+		if (*pp == b)
+		{
+			*pp = b->next;
+			break;
+		}
+	}
+	if (b->gen == stats_gen)
+		emapi_stats_merge(&stats_retired, &b->s);
+	pthread_mutex_unlock(&stats_lock);
+
+	tblock = NULL;
+	free(b);
+}
+
+/**
+ * Sum the histograms of every thread
+ *
+ * Samples recorded while the snapshot is taken may be partially included.
+ *
+ * @param[out] 	s 	struct emapi_stats* to fill
+ */
+void emapi_stats_snapshot(struct emapi_stats *s)
+{
+	struct emst_block *b;
+
+	memset(s, 0, sizeof(*s));
+
+	pthread_mutex_lock(&stats_lock);
+	emapi_stats_merge(s, &stats_retired);
+	for ( b = stats_head ; b != NULL ; b = b->next )
+		if (__atomic_load_n(&b->gen, __ATOMIC_ACQUIRE) == stats_gen)
+			emapi_stats_merge(s, &b->s);
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/**
+ * Clear the histograms of every thread
+ */
+void emapi_stats_reset(void)
+{
+	pthread_mutex_lock(&stats_lock);
+	memset(&stats_retired, 0, sizeof(stats_retired));
+	__atomic_store_n(&stats_gen, stats_gen + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/**
+ * Estimate a percentile of a histogram
+ *
+ * Returns the middle of the bucket holding the percentile, bounded by the
+ * smallest and largest samples.
+ *
+ * @param 	h 		struct emapi_hist*
+ * @param 	pct 	Percentile between 0 and 100
+ * @return 	latency in nanoseconds, 0 if the histogram is empty
+ */
+__u64 emapi_hist_pct(struct emapi_hist *h, double pct)
+{
+	__u64 want, seen, v, lo, hi;
+	unsigned i;
+
+	if (h->count == 0)
+		return 0;
+
+	if (pct < 0)
+		pct = 0;
+	if (pct > 100)
+		pct = 100;
+
+	want = (__u64) (pct / 100.0 * h->count + 0.5);
+	if (want == 0)
+		want = 1;
+
+	seen = 0;
+	for ( i = 0 ; i < EMST_BUCKETS ; i++ )
+	{
+		seen += h->bucket[i];
+		if (seen >= want)
+			break;
+	}
+	if (i >= EMST_BUCKETS)
+		return h->max;
+
+	lo = emst_lower(i);
+	hi = i + 1 < EMST_BUCKETS ? emst_lower(i + 1) : EMST_MAX_NS + 1;
+	v = lo + (hi - lo) / 2;
+
+	if (v < h->min)
+		v = h->min;
+	if (v > h->max)
+		v = h->max;
+	return v;
+}
@@ -21,6 +21,10 @@
 
 #include <stdlib.h>
 
+/* offsetof()
+ */
+#include <stddef.h>
+
 /* memset()
  */
 #include <string.h>
@@ -29,6 +33,26 @@
  */
 #include <arrayutils.h>
 
+/* pthread_create()
+ */
+#include <pthread.h>
+
+/* read(), close()
+ */
+#include <unistd.h>
+
+/* socketpair()
+ */
+#include <sys/socket.h>
+
+/* clock_gettime()
+ */
+#include <time.h>
+
+/* sched_yield()
+ */
+#include <sched.h>
+
 #include "main.h"
 
 /* MACROS ====================================================================*/
@@ -39,6 +63,11 @@
 
 /* GLOBAL VARIABLES ==========================================================*/
 
+/**
+ * Ring shared by the MPSC senders of verify_shm(). The index is the sender id.
+ */
+struct emapi_shm *shm_senders[4];
+
 /* PROTOTYPES ================================================================*/
 
 void print_strings()
@@ -152,11 +181,1386 @@ int verify_dev()
 	return verify_object(&obj, sizeof(obj), EMOB_LIST_DEV, obj.len+2);
 }
 
+int verify_conn_batch()
+{
+	struct emapi_conn_ent obj;
+	struct emapi_msg *m;
+	__u8 buf[EMLN_HDR + EMLN_CONN_NUM*EMLN_CONN_ENT];
+	unsigned i, num;
+	int len;
+
+	/* STEPS 
+	 * 1: Verify a single entry
+	 * 2: Fill a batch message
+	 * 3: Serialize and deserialize the batch
+	 */
+
+	// STEP 1: Verify a single entry
+	memset(&obj, 0 , sizeof(obj));
+	obj.ppid = 0x12;
+	obj.flags = EMCF_ALL;
+	obj.rc = EMRC_BUSY;
+	obj.dev = 0x12345678;
+	verify_object(&obj, sizeof(obj), EMOB_CONN_BATCH, EMLN_CONN_ENT);
+
+	// STEP 2: Fill a batch message
+	m = (struct emapi_msg*) malloc(sizeof(*m));
+	emapi_fill_conn_batch(m);
+	for ( i = 0 ; i < EMLN_CONN_NUM + 1 ; i++ )
+		if (emapi_fill_batch_add(m, i, 100 + i, 0))
+			break;
+	printf("entries: %u len: %u full: %s\n", m->hdr.a, m->hdr.len, i == EMLN_CONN_NUM ? "OK" : "FAIL");
+
+	// STEP 3: Serialize and deserialize the batch
+	num = m->hdr.a;
+	len = emapi_serialize(buf, &m->hdr, EMOB_HDR, NULL);
+	len += emapi_serialize(&buf[len], m->obj.conn, EMOB_CONN_BATCH, &num);
+	memset(m, 0, sizeof(*m));
+	emapi_deserialize(&m->hdr, buf, EMOB_HDR, NULL);
+	num = m->hdr.a;
+	emapi_deserialize(m->obj.conn, &buf[EMLN_HDR], EMOB_CONN_BATCH, &num);
+	emapi_prnt(&m->obj.conn[num-1], EMOB_CONN_BATCH);
+	printf("batch: %s\n", (len == EMLN_HDR + m->hdr.len && m->obj.conn[num-1].dev == 100 + num - 1) ? "OK" : "FAIL");
+	free(m);
+
+	return 0;
+}
+
+int verify_dev_view()
+{
+	struct emapi_dev_view v;
+	struct emapi_dev_ref d;
+	struct emapi_dev dev;
+	__u8 data[64], big[300];
+	int rv, len;
+	char *names[] = { "Device A", "Dev B", "" };
+	unsigned i;
+
+	/* STEPS 
+	 * 1: Serialize a set of devices back to back
+	 * 2: Walk the payload in place
+	 * 3: Verify a truncated payload is detected
+	 * 4: Verify a name longer than EMLN_DEV_NAME is rejected
+	 */
+
+	// STEP 1: Serialize a set of devices back to back
+	len = 0;
+	for ( i = 0 ; i < 3 ; i++ ) 
+	{
+		data[len++] = 0x10 + i;
+		data[len++] = strlen(names[i]);
+		memcpy(&data[len], names[i], strlen(names[i]));
+		len += strlen(names[i]);
+	}
+
+	// STEP 2: Walk the payload in place
+	emapi_dev_view_init(&v, data, len, 3);
+	while ( (rv = emapi_dev_next(&v, &d)) == 1 )
+		printf("%02d - %.*s\n", d.id, d.len, d.name);
+	printf("view end: %d consumed: %u/%d\n", rv, v.off, len);
+
+	// STEP 3: Verify a truncated payload is detected
+	emapi_dev_view_init(&v, data, len - 1, 3);
+	while ( (rv = emapi_dev_next(&v, &d)) == 1 );
+	printf("truncated: %d\n", rv);
+
+	// STEP 4: Verify a name longer than EMLN_DEV_NAME is rejected
+	memset(big, 'x', sizeof(big));
+	big[1] = 255;
+	i = 1;
+	rv = emapi_deserialize(&dev, big, EMOB_LIST_DEV, &i);
+	printf("oversized name: %d\n", rv);
+
+	return 0;
+}
+
+int verify_framer()
+{
+	struct emapi_framer *f;
+	struct emapi_frame fr;
+	struct emapi_hdr hdr;
+	__u8 data[128];
+	unsigned chunks[] = { 1, 5, 7, 13, 128 };
+	unsigned i, j, k, len, n;
+	int rv;
+
+	/* STEPS 
+	 * 1: Serialize a stream of messages with and without payload
+	 * 2: Feed the stream in chunks of various sizes
+	 */
+
+	f = (struct emapi_framer*) malloc(sizeof(*f));
+
+	// STEP 1: Serialize a stream of messages with and without payload
+	len = 0;
+	for ( i = 0 ; i < 4 ; i++ ) 
+	{
+		emapi_fill_hdr(&hdr, EMMT_REQ, i, 0, EMOP_LIST_DEV, i * 3, i, i);
+		len += emapi_serialize(&data[len], &hdr, EMOB_HDR, NULL);
+		memset(&data[len], 0xA0 + i, i * 3);
+		len += i * 3;
+	}
+
+	// STEP 2: Feed the stream in chunks of various sizes
+	for ( i = 0 ; i < sizeof(chunks)/sizeof(chunks[0]) ; i++ ) 
+	{
+		emapi_framer_init(f);
+		n = 0;
+		for ( j = 0 ; j < len ; j += chunks[i] ) 
+		{
+			k = (len - j) < chunks[i] ? (len - j) : chunks[i];
+			emapi_framer_feed(f, &data[j], k);
+			while ( (rv = emapi_framer_next(f, &fr)) == 1 )
+			{
+				if (fr.hdr.tag != n || fr.hdr.len != n * 3 || (fr.hdr.len && fr.payload[0] != 0xA0 + n) )
+					printf("chunk %u: frame %u mismatch\n", chunks[i], n);
+				n++;
+			}
+		}
+		printf("chunk %3u: %u frames %s\n", chunks[i], n, n == 4 ? "OK" : "FAIL");
+	}
+
+	free(f);
+	return 0;
+}
+
+int verify_iov()
+{
+	struct emapi_msg *m;
+	struct emapi_buf *b;
+	struct iovec iov[2 * EMLN_DEV_NUM + 1];
+	__u8 hdr[EMLN_HDR];
+	__u8 *data;
+	unsigned i, len;
+	int n;
+
+	/* STEPS 
+	 * 1: Fill in a List Devices response
+	 * 2: Serialize into an iovec
+	 * 3: Gather the iovec
+	 * 4: Compare against the bulk List Devices encoder
+	 * 5: Deserialize the gathered buffer
+	 * 6: Reject an entry with an oversized name length
+	 */
+
+	m = (struct emapi_msg*) calloc(1, sizeof(*m));
+	data = (__u8*) calloc(1, EMLN_MSG);
+
+	// STEP 1: Fill in a List Devices response
+	emapi_fill_hdr(&m->hdr, EMMT_RSP, 0x42, EMRC_SUCCESS, EMOP_LIST_DEV, 0, 3, 3);
+	for ( i = 0 ; i < 3 ; i++ ) 
+	{
+		m->obj.dev[i].id = i;
+		m->obj.dev[i].len = sprintf(m->obj.dev[i].name, "Device %u", i) + 1;
+	}
+
+	// STEP 2: Serialize into an iovec
+	n = emapi_serialize_iov(iov, 2 * EMLN_DEV_NUM + 1, hdr, m, EMOB_LIST_DEV, 3);
+	printf("iovcnt: %d\n", n);
+
+	// STEP 3: Gather the iovec
+	len = 0;
+	for ( i = 0 ; i < (unsigned) n ; i++ ) 
+	{
+		memcpy(&data[len], iov[i].iov_base, iov[i].iov_len);
+		len += iov[i].iov_len;
+	}
+	autl_prnt_buf(data, len, 4, 1);
+
+	// STEP 4: Compare against the bulk List Devices encoder
+	b = (struct emapi_buf*) calloc(1, sizeof(*b));
+	n = emapi_serialize_listdev(b, m, 3, 3);
+	printf("emapi_serialize_listdev: %d bytes %s\n", n, 
+		((unsigned) n == len && !memcmp(b, data, len)) ? "match" : "MISMATCH");
+	free(b);
+
+	// STEP 5: Deserialize the gathered buffer
+	memset(m, 0, sizeof(*m));
+	emapi_deserialize(&m->hdr, data, EMOB_HDR, NULL);
+	i = m->hdr.a;
+	emapi_deserialize(m->obj.dev, &data[EMLN_HDR], EMOB_LIST_DEV, &i);
+	emapi_prnt(&m->hdr, EMOB_HDR);
+	for ( i = 0 ; i < m->hdr.a ; i++ ) 
+		emapi_prnt(&m->obj.dev[i], EMOB_LIST_DEV);
+
+	// STEP 6: Reject an entry with an oversized name length
+	m->obj.dev[1].len = EMLN_DEV_NAME + 1;
+	n = emapi_serialize_iov(iov, 2 * EMLN_DEV_NUM + 1, hdr, m, EMOB_LIST_DEV, 3);
+	printf("oversized name: %s\n", n < 0 ? "rejected" : "FAIL");
+	i = 3;
+	n = emapi_serialize_ver(data, m->obj.dev, EMOB_LIST_DEV, &i, EMVER_V2);
+	printf("oversized name serialize: %s\n", n == 0 ? "rejected" : "FAIL");
+	b = (struct emapi_buf*) calloc(1, sizeof(*b));
+	n = emapi_serialize_listdev(b, m, 3, 3);
+	printf("oversized name listdev: %s\n", n < 0 ? "rejected" : "FAIL");
+	free(b);
+
+	free(data);
+	free(m);
+	return 0;
+}
+
+int verify_hdrs()
+{
+	struct emapi_hdr_soa soa;
+	struct emapi_hdr hdr;
+	__u8 data[37 * EMLN_HDR];
+	__u8 type[37], ver[37], tag[37], rc[37], opcode[37];
+	__u16 a[37];
+	__u16 len[37];
+	__u32 b[37];
+	unsigned i, err;
+
+	/* STEPS 
+	 * 1: Fill the stream with pseudo random headers
+	 * 2: Batch decode the stream
+	 * 3: Compare each header against emapi_deserialize()
+	 */
+
+	// STEP 1: Fill the stream with pseudo random headers
+	srand(37);
+	for ( i = 0 ; i < sizeof(data) ; i++ ) 
+		data[i] = rand();
+
+	// STEP 2: Batch decode the stream
+	soa.type = type; soa.ver = ver; soa.tag = tag; soa.rc = rc; 
+	soa.opcode = opcode; soa.a = a; soa.len = len; soa.b = b;
+	emapi_deserialize_hdrs(&soa, data, 37);
+
+	// STEP 3: Compare each header against emapi_deserialize()
+	err = 0;
+	for ( i = 0 ; i < 37 ; i++ ) 
+	{
+		emapi_deserialize(&hdr, &data[i * EMLN_HDR], EMOB_HDR, NULL);
+		if ( hdr.type != type[i] || hdr.ver != ver[i] || hdr.tag != tag[i] || hdr.rc != rc[i] 
+		  || hdr.opcode != opcode[i] || hdr.a != a[i] || hdr.len != len[i] || hdr.b != b[i] )
+		{
+			printf("header %u mismatch\n", i);
+			err++;
+		}
+	}
+	printf("emapi_deserialize_hdrs: %s\n", err ? "FAIL" : "OK");
+
+	return err;
+}
+
+void *pool_worker(void *arg)
+{
+	void *p[256];
+	unsigned i, j, sizes[] = { sizeof(struct emapi_smsg), 200, sizeof(struct emapi_buf), sizeof(struct emapi_msg) };
+
+	(void) arg;
+
+	for ( i = 0 ; i < 1000 ; i++ ) 
+	{
+		for ( j = 0 ; j < 256 ; j++ ) 
+		{
+			p[j] = emapi_pool_alloc(sizes[j % 4]);
+			memset(p[j], j, sizes[j % 4]);
+		}
+		for ( j = 0 ; j < 256 ; j++ ) 
+			emapi_pool_free(p[j]);
+	}
+	return NULL;
+}
+
+int verify_pool()
+{
+	struct emapi_pool_stats s;
+	pthread_t t[4];
+	unsigned i;
+
+	/* STEPS 
+	 * 1: Allocate and release blocks of all size classes from several threads 
+	 * 2: Print the pool statistics
+	 */
+
+	// STEP 1: Allocate and release blocks of all size classes from several threads 
+	emapi_pool_init(0);
+	for ( i = 0 ; i < 4 ; i++ ) 
+		pthread_create(&t[i], NULL, pool_worker, NULL);
+	for ( i = 0 ; i < 4 ; i++ ) 
+		pthread_join(t[i], NULL);
+
+	// STEP 2: Print the pool statistics
+	emapi_pool_stats(&s);
+	for ( i = 0 ; i < EMPC_MAX ; i++ ) 
+		printf("class %u: alloc %llu free %llu refill %llu\n", i, 
+			(unsigned long long) s.alloc[i], (unsigned long long) s.free[i], (unsigned long long) s.refill[i]);
+	printf("slabs %llu bytes %llu\n", (unsigned long long) s.slabs, (unsigned long long) s.bytes);
+	printf("pool: %s\n", (s.alloc[EMPC_MSG] == s.free[EMPC_MSG] && s.alloc[EMPC_MSG] == 512000) ? "OK" : "FAIL");
+
+	return 0;
+}
+
+void srv_dispatch(struct emapi_conn *c, struct emapi_frame *f, void *arg)
+{
+	struct emapi_dev dev[3];
+	__u8 buf[512];
+	unsigned i, num;
+	int len;
+
+	(void) arg;
+
+	switch (f->hdr.opcode)
+	{
+		case EMOP_LIST_DEV:
+			num = 3;
+			for ( i = 0 ; i < num ; i++ )
+			{
+				dev[i].id = i;
+				dev[i].len = sprintf(dev[i].name, "Device %u", i) + 1;
+			}
+			len = emapi_serialize(buf, dev, EMOB_LIST_DEV, &num);
+			emapi_conn_reply(c, &f->hdr, EMRC_SUCCESS, num, num, buf, len);
+			break;
+
+		case EMOP_CONN_DEV:
+		case EMOP_DISCON_DEV:
+			emapi_conn_reply(c, &f->hdr, EMRC_SUCCESS, 0, 0, NULL, 0);
+			break;
+
+		case EMOP_CONN_DEV_BATCH:
+		case EMOP_DISCON_DEV_BATCH:
+			// Entries are answered in place. Odd PPIDs fail.
+			len = 0;
+			num = f->hdr.len / EMLN_CONN_ENT;
+			for ( i = 0 ; i < num && len + EMLN_CONN_ENT <= (int) sizeof(buf) ; i++ )
+			{
+				memcpy(&buf[len], &f->payload[i * EMLN_CONN_ENT], EMLN_CONN_ENT);
+				buf[len + 2] = (buf[len] & 1) ? EMRC_INVALID_INPUT : EMRC_SUCCESS;
+				len += EMLN_CONN_ENT;
+			}
+			emapi_conn_reply(c, &f->hdr, EMRC_SUCCESS, i, i / 2, buf, len);
+			break;
+
+		default:
+			emapi_conn_reply(c, &f->hdr, EMRC_UNSUPPORTED, 0, 0, NULL, 0);
+			break;
+	}
+}
+
+void *srv_thread(void *arg)
+{
+	emapi_server_run((struct emapi_server*) arg);
+	return NULL;
+}
+
+int verify_hello()
+{
+	struct emapi_server srv;
+	struct emapi_hello obj;
+	struct emapi_mock *mock;
+	struct emapi_ops *ops;
+	struct emapi_client *c;
+	pthread_t t;
+	int rv, ok;
+
+	/* STEPS 
+	 * 1: Verify the object
+	 * 2: Say hello to a server using an opcode table
+	 * 3: Say hello to a server that does not know EMOP_HELLO
+	 */
+
+	// STEP 1: Verify the object
+	emapi_hello_init(&obj, NULL);
+	obj.caps = 0xA55A;
+	obj.max_msg = 0x12345678;
+	verify_object(&obj, sizeof(obj), EMOB_HELLO, EMLN_HELLO);
+
+	// STEP 2: Say hello to a server using an opcode table
+	mock = (struct emapi_mock*) malloc(sizeof(*mock));
+	ops = (struct emapi_ops*) malloc(sizeof(*ops));
+	emapi_ops_init(ops);
+	if (emapi_mock_init(mock, 16, 16) || emapi_mock_register(mock, ops) 
+		|| emapi_server_init(&srv, emapi_ops_dispatch, ops) || emapi_server_listen(&srv, "@emapi-testbench"))
+	{
+		printf("server: FAIL\n");
+		return 1;
+	}
+	pthread_create(&t, NULL, srv_thread, &srv);
+
+	c = (struct emapi_client*) malloc(sizeof(*c));
+	if (emapi_client_open(c, "@emapi-testbench"))
+	{
+		printf("client: FAIL\n");
+		return 1;
+	}
+	obj.max_msg = 4096;
+	obj.caps = 0xFFFF;
+	rv = emapi_client_hello(c, &obj);
+	emapi_prnt(&c->peer, EMOB_HELLO);
+	ok = rv == 0 && c->peer.ver == EMVER_V2 && c->peer.caps == EMHC_ENVELOPE && c->peer.max_msg == 4096
+		&& emapi_hello_has(&c->peer, EMOP_LIST_DEV) && emapi_hello_has(&c->peer, EMOP_ENVELOPE)
+		&& !emapi_hello_has(&c->peer, EMOP_CONN_DEV_BATCH);
+	printf("hello: %s\n", ok ? "OK" : "FAIL");
+
+	emapi_client_close(c);
+	emapi_server_stop(&srv);
+	pthread_join(t, NULL);
+	emapi_server_free(&srv);
+
+	// STEP 3: Say hello to a server that does not know EMOP_HELLO
+	if (emapi_server_init(&srv, srv_dispatch, NULL) || emapi_server_listen(&srv, "@emapi-testbench"))
+	{
+		printf("server: FAIL\n");
+		return 1;
+	}
+	pthread_create(&t, NULL, srv_thread, &srv);
+
+	if (emapi_client_open(c, "@emapi-testbench"))
+	{
+		printf("client: FAIL\n");
+		return 1;
+	}
+	rv = emapi_client_hello(c, NULL);
+	ok = rv == EMRC_UNSUPPORTED && c->peer.ver == EMVER_V0 && c->peer.caps == 0 
+		&& emapi_hello_has(&c->peer, EMOP_CONN_DEV) && !emapi_hello_has(&c->peer, EMOP_ENVELOPE);
+	printf("fallback: %s\n", ok ? "OK" : "FAIL");
+
+	emapi_client_close(c);
+	free(c);
+	emapi_server_stop(&srv);
+	pthread_join(t, NULL);
+	emapi_server_free(&srv);
+	emapi_mock_free(mock);
+	free(mock);
+	free(ops);
+
+	return 0;
+}
+
+int verify_transport()
+{
+	struct emapi_server srv;
+	struct emapi_framer *fr;
+	struct emapi_frame f;
+	struct emapi_smsg m;
+	struct emapi_dev_view v;
+	struct emapi_dev_ref d;
+	pthread_t t;
+	__u8 buf[256];
+	unsigned len, n;
+	int fd, rv;
+	ssize_t k;
+
+	/* STEPS 
+	 * 1: Start a server on a Unix domain socket
+	 * 2: Connect and send pipelined requests in a single write
+	 * 3: Read and print the responses
+	 * 4: Stop the server
+	 */
+
+	// STEP 1: Start a server on a Unix domain socket
+	if (emapi_server_init(&srv, srv_dispatch, NULL) || emapi_server_listen(&srv, "@emapi-testbench"))
+	{
+		printf("server: FAIL\n");
+		return 1;
+	}
+	pthread_create(&t, NULL, srv_thread, &srv);
+
+	// STEP 2: Connect and send pipelined requests in a single write
+	fd = emapi_connect("@emapi-testbench");
+	len = 0;
+	emapi_sfill_listdev(&m, 0, 0);
+	m.hdr.tag = 1;
+	len += emapi_serialize_smsg(&buf[len], &m);
+	emapi_sfill_conn(&m, 1, 2);
+	m.hdr.tag = 2;
+	len += emapi_serialize_smsg(&buf[len], &m);
+	emapi_sfill_disconn(&m, 1, 0);
+	m.hdr.tag = 3;
+	m.hdr.opcode = EMOP_MAX;
+	len += emapi_serialize_smsg(&buf[len], &m);
+	emapi_write_all(fd, buf, len);
+
+	// STEP 3: Read and print the responses
+	fr = (struct emapi_framer*) malloc(sizeof(*fr));
+	emapi_framer_init(fr);
+	n = 0;
+	while (n < 3 && (k = read(fd, buf, sizeof(buf))) > 0)
+	{
+		emapi_framer_feed(fr, buf, k);
+		while ( (rv = emapi_framer_next(fr, &f)) == 1 )
+		{
+			printf("tag %u opcode %u rc %s a %u b %u len %u\n", f.hdr.tag, f.hdr.opcode, 
+				emrc(f.hdr.rc), f.hdr.a, f.hdr.b, f.hdr.len);
+			emapi_dev_view_init(&v, f.payload, f.hdr.len, f.hdr.len ? f.hdr.a : 0);
+			while (emapi_dev_next(&v, &d) == 1)
+				printf("  %02d - %.*s\n", d.id, d.len, d.name);
+			n++;
+		}
+	}
+	printf("transport: %s\n", n == 3 ? "OK" : "FAIL");
+	close(fd);
+	free(fr);
+
+	// STEP 4: Stop the server
+	emapi_server_stop(&srv);
+	pthread_join(t, NULL);
+	emapi_server_free(&srv);
+
+	return 0;
+}
+
+void client_done(struct emapi_client *c, struct emapi_frame *rsp, void *arg)
+{
+	unsigned *cnt = (unsigned*) arg;
+
+	(void) c;
+
+	if (rsp == NULL)
+		return;
+	if (rsp->hdr.rc == EMRC_SUCCESS)
+		cnt[rsp->hdr.opcode]++;
+}
+
+int verify_client(unsigned backend)
+{
+	struct emapi_server srv;
+	struct emapi_client *c;
+	struct emapi_smsg m;
+	pthread_t t;
+	unsigned sent, cnt[EMOP_MAX];
+	int rv;
+
+	/* STEPS 
+	 * 1: Start a server on a Unix domain socket
+	 * 2: Keep as many requests in flight as there are tags 
+	 * 3: Stop the server
+	 */
+
+	// STEP 1: Start a server on a Unix domain socket
+	if (emapi_server_init(&srv, srv_dispatch, NULL) || emapi_server_backend(&srv, backend) 
+		|| emapi_server_listen(&srv, "@emapi-testbench"))
+	{
+		printf("server: FAIL\n");
+		return 1;
+	}
+	pthread_create(&t, NULL, srv_thread, &srv);
+
+	// STEP 2: Keep as many requests in flight as there are tags 
+	c = (struct emapi_client*) malloc(sizeof(*c));
+	if (emapi_client_open(c, "@emapi-testbench"))
+	{
+		printf("client: FAIL\n");
+		return 1;
+	}
+	memset(cnt, 0, sizeof(cnt));
+	sent = 0;
+	while (sent < 10000)
+	{
+		for ( ; sent < 10000 ; sent++ )
+		{
+			if (sent % 2)
+				emapi_sfill_conn(&m, 1, sent);
+			else 
+				emapi_sfill_listdev(&m, 0, 0);
+			if (emapi_client_submit(c, &m.hdr, m.payload, client_done, cnt) < 0)
+				break;
+		}
+		if (emapi_client_poll(c, 1000) < 0)
+			break;
+	}
+	rv = emapi_client_wait(c);
+	printf("list: %u conn: %u\n", cnt[EMOP_LIST_DEV], cnt[EMOP_CONN_DEV]);
+	printf("client: %s\n", (!rv && cnt[EMOP_LIST_DEV] + cnt[EMOP_CONN_DEV] == 10000) ? "OK" : "FAIL");
+	emapi_client_close(c);
+	free(c);
+
+	// STEP 3: Stop the server
+	emapi_server_stop(&srv);
+	pthread_join(t, NULL);
+	printf("backend: %s\n", srv.backend == EMTB_URING ? "io_uring" : "epoll");
+	emapi_server_free(&srv);
+
+	return 0;
+}
+
+void ops_done(struct emapi_client *c, struct emapi_frame *rsp, void *arg)
+{
+	(void) c;
+	(void) arg;
+
+	if (rsp != NULL)
+		printf("tag %u opcode 0x%02x: %s a %u b %u\n", rsp->hdr.tag, rsp->hdr.opcode, emrc(rsp->hdr.rc), 
+			rsp->hdr.a, rsp->hdr.b);
+}
+
+int verify_ops()
+{
+	struct emapi_server srv;
+	struct emapi_ops *ops;
+	struct emapi_client *c;
+	struct emapi_msg *bm;
+	struct emapi_smsg m;
+	__u8 payload[4], batch[4*EMLN_CONN_ENT];
+	unsigned i, num;
+	pthread_t t;
+
+	/* STEPS 
+	 * 1: Start a server that dispatches through an opcode table 
+	 * 2: Send valid, invalid and unsupported requests
+	 * 3: Stop the server
+	 */
+
+	// STEP 1: Start a server that dispatches through an opcode table 
+	ops = (struct emapi_ops*) malloc(sizeof(*ops));
+	emapi_ops_init(ops);
+	emapi_ops_register(ops, EMOP_LIST_DEV, srv_dispatch, NULL, NULL);
+	emapi_ops_register(ops, EMOP_CONN_DEV, srv_dispatch, NULL, NULL);
+	emapi_ops_register(ops, EMOP_DISCON_DEV, srv_dispatch, NULL, NULL);
+	emapi_ops_register(ops, EMOP_CONN_DEV_BATCH, srv_dispatch, NULL, NULL);
+	if (emapi_server_init(&srv, emapi_ops_dispatch, ops) || emapi_server_listen(&srv, "@emapi-testbench"))
+	{
+		printf("server: FAIL\n");
+		return 1;
+	}
+	pthread_create(&t, NULL, srv_thread, &srv);
+
+	// STEP 2: Send valid, invalid and unsupported requests
+	c = (struct emapi_client*) malloc(sizeof(*c));
+	if (emapi_client_open(c, "@emapi-testbench"))
+	{
+		printf("client: FAIL\n");
+		return 1;
+	}
+	emapi_sfill_disconn(&m, 1, 1);
+	emapi_client_submit(c, &m.hdr, m.payload, ops_done, NULL);
+	emapi_sfill_disconn(&m, 1, 5);
+	emapi_client_submit(c, &m.hdr, m.payload, ops_done, NULL);
+	emapi_sfill_conn(&m, 1, 2);
+	m.hdr.len = sizeof(payload);
+	emapi_client_submit(c, &m.hdr, payload, ops_done, NULL);
+	emapi_sfill_conn(&m, 1, 2);
+	m.hdr.opcode = 0x80;
+	emapi_client_submit(c, &m.hdr, m.payload, ops_done, NULL);
+	bm = (struct emapi_msg*) malloc(sizeof(*bm));
+	emapi_fill_conn_batch(bm);
+	for ( i = 0 ; i < 4 ; i++ )
+		emapi_fill_batch_add(bm, i, 10 + i, 0);
+	num = bm->hdr.a;
+	emapi_serialize(batch, bm->obj.conn, EMOB_CONN_BATCH, &num);
+	emapi_client_submit(c, &bm->hdr, batch, ops_done, NULL);
+	bm->hdr.a = 3;
+	emapi_client_submit(c, &bm->hdr, batch, ops_done, NULL);
+	free(bm);
+	emapi_client_wait(c);
+	emapi_client_close(c);
+	free(c);
+
+	// STEP 3: Stop the server
+	emapi_server_stop(&srv);
+	pthread_join(t, NULL);
+	emapi_server_free(&srv);
+	free(ops);
+
+	return 0;
+}
+
+void *shm_thread(void *arg)
+{
+	struct emapi_shm m;
+	struct emapi_frame f;
+	struct emapi_hdr h;
+	int sock = *(int*) arg;
+	int rv;
+
+	if (emapi_shm_join(&m, sock))
+		return NULL;
+	m.spin = 0;
+
+	// Answer until the peer sends a request with an unknown opcode
+	while ( (rv = emapi_shm_recv(&m, &f, 1000)) == 1 )
+	{
+		if (f.hdr.opcode >= EMOP_MAX)
+			break;
+		emapi_fill_hdr(&h, EMMT_RSP, f.hdr.tag, EMRC_SUCCESS, f.hdr.opcode, 0, f.hdr.a, f.hdr.b);
+		emapi_shm_release(&m);
+		while (emapi_shm_send(&m, &h, NULL))
+			;
+	}
+
+	emapi_shm_close(&m);
+	return NULL;
+}
+
+void *shm_sender(void *arg)
+{
+	struct emapi_shm *m = *(struct emapi_shm**) arg;
+	struct emapi_smsg sm;
+	unsigned i;
+
+	// Tag identifies the sender, Immediate B the sequence number
+	for ( i = 0 ; i < 20000 ; i++ )
+	{
+		emapi_sfill_conn(&sm, 1, i);
+		sm.hdr.tag = (struct emapi_shm**) arg - (struct emapi_shm**) shm_senders;
+		while (emapi_shm_send(m, &sm.hdr, sm.payload))
+			sched_yield();
+	}
+	return NULL;
+}
+
+int verify_shm()
+{
+	struct emapi_shm m, rx;
+	struct emapi_frame f;
+	struct emapi_smsg sm;
+	struct timespec t0, t1;
+	pthread_t t, ts[4];
+	unsigned i, ok, seq[4];
+	int sv[2];
+	double ns;
+
+	/* STEPS 
+	 * 1: Create the rings and pass them to a responder thread 
+	 * 2: Time request / response round trips
+	 * 3: Stop the responder
+	 * 4: Send from several threads on a MPSC ring
+	 */
+
+	// STEP 1: Create the rings and pass them to a responder thread 
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) || emapi_shm_create(&m, 0, 0))
+	{
+		printf("shm: FAIL\n");
+		return 1;
+	}
+	pthread_create(&t, NULL, shm_thread, &sv[1]);
+	emapi_shm_share(&m, sv[0]);
+	m.spin = 100;
+
+	// STEP 2: Time request / response round trips
+	ok = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for ( i = 0 ; i < 100000 ; i++ )
+	{
+		if (i % 2)
+			emapi_sfill_conn(&sm, 1, i);
+		else 
+			emapi_sfill_listdev(&sm, 0, 0);
+		sm.hdr.tag = i;
+		if (emapi_shm_send(&m, &sm.hdr, sm.payload))
+			break;
+		if (emapi_shm_recv(&m, &f, 1000) != 1)
+			break;
+		if (f.hdr.type == EMMT_RSP && f.hdr.tag == (i & 0xFF) && f.hdr.rc == EMRC_SUCCESS)
+			ok++;
+		emapi_shm_release(&m);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+	printf("round trips: %u avg %.0f ns\n", ok, i ? ns / i : 0);
+	printf("shm: %s\n", ok == 100000 ? "OK" : "FAIL");
+
+	// STEP 3: Stop the responder
+	emapi_fill_hdr(&sm.hdr, EMMT_REQ, 0, 0, EMOP_MAX, 0, 0, 0);
+	emapi_shm_send(&m, &sm.hdr, NULL);
+	pthread_join(t, NULL);
+	emapi_shm_close(&m);
+
+	// STEP 4: Send from several threads on a MPSC ring
+	if (emapi_shm_create(&m, 0, EMSH_MPSC) || emapi_shm_share(&m, sv[0]) || emapi_shm_join(&rx, sv[1]))
+	{
+		printf("mpsc: FAIL\n");
+		return 1;
+	}
+	for ( i = 0 ; i < 4 ; i++ )
+	{
+		shm_senders[i] = &m;
+		seq[i] = 0;
+		pthread_create(&ts[i], NULL, shm_sender, &shm_senders[i]);
+	}
+	ok = 0;
+	for ( i = 0 ; i < 4 * 20000 ; i++ )
+	{
+		if (emapi_shm_recv(&rx, &f, 1000) != 1 || f.hdr.tag >= 4)
+			break;
+		if (f.hdr.b == seq[f.hdr.tag]++)
+			ok++;
+		emapi_shm_release(&rx);
+	}
+	for ( i = 0 ; i < 4 ; i++ )
+		pthread_join(ts[i], NULL);
+	printf("mpsc in order: %u\n", ok);
+	printf("mpsc: %s\n", ok == 4 * 20000 ? "OK" : "FAIL");
+	emapi_shm_close(&rx);
+	emapi_shm_close(&m);
+	close(sv[0]);
+	close(sv[1]);
+
+	return 0;
+}
+
+int verify_coal()
+{
+	struct emapi_server srv;
+	struct emapi_coal *e;
+	struct emapi_framer *fr;
+	struct emapi_env_view v;
+	struct emapi_frame f, in;
+	struct emapi_smsg m;
+	pthread_t t;
+	__u8 *p, buf[256];
+	unsigned n;
+	int len, fd, rv;
+	ssize_t k;
+
+	/* STEPS 
+	 * 1: Pack messages until the size threshold is reached
+	 * 2: Walk the envelope 
+	 * 3: Check the time threshold
+	 * 4: Send an envelope to a server
+	 */
+
+	// STEP 1: Pack messages until the size threshold is reached
+	e = (struct emapi_coal*) malloc(sizeof(*e));
+	emapi_coal_init(e, 64, 0);
+	for ( n = 0 ; !emapi_coal_due(e) ; n++ )
+	{
+		emapi_sfill_conn(&m, n, 100 + n);
+		m.hdr.tag = n;
+		emapi_coal_add(e, &m.hdr, m.payload);
+	}
+	len = emapi_coal_seal(e, &p);
+	printf("packed %u messages in %d bytes\n", n, len);
+
+	// STEP 2: Walk the envelope 
+	fr = (struct emapi_framer*) malloc(sizeof(*fr));
+	emapi_framer_init(fr);
+	emapi_framer_feed(fr, p, len);
+	rv = emapi_framer_next(fr, &f);
+	n = 0;
+	if (rv == 1 && !emapi_env_view_init(&v, &f))
+		while ( (rv = emapi_env_next(&v, &in)) == 1 )
+		{
+			printf("tag %u opcode %s a %u b %u\n", in.hdr.tag, emop(in.hdr.opcode), in.hdr.a, in.hdr.b);
+			n++;
+		}
+	printf("envelope: %s\n", (rv == 0 && n == f.hdr.a) ? "OK" : "FAIL");
+	emapi_coal_reset(e);
+
+	// STEP 3: Check the time threshold
+	emapi_coal_init(e, 0, 1000);
+	emapi_sfill_listdev(&m, 0, 0);
+	emapi_coal_add(e, &m.hdr, m.payload);
+	rv = emapi_coal_due(e);
+	usleep(2000);
+	rv = !rv && emapi_coal_due(e);
+	len = emapi_coal_seal(e, &p);
+	printf("time threshold: %s\n", (rv && len == EMLN_HDR && p[3] == EMOP_LIST_DEV) ? "OK" : "FAIL");
+
+	// STEP 4: Send an envelope to a server
+	if (emapi_server_init(&srv, srv_dispatch, NULL) || emapi_server_listen(&srv, "@emapi-testbench"))
+	{
+		printf("server: FAIL\n");
+		return 1;
+	}
+	pthread_create(&t, NULL, srv_thread, &srv);
+
+	fd = emapi_connect("@emapi-testbench");
+	emapi_coal_init(e, 0, 0);
+	for ( n = 0 ; n < 8 ; n++ )
+	{
+		emapi_sfill_disconn(&m, n, 0);
+		m.hdr.tag = n;
+		emapi_coal_add(e, &m.hdr, m.payload);
+	}
+	len = emapi_coal_seal(e, &p);
+	emapi_write_all(fd, p, len);
+
+	emapi_framer_init(fr);
+	n = 0;
+	while (n < 8 && (k = read(fd, buf, sizeof(buf))) > 0)
+	{
+		emapi_framer_feed(fr, buf, k);
+		while ( (rv = emapi_framer_next(fr, &f)) == 1 )
+			if (f.hdr.rc == EMRC_SUCCESS && f.hdr.tag == n)
+				n++;
+	}
+	printf("server: %s\n", n == 8 ? "OK" : "FAIL");
+	close(fd);
+
+	emapi_server_stop(&srv);
+	pthread_join(t, NULL);
+	emapi_server_free(&srv);
+	free(fr);
+	free(e);
+
+	return 0;
+}
+
+int verify_stats()
+{
+	struct emapi_stats *st;
+	struct emapi_hist *h;
+	unsigned k, op, ok;
+
+	/* STEPS 
+	 * 1: Record a client / server workload
+	 * 2: Print the percentiles per opcode
+	 * 3: Reset
+	 */
+
+	// STEP 1: Record a client / server workload
+	emapi_stats_enable(1);
+	verify_client(EMTB_EPOLL);
+	emapi_stats_enable(0);
+
+	// STEP 2: Print the percentiles per opcode
+	st = (struct emapi_stats*) malloc(sizeof(*st));
+	emapi_stats_snapshot(st);
+	ok = 1;
+	for ( k = 0 ; k < EMSK_MAX ; k++ )
+	{
+		for ( op = EMOP_LIST_DEV ; op <= EMOP_CONN_DEV ; op++ )
+		{
+			h = &st->op[k][op];
+			printf("%s %-16s count %llu p50 %llu p99 %llu max %llu ns\n", k == EMSK_CLIENT ? "client" : "server", emop(op),
+				(unsigned long long) h->count, (unsigned long long) emapi_hist_pct(h, 50), 
+				(unsigned long long) emapi_hist_pct(h, 99), (unsigned long long) h->max);
+			if (h->count != 5000 || emapi_hist_pct(h, 50) > emapi_hist_pct(h, 99))
+				ok = 0;
+		}
+		if (st->rc[k][EMRC_SUCCESS].count != 10000)
+			ok = 0;
+	}
+	printf("histograms: %s\n", ok ? "OK" : "FAIL");
+
+	// STEP 3: Reset
+	emapi_stats_reset();
+	emapi_stats_snapshot(st);
+	printf("reset: %s\n", st->op[EMSK_CLIENT][EMOP_LIST_DEV].count == 0 ? "OK" : "FAIL");
+	free(st);
+
+	return 0;
+}
+
+int verify_capture()
+{
+	struct emapi_capfile f;
+	struct emapi_cap_rec *r;
+	struct emapi_hdr h;
+	unsigned cnt[EMSK_MAX][EMCD_MAX], ok;
+	const char *path = "/tmp/emapi_testbench.emcap";
+	FILE *fp;
+	__u32 bom;
+	long n;
+	int rv;
+
+	/* STEPS 
+	 * 1: Capture a client / server workload
+	 * 2: Dump the ring
+	 * 3: Read back and check every record
+	 * 4: Reject a file written in the other byte order
+	 */
+
+	// STEP 1: Capture a client / server workload
+	if (emapi_capture_init(1024, 64))
+	{
+		printf("emapi_capture_init: FAIL\n");
+		return 1;
+	}
+	verify_client(EMTB_EPOLL);
+	emapi_capture_enable(0);
+
+	// STEP 2: Dump the ring
+	n = emapi_capture_dump(path);
+	printf("dump: %ld records\n", n);
+
+	// STEP 3: Read back and check every record
+	if (emapi_capfile_open(&f, path))
+	{
+		printf("emapi_capfile_open: FAIL\n");
+		emapi_capture_free();
+		return 1;
+	}
+
+	memset(cnt, 0, sizeof(cnt));
+	ok = f.hdr->count == (__u64) n && n == 1024 && f.hdr->snaplen == 64;
+	while ( (rv = emapi_capfile_next(&f, &r)) == 1 )
+	{
+		emapi_deserialize(&h, (__u8*) (r + 1), EMOB_HDR, NULL);
+		if (r->caplen < EMLN_HDR || r->side >= EMSK_MAX || r->dir >= EMCD_MAX || (unsigned) h.len + EMLN_HDR != r->len)
+			ok = 0;
+		else
+			cnt[r->side][r->dir]++;
+	}
+	if (rv < 0)
+		ok = 0;
+
+	printf("client tx %u rx %u, server rx %u tx %u, dropped %llu\n", cnt[EMSK_CLIENT][EMCD_TX], cnt[EMSK_CLIENT][EMCD_RX],
+		cnt[EMSK_SERVER][EMCD_RX], cnt[EMSK_SERVER][EMCD_TX], (unsigned long long) f.hdr->dropped);
+	printf("records: %s\n", ok ? "OK" : "FAIL");
+
+	bom = __builtin_bswap32(f.hdr->bom);
+	emapi_capfile_close(&f);
+
+	// STEP 4: Reject a file written in the other byte order
+	fp = fopen(path, "r+b");
+	if (fp != NULL)
+	{
+		fseek(fp, offsetof(struct emapi_cap_hdr, bom), SEEK_SET);
+		fwrite(&bom, sizeof(bom), 1, fp);
+		fclose(fp);
+	}
+	rv = emapi_capfile_open(&f, path);
+	printf("byte order: %s\n", fp != NULL && rv != 0 ? "rejected" : "FAIL");
+	if (rv == 0)
+		emapi_capfile_close(&f);
+	unlink(path);
+	emapi_capture_free();
+
+	return 0;
+}
+
+void mock_done(struct emapi_client *c, struct emapi_frame *rsp, void *arg)
+{
+	unsigned *cnt = (unsigned*) arg;
+	struct emapi_dev_view v;
+	struct emapi_dev_ref d;
+
+	(void) c;
+
+	if (rsp == NULL)
+		return;
+
+	cnt[rsp->hdr.rc < EMRC_MAX ? rsp->hdr.rc : EMRC_MAX]++;
+	if (rsp->hdr.opcode == EMOP_LIST_DEV && rsp->hdr.rc == EMRC_SUCCESS)
+	{
+		emapi_dev_view_init_ver(&v, rsp->payload, rsp->hdr.len, rsp->hdr.a, rsp->hdr.ver);
+		while (emapi_dev_next(&v, &d) == 1)
+			cnt[EMRC_MAX + 1]++;
+		cnt[EMRC_MAX + 2] = rsp->hdr.b;
+	}
+}
+
+int verify_mock()
+{
+	struct emapi_server srv;
+	struct emapi_mock *mock;
+	struct emapi_ops *ops;
+	struct emapi_client *c;
+	struct emapi_smsg m;
+	unsigned i, cnt[EMRC_MAX + 3];
+	pthread_t t;
+	__u64 t0;
+
+	/* STEPS 
+	 * 1: Start an emulated switch with more devices than fit in one response
+	 * 2: Page through the device list
+	 * 3: Connect and disconnect
+	 * 4: Inject errors
+	 * 5: Hold replies back without blocking the server
+	 * 6: Stop the server
+	 */
+
+	// STEP 1: Start an emulated switch with more devices than fit in one response
+	mock = (struct emapi_mock*) malloc(sizeof(*mock));
+	ops = (struct emapi_ops*) malloc(sizeof(*ops));
+	emapi_ops_init(ops);
+	if (emapi_mock_init(mock, 1000, 16) || emapi_mock_register(mock, ops) 
+		|| emapi_server_init(&srv, emapi_ops_dispatch, ops) || emapi_server_listen(&srv, "@emapi-testbench"))
+	{
+		printf("server: FAIL\n");
+		return 1;
+	}
+	pthread_create(&t, NULL, srv_thread, &srv);
+
+	c = (struct emapi_client*) malloc(sizeof(*c));
+	if (emapi_client_open(c, "@emapi-testbench"))
+	{
+		printf("client: FAIL\n");
+		return 1;
+	}
+
+	// STEP 2: Page through the device list
+	memset(cnt, 0, sizeof(cnt));
+	for ( i = 0 ; i < 1000 ; i += EMLN_DEV_NUM )
+	{
+		emapi_sfill_listdev(&m, 0, i);
+		emapi_client_submit(c, &m.hdr, m.payload, mock_done, cnt);
+	}
+	emapi_client_wait(c);
+	printf("devices listed: %u of %u: %s\n", cnt[EMRC_MAX + 1], cnt[EMRC_MAX + 2], 
+		(cnt[EMRC_MAX + 1] == 1000 && cnt[EMRC_MAX + 2] == 1000) ? "OK" : "FAIL");
+
+	// STEP 3: Connect and disconnect
+	memset(cnt, 0, sizeof(cnt));
+	emapi_sfill_conn(&m, 1, 900);
+	emapi_client_submit(c, &m.hdr, m.payload, mock_done, cnt);
+	emapi_sfill_conn(&m, 1, 900);
+	emapi_client_submit(c, &m.hdr, m.payload, mock_done, cnt);
+	emapi_sfill_conn(&m, 1, 901);
+	emapi_client_submit(c, &m.hdr, m.payload, mock_done, cnt);
+	emapi_sfill_conn(&m, 16, 1);
+	emapi_client_submit(c, &m.hdr, m.payload, mock_done, cnt);
+	emapi_sfill_disconn(&m, 1, 0);
+	emapi_client_submit(c, &m.hdr, m.payload, mock_done, cnt);
+	emapi_sfill_conn(&m, 1, 901);
+	emapi_client_submit(c, &m.hdr, m.payload, mock_done, cnt);
+	emapi_client_wait(c);
+	printf("connect: success %u invalid %u: %s\n", cnt[EMRC_SUCCESS], cnt[EMRC_INVALID_INPUT],
+		(cnt[EMRC_SUCCESS] == 4 && cnt[EMRC_INVALID_INPUT] == 2) ? "OK" : "FAIL");
+
+	// STEP 4: Inject errors
+	emapi_server_stop(&srv);
+	pthread_join(t, NULL);
+	mock->busy_ppm = 250000;
+	mock->err_ppm = 250000;
+	mock->lat_ns = 1000;
+	pthread_create(&t, NULL, srv_thread, &srv);
+
+	memset(cnt, 0, sizeof(cnt));
+	for ( i = 0 ; i < 4000 ; i++ )
+	{
+		emapi_sfill_disconn(&m, i % 16, 0);
+		while (emapi_client_submit(c, &m.hdr, m.payload, mock_done, cnt) < 0)
+			emapi_client_poll(c, 1000);
+	}
+	emapi_client_wait(c);
+	printf("success %u busy %u error %u: %s\n", cnt[EMRC_SUCCESS], cnt[EMRC_BUSY], cnt[EMRC_INTERNAL_ERROR],
+		(cnt[EMRC_SUCCESS] > 1600 && cnt[EMRC_BUSY] > 800 && cnt[EMRC_INTERNAL_ERROR] > 800) ? "OK" : "FAIL");
+
+	// STEP 5: Hold replies back without blocking the server
+	emapi_server_stop(&srv);
+	pthread_join(t, NULL);
+	mock->busy_ppm = 0;
+	mock->err_ppm = 0;
+	mock->lat_ns = 10000000;
+	pthread_create(&t, NULL, srv_thread, &srv);
+
+	memset(cnt, 0, sizeof(cnt));
+	t0 = emapi_now_ns();
+	for ( i = 0 ; i < 64 ; i++ )
+	{
+		emapi_sfill_disconn(&m, i % 16, 0);
+		emapi_client_submit(c, &m.hdr, m.payload, mock_done, cnt);
+	}
+	emapi_client_wait(c);
+	t0 = emapi_now_ns() - t0;
+	printf("64 requests at 10 ms: %s\n", 
+		(cnt[EMRC_SUCCESS] == 64 && t0 >= 10000000 && t0 < 200000000) ? "OK" : "FAIL");
+
+	// STEP 6: Stop the server
+	emapi_client_close(c);
+	free(c);
+	emapi_server_stop(&srv);
+	pthread_join(t, NULL);
+	emapi_server_free(&srv);
+	emapi_mock_free(mock);
+	free(mock);
+	free(ops);
+
+	return 0;
+}
+
+int verify_v2()
+{
+	struct emapi_server srv;
+	struct emapi_mock *mock;
+	struct emapi_ops *ops;
+	struct emapi_client *c;
+	struct emapi_smsg m;
+	struct emapi_hdr h, o;
+	struct emapi_dev *dev;
+	struct emapi_conn_ent ent, ent2;
+	struct emapi_dev_view v;
+	struct emapi_dev_ref d;
+	unsigned num, cnt[EMRC_MAX + 3];
+	__u8 data[EMLN_HDR + 16];
+	int len, ok;
+	pthread_t t;
+
+	/* STEPS 
+	 * 1: Header: A keeps 16 bits in v2 and 8 bits in v0
+	 * 2: List Devices entries with 32 bit IDs
+	 * 3: Connect entries with 16 bit PPIDs
+	 * 4: List devices past ID 255 from an emulated switch
+	 */
+
+	// STEP 1: Header: A keeps 16 bits in v2 and 8 bits in v0
+	emapi_fill_hdr(&h, EMMT_REQ, 7, 0, EMOP_DISCON_DEV, 0, 0x1234, 0);
+	h.ver = EMVER_V2;
+	emapi_serialize(data, &h, EMOB_HDR, NULL);
+	emapi_deserialize(&o, data, EMOB_HDR, NULL);
+	ok = o.ver == EMVER_V2 && o.a == 0x1234;
+	h.ver = EMVER_V0;
+	emapi_serialize(data, &h, EMOB_HDR, NULL);
+	emapi_deserialize(&o, data, EMOB_HDR, NULL);
+	ok &= data[5] == 0 && o.ver == EMVER_V0 && o.a == 0x34;
+	data[5] = 0x12;
+	emapi_deserialize(&o, data, EMOB_HDR, NULL);
+	ok &= o.a == 0x34;
+	printf("header: %s\n", ok ? "OK" : "FAIL");
+
+	// STEP 2: List Devices entries with 32 bit IDs
+	dev = (struct emapi_dev*) calloc(2, sizeof(*dev));
+	dev[0].id = 70000;
+	dev[0].len = sprintf(dev[0].name, "Wide") + 1;
+	dev[1].id = 255;
+	dev[1].len = 0;
+	num = 2;
+	len = emapi_serialize_ver(data, dev, EMOB_LIST_DEV, &num, EMVER_V2);
+	memset(dev, 0, 2 * sizeof(*dev));
+	ok = len == 15 && emapi_deserialize_ver(dev, data, EMOB_LIST_DEV, &num, EMVER_V2) == len
+		&& dev[0].id == 70000 && !strcmp(dev[0].name, "Wide") && dev[1].id == 255;
+	emapi_dev_view_init_ver(&v, data, len, num, EMVER_V2);
+	ok &= emapi_dev_next(&v, &d) == 1 && d.id == 70000 && d.len == 5;
+	ok &= emapi_dev_next(&v, &d) == 1 && d.id == 255 && d.len == 0;
+	ok &= emapi_dev_next(&v, &d) == 0;
+	printf("list devices: %s\n", ok ? "OK" : "FAIL");
+	free(dev);
+
+	// STEP 3: Connect entries with 16 bit PPIDs
+	memset(&ent, 0, sizeof(ent));
+	ent.ppid = 300;
+	ent.flags = 1;
+	num = 1;
+	emapi_serialize_ver(data, &ent, EMOB_CONN_BATCH, &num, EMVER_V2);
+	emapi_deserialize_ver(&ent2, data, EMOB_CONN_BATCH, &num, EMVER_V2);
+	ok = ent2.ppid == 300 && ent2.flags == 1;
+	emapi_serialize_ver(data, &ent, EMOB_CONN_BATCH, &num, EMVER_V0);
+	emapi_deserialize_ver(&ent2, data, EMOB_CONN_BATCH, &num, EMVER_V0);
+	ok &= data[3] == 0 && ent2.ppid == 44;
+	num = EMLN_CONN_NUM + 1;
+	ok &= emapi_deserialize_ver(&ent2, data, EMOB_CONN_BATCH, &num, EMVER_V2) == 0;
+	printf("connect entries: %s\n", ok ? "OK" : "FAIL");
+
+	// STEP 4: List devices past ID 255 from an emulated switch
+	mock = (struct emapi_mock*) malloc(sizeof(*mock));
+	ops = (struct emapi_ops*) malloc(sizeof(*ops));
+	emapi_ops_init(ops);
+	if (emapi_mock_init(mock, 70000, 1024) || emapi_mock_register(mock, ops) 
+		|| emapi_server_init(&srv, emapi_ops_dispatch, ops) || emapi_server_listen(&srv, "@emapi-testbench"))
+	{
+		printf("server: FAIL\n");
+		return 1;
+	}
+	pthread_create(&t, NULL, srv_thread, &srv);
+
+	c = (struct emapi_client*) malloc(sizeof(*c));
+	if (emapi_client_open(c, "@emapi-testbench"))
+	{
+		printf("client: FAIL\n");
+		return 1;
+	}
+
+	memset(cnt, 0, sizeof(cnt));
+	emapi_sfill_listdev(&m, 0, 69990);
+	m.hdr.ver = EMVER_V2;
+	emapi_client_submit(c, &m.hdr, m.payload, mock_done, cnt);
+	emapi_sfill_conn(&m, 1000, 69999);
+	m.hdr.ver = EMVER_V2;
+	emapi_client_submit(c, &m.hdr, m.payload, mock_done, cnt);
+	emapi_sfill_conn(&m, 1000, 69999);
+	m.hdr.ver = EMVER_V2 + 1;
+	emapi_client_submit(c, &m.hdr, m.payload, mock_done, cnt);
+	emapi_client_wait(c);
+	printf("devices listed: %u success %u unsupported %u: %s\n", cnt[EMRC_MAX + 1], cnt[EMRC_SUCCESS], 
+		cnt[EMRC_UNSUPPORTED], (cnt[EMRC_MAX + 1] == 10 && cnt[EMRC_SUCCESS] == 2 && cnt[EMRC_UNSUPPORTED] == 1) 
+		? "OK" : "FAIL");
+
+	emapi_client_close(c);
+	free(c);
+	emapi_server_stop(&srv);
+	pthread_join(t, NULL);
+	emapi_server_free(&srv);
+	emapi_mock_free(mock);
+	free(mock);
+	free(ops);
+
+	return 0;
+}
+
+int verify_fmt()
+{
+	struct emapi_frame f;
+	struct emapi_hdr h;
+	struct emapi_dev dev[2];
+	struct emapi_conn_ent e;
+	__u8 data[256];
+	char out[512];
+	unsigned num;
+	int len, ok;
+
+	/* STEPS 
+	 * 1: Format a header as text and JSON
+	 * 2: Format a List Devices response with a name that needs escaping
+	 * 3: Format an envelope holding a Connect Batch request
+	 * 4: Output that does not fit
+	 */
+
+	// STEP 1: Format a header as text and JSON
+	emapi_fill_hdr(&h, EMMT_REQ, 0x42, 0, EMOP_CONN_DEV, 0, 7, 1234567);
+	len = emapi_fmt(out, sizeof(out), &h, EMOB_HDR, 0);
+	printf("%s\n", out);
+	ok = len == (int) strlen(out) && !strcmp(out, 
+		"type=Request ver=0 tag=0x42 rc=Success opcode=Connect Device a=0x0007 len=0 b=0x0012d687");
+	len = emapi_fmt(out, sizeof(out), &h, EMOB_HDR, EMFM_JSON);
+	printf("%s\n", out);
+	ok &= len == (int) strlen(out) && !strcmp(out, 
+		"{\"type\":0,\"ver\":0,\"tag\":66,\"rc\":0,\"opcode\":2,\"a\":7,\"len\":0,\"b\":1234567}");
+	printf("header: %s\n", ok ? "OK" : "FAIL");
+
+	// STEP 2: Format a List Devices response with a name that needs escaping
+	dev[0].id = 70000;
+	dev[0].len = sprintf(dev[0].name, "Dev \"0\"\t") + 1;
+	dev[1].id = 1;
+	dev[1].len = sprintf(dev[1].name, "Dev 1") + 1;
+	num = 2;
+	len = emapi_serialize_ver(&data[EMLN_HDR], dev, EMOB_LIST_DEV, &num, EMVER_V2);
+	emapi_fill_hdr(&f.hdr, EMMT_RSP, 1, EMRC_SUCCESS, EMOP_LIST_DEV, len, num, num);
+	f.hdr.ver = EMVER_V2;
+	emapi_serialize(data, &f.hdr, EMOB_HDR, NULL);
+	f.buf = data;
+	f.payload = &data[EMLN_HDR];
+	f.len = EMLN_HDR + len;
+	len = emapi_fmt_frame(out, sizeof(out), &f, 0);
+	printf("%s\n", out);
+	ok = len > 0 && strstr(out, " | id=70000 name=\"Dev \\\"0\\\"?\" | id=1 name=\"Dev 1\"") != NULL;
+	len = emapi_fmt_frame(out, sizeof(out), &f, EMFM_JSON);
+	printf("%s\n", out);
+	ok &= len > 0 && strstr(out, ",\"obj\":[{\"id\":70000,\"name\":\"Dev \\\"0\\\"\\u0009\"},{\"id\":1,\"name\":\"Dev 1\"}]}") != NULL;
+	printf("list devices: %s\n", ok ? "OK" : "FAIL");
+
+	// STEP 3: Format an envelope holding a Connect Batch request
+	memset(&e, 0, sizeof(e));
+	e.ppid = 3;
+	e.dev = 9;
+	num = 1;
+	emapi_fill_hdr(&h, EMMT_REQ, 5, 0, EMOP_CONN_DEV_BATCH, EMLN_CONN_ENT, 1, 0);
+	emapi_serialize(&data[EMLN_HDR], &h, EMOB_HDR, NULL);
+	emapi_serialize(&data[2 * EMLN_HDR], &e, EMOB_CONN_BATCH, &num);
+	emapi_fill_hdr(&f.hdr, EMMT_REQ, 0, 0, EMOP_ENVELOPE, EMLN_HDR + EMLN_CONN_ENT, 1, 0);
+	emapi_serialize(data, &f.hdr, EMOB_HDR, NULL);
+	f.len = 2 * EMLN_HDR + EMLN_CONN_ENT;
+	len = emapi_fmt_frame(out, sizeof(out), &f, 0);
+	printf("%s\n", out);
+	ok = len > 0 && strstr(out, " | [type=Request ver=0 tag=0x05") != NULL 
+		&& strstr(out, " | ppid=3 flags=0x00 rc=Success dev=9]") != NULL;
+	len = emapi_fmt_frame(out, sizeof(out), &f, EMFM_JSON);
+	printf("%s\n", out);
+	ok &= len > 0 && strstr(out, "\"obj\":[{\"ppid\":3,\"flags\":0,\"rc\":0,\"dev\":9}]}]}") != NULL;
+	printf("envelope: %s\n", ok ? "OK" : "FAIL");
+
+	// STEP 4: Output that does not fit
+	len = emapi_fmt_frame(out, 40, &f, EMFM_JSON);
+	ok = len == -1 && out[0] == 0;
+	len = emapi_fmt(out, 3, &num, EMOB_MAX, 0);
+	ok &= len == -1;
+	printf("overflow: %s\n", ok ? "OK" : "FAIL");
+
+	return 0;
+}
+
 int verify_sizes()
 {
 	printf("Sizeof:\n");
 	printf("struct emapi_hdr:         %lu\n", sizeof(struct emapi_hdr));
 	printf("struct emapi_dev:         %lu\n", sizeof(struct emapi_dev));
+	printf("struct emapi_msg:         %lu\n", sizeof(struct emapi_msg));
+	printf("struct emapi_smsg:        %lu\n", sizeof(struct emapi_smsg));
 	return 0;
 }
 
@@ -167,10 +1571,28 @@ int main(int argc, char **argv)
 		"",
 		"fmapi_hdr",					// 1
 		"fmapi_dev",					// 2
-		"sizeof()"						// 3
+		"emapi_conn_ent",				// 3
+		"emapi_hello",					// 4
+		"sizeof()",						// 5
+		"emapi_dev_view",				// 6
+		"emapi_framer",					// 7
+		"emapi_serialize_iov",			// 8
+		"emapi_deserialize_hdrs",		// 9
+		"emapi_pool",					// 10
+		"emapi_server",					// 11
+		"emapi_client",					// 12
+		"emapi_ops",					// 13
+		"emapi_server io_uring",		// 14
+		"emapi_shm",					// 15
+		"emapi_coal",					// 16
+		"emapi_stats",					// 17
+		"emapi_capture",				// 18
+		"emapi_mock",					// 19
+		"emapi v2",						// 20
+		"emapi_fmt"						// 21
 	};
 
-	max = 3;
+	max = 21;
 
 	if (argc > 1)
 		i = atoi(argv[1]);
@@ -188,7 +1610,25 @@ int main(int argc, char **argv)
 	{
 		case EMOB_HDR					: verify_hdr(); 					break;	// 1,  //!< struct emapi_hdr
 		case EMOB_LIST_DEV				: verify_dev();  		 			break;	// 2,  //!< struct emapi_dev
-		case EMOB_MAX 					: verify_sizes();					break;  // 3,  
+		case EMOB_CONN_BATCH			: verify_conn_batch(); 				break;	// 3,  //!< struct emapi_conn_ent
+		case EMOB_HELLO					: verify_hello();					break;	// 4,  //!< struct emapi_hello
+		case EMOB_MAX 					: verify_sizes();					break;  // 5,  
+		case EMOB_MAX+1					: verify_dev_view();				break;  // 6,  
+		case EMOB_MAX+2					: verify_framer();					break;  // 7,  
+		case EMOB_MAX+3					: verify_iov();						break;  // 8,  
+		case EMOB_MAX+4					: verify_hdrs();					break;  // 9,  
+		case EMOB_MAX+5					: verify_pool();					break;  // 10, 
+		case EMOB_MAX+6					: verify_transport();				break;  // 11, 
+		case EMOB_MAX+7					: verify_client(EMTB_EPOLL);		break;  // 12, 
+		case EMOB_MAX+8					: verify_ops();						break;  // 13, 
+		case EMOB_MAX+9					: verify_client(EMTB_URING);		break;  // 14, 
+		case EMOB_MAX+10				: verify_shm();						break;  // 15, 
+		case EMOB_MAX+11				: verify_coal();					break;  // 16, 
+		case EMOB_MAX+12				: verify_stats();					break;  // 17, 
+		case EMOB_MAX+13				: verify_capture();					break;  // 18, 
+		case EMOB_MAX+14				: verify_mock();					break;  // 19, 
+		case EMOB_MAX+15				: verify_v2();						break;  // 20, 
+		case EMOB_MAX+16				: verify_fmt();						break;  // 21, 
 		default 						: print_strings();					break;
 	}
 
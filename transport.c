@@ -0,0 +1,1072 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		transport.c
+ *
+ * @brief 		Code file for the EM API socket transport
+ *
+ * @details 	Provides a non-blocking Unix domain / TCP listener driven by
+ *              an epoll event loop. Each connection has a read buffer that
+ *              is fed to an emapi_framer, so many pipelined messages can be
+ *              parsed per read(). Replies are queued on the connection and
+ *              flushed once per pass of the event loop.
+ *
+ *              Addresses take one of the following forms:
+ *              - unix:<path>   Unix domain socket
+ *              - <path>        Unix domain socket if the string contains '/'
+ *              - @<name>       Unix domain socket in the abstract namespace
+ *              - [tcp:]<host>:<port>  TCP socket. Empty host binds to all
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* accept4()
+ */
+#define _GNU_SOURCE
+
+/* malloc(), free()
+ */
+#include <stdlib.h>
+
+/* memset(), memcpy(), strchr()
+ */
+#include <string.h>
+
+/* offsetof()
+ */
+#include <stddef.h>
+
+/* Return error codes from functions
+ */
+#include <errno.h>
+
+/* read(), write(), close(), unlink()
+ */
+#include <unistd.h>
+
+/* socket(), bind(), listen(), accept4(), connect()
+ */
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/* epoll_create1(), epoll_ctl(), epoll_wait()
+ */
+#include <sys/epoll.h>
+
+/* eventfd()
+ */
+#include <sys/eventfd.h>
+
+/* timerfd_create(), timerfd_settime()
+ */
+#include <sys/timerfd.h>
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+#define EMTR_EVENTS 				64 		//!< Max events handled per epoll_wait()
+#define EMTR_BACKLOG 				128 	//!< listen() backlog
+
+/* ENUMERATIONS ==============================================================*/
+
+/* STRUCTS ===================================================================*/
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+/**
+ * Markers stored in epoll_event.data.ptr for the non connection descriptors
+ */
+static char emtr_listen_tok;
+static char emtr_wake_tok;
+static char emtr_timer_tok;
+
+/* PROTOTYPES ================================================================*/
+
+/* FUNCTIONS =================================================================*/
+
+/**
+ * Resolve an address string into a sockaddr
+ *
+ * @return 0 upon success, non zero otherwise
+ */
+static int emtr_addr(const char *addr, struct sockaddr_storage *ss, socklen_t *sl, int passive)
+{
+	struct addrinfo hints, *res;
+	struct sockaddr_un *un;
+	char host[256];
+	const char *port, *path;
+	unsigned n;
+	int rv;
+
+	memset(ss, 0, sizeof(*ss));
+
+	path = NULL;
+	if (!strncmp(addr, "unix:", 5))
+		path = addr + 5;
+	else if (addr[0] == '@' || strchr(addr, '/') != NULL)
+		path = addr;
+
+	// Unix domain socket
+	if (path != NULL)
+	{
+		un = (struct sockaddr_un*) ss;
+		n = strlen(path);
+		if (n == 0 || n >= sizeof(un->sun_path))
+			return 1;
+		un->sun_family = AF_UNIX;
+		memcpy(un->sun_path, path, n);
+		if (path[0] == '@')
+			un->sun_path[0] = 0;
+		*sl = offsetof(struct sockaddr_un, sun_path) + n + (path[0] == '@' ? 0 : 1);
+		return 0;
+	}
+
+	// TCP socket
+	if (!strncmp(addr, "tcp:", 4))
+		addr += 4;
+	port = strrchr(addr, ':');
+	if (port == NULL || (unsigned) (port - addr) >= sizeof(host))
+		return 1;
+	n = port - addr;
+	memcpy(host, addr, n);
+	host[n] = 0;
+	port++;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (passive)
+		hints.ai_flags = AI_PASSIVE;
+
+	rv = getaddrinfo(n > 0 ? host : NULL, port, &hints, &res);
+	if (rv != 0)
+		return 1;
+
+	memcpy(ss, res->ai_addr, res->ai_addrlen);
+	*sl = res->ai_addrlen;
+	freeaddrinfo(res);
+	return 0;
+}
+
+/**
+ * Create a non-blocking listening socket
+ *
+ * @param 	addr 	Address string
+ * @return 	file descriptor, -1 upon error
+ */
+int emapi_listen(const char *addr)
+{
+	struct sockaddr_storage ss;
+	socklen_t sl;
+	int fd, one;
+
+	if (addr == NULL || emtr_addr(addr, &ss, &sl, 1))
+		return -1;
+
+	fd = socket(ss.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	one = 1;
+	if (ss.ss_family == AF_UNIX)
+	{
+		// Remove a stale socket file left by a previous server
+		if (((struct sockaddr_un*) &ss)->sun_path[0] != 0)
+			unlink(((struct sockaddr_un*) &ss)->sun_path);
+	}
+	else
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	if (bind(fd, (struct sockaddr*) &ss, sl) || listen(fd, EMTR_BACKLOG))
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * Open a blocking connection to an EM API server
+ *
+ * @param 	addr 	Address string
+ * @return 	file descriptor, -1 upon error
+ */
+int emapi_connect(const char *addr)
+{
+	struct sockaddr_storage ss;
+	socklen_t sl;
+	int fd, one;
+
+	if (addr == NULL || emtr_addr(addr, &ss, &sl, 0))
+		return -1;
+
+	fd = socket(ss.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	if (connect(fd, (struct sockaddr*) &ss, sl))
+	{
+		close(fd);
+		return -1;
+	}
+
+	// Small request messages should not wait on Nagle
+	if (ss.ss_family != AF_UNIX)
+	{
+		one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+
+	return fd;
+}
+
+/**
+ * Write all bytes to a blocking descriptor
+ *
+ * @return 0 upon success, non zero otherwise
+ */
+int emapi_write_all(int fd, __u8 *buf, unsigned len)
+{
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = write(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 1;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * Initialize a server
+ *
+ * @param 	s 		struct emapi_server* to initialize
+ * @param 	fn 		Function called for every message received
+ * @param 	arg 	Passed to fn
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_server_init(struct emapi_server *s, emapi_dispatch_fn fn, void *arg)
+{
+	struct epoll_event ev;
+
+	memset(s, 0, sizeof(*s));
+	s->lfd = -1;
+	s->wfd = -1;
+	s->tfd = -1;
+	s->fn = fn;
+	s->arg = arg;
+
+	s->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (s->epfd < 0)
+		goto fail;
+
+	s->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (s->wfd < 0)
+		goto fail;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &emtr_wake_tok;
+	if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->wfd, &ev))
+		goto fail;
+
+	s->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (s->tfd < 0)
+		goto fail;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &emtr_timer_tok;
+	if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->tfd, &ev))
+		goto fail;
+
+	return 0;
+
+fail:
+
+	if (s->epfd >= 0)
+		close(s->epfd);
+	if (s->wfd >= 0)
+		close(s->wfd);
+	if (s->tfd >= 0)
+		close(s->tfd);
+	s->epfd = -1;
+	s->wfd = -1;
+	s->tfd = -1;
+	return 1;
+}
+
+/**
+ * Start listening for connections
+ *
+ * @param 	s 		struct emapi_server*
+ * @param 	addr 	Address string
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_server_listen(struct emapi_server *s, const char *addr)
+{
+	int fd;
+
+	fd = emapi_listen(addr);
+	if (fd < 0)
+		return 1;
+
+	if (emapi_server_listen_fd(s, fd))
+	{
+		close(fd);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Accept connections on an existing non-blocking listening socket
+ *
+ * The same listening socket may be serviced by several servers running on
+ * different threads. Each server closes the descriptor it was given when 
+ * freed, so hand each one its own dup().
+ *
+ * @param 	s 		struct emapi_server*
+ * @param 	fd 		Listening socket
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_server_listen_fd(struct emapi_server *s, int fd)
+{
+	struct epoll_event ev;
+
+	if (s->lfd >= 0)
+		return 1;
+
+	ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+	ev.data.ptr = &emtr_listen_tok;
+	if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev))
+		return 1;
+
+	s->lfd = fd;
+	return 0;
+}
+
+/**
+ * Allocate a connection object and add it to the server table
+ *
+ * Used by the event loop backends. The caller registers the descriptor 
+ * with the backend.
+ *
+ * @param 	s 		struct emapi_server*
+ * @param 	fd 		Connected socket
+ * @return 	struct emapi_conn*, NULL upon error
+ */
+struct emapi_conn *emapi_conn_new(struct emapi_server *s, int fd)
+{
+	struct emapi_conn *c, **t;
+	unsigned n;
+
+	// Grow the table indexed by descriptor
+	if ((unsigned) fd >= s->nconns)
+	{
+		n = s->nconns ? s->nconns : 64;
+		while (n <= (unsigned) fd)
+			n *= 2;
+		t = (struct emapi_conn**) realloc(s->conns, n * sizeof(*t));
+		if (t == NULL)
+			return NULL;
+		memset(&t[s->nconns], 0, (n - s->nconns) * sizeof(*t));
+		s->conns = t;
+		s->nconns = n;
+	}
+
+	c = (struct emapi_conn*) calloc(1, sizeof(*c));
+	if (c == NULL)
+		return NULL;
+
+	c->rbuf = (__u8*) malloc(EMLN_RX_BUF);
+	if (c->rbuf == NULL)
+	{
+		free(c);
+		return NULL;
+	}
+
+	c->fd = fd;
+	c->id = ++s->next_id;
+	c->srv = s;
+	emapi_framer_init(&c->rx);
+	s->conns[fd] = c;
+	s->count++;
+	return c;
+}
+
+/**
+ * Release a connection object
+ */
+static void emtr_conn_free(struct emapi_conn *c)
+{
+	free(c->tx);
+	free(c->txs);
+	free(c->rbuf);
+	free(c);
+}
+
+/**
+ * Close a connection
+ *
+ * The object is released at the end of the current event loop pass so that
+ * callers up the stack can still reference it.
+ *
+ * @param 	c 		struct emapi_conn* to close
+ */
+void emapi_conn_close(struct emapi_conn *c)
+{
+	struct emapi_server *s = c->srv;
+
+	if (c->fd < 0)
+		return;
+
+	if (s->on_close != NULL)
+		s->on_close(c, s->arg);
+
+	if (s->bclose != NULL)
+		s->bclose(c);
+
+	if (s->conns[c->fd] == c)
+		s->conns[c->fd] = NULL;
+	close(c->fd);
+	c->fd = -1;
+	s->count--;
+
+	c->next = s->dead;
+	s->dead = c;
+}
+
+/**
+ * Reserve room for len more bytes in the transmit buffer
+ *
+ * @return 	0 upon success, non zero otherwise
+ */
+static int emtr_tx_reserve(struct emapi_conn *c, unsigned len)
+{
+	unsigned cap;
+	__u8 *p;
+
+	if (c->fd < 0)
+		return 1;
+
+	// Reclaim space already written
+	if (c->tx_off > 0 && c->tx_off == c->tx_len)
+		c->tx_off = c->tx_len = 0;
+
+	if (c->tx_len + len > c->tx_cap)
+	{
+		if (c->tx_off > 0)
+		{
+			memmove(c->tx, &c->tx[c->tx_off], c->tx_len - c->tx_off);
+			c->tx_len -= c->tx_off;
+			c->tx_off = 0;
+		}
+		cap = c->tx_cap ? c->tx_cap : EMLN_MSG;
+		while (cap < c->tx_len + len)
+			cap *= 2;
+		if (cap != c->tx_cap)
+		{
+			p = (__u8*) realloc(c->tx, cap);
+			if (p == NULL)
+				return 1;
+			c->tx = p;
+			c->tx_cap = cap;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Add a connection with queued bytes to the list flushed by the event loop
+ */
+static void emtr_tx_dirty(struct emapi_conn *c)
+{
+	if (!c->dirty)
+	{
+		c->dirty = 1;
+		c->next_dirty = c->srv->dirty;
+		c->srv->dirty = c;
+	}
+}
+
+/**
+ * Queue bytes to be sent on a connection
+ *
+ * Data is flushed once per pass of the event loop so that replies to
+ * pipelined requests go out in a single write().
+ *
+ * @param 	c 		struct emapi_conn*
+ * @param 	buf 	Bytes to send
+ * @param 	len 	Number of bytes
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_conn_send(struct emapi_conn *c, __u8 *buf, unsigned len)
+{
+	if (emtr_tx_reserve(c, len))
+		return 1;
+
+	memcpy(&c->tx[c->tx_len], buf, len);
+	c->tx_len += len;
+	emtr_tx_dirty(c);
+
+	return 0;
+}
+
+/**
+ * Serialize the header of a response to a request
+ */
+static void emtr_reply_hdr(struct emapi_conn *c, struct emapi_hdr *req, __u8 rc, __u16 a, __u32 b, __u16 len, __u8 *buf)
+{
+	struct emapi_hdr h;
+
+	c->rc = rc;
+	emapi_fill_hdr(&h, EMMT_RSP, req->tag, rc, req->opcode, len, a, b);
+	h.ver = req->ver < EMVER_V2 ? req->ver : EMVER_V2;
+	emapi_enc_hdr(buf, &h);
+}
+
+/**
+ * Queue a response to a request
+ *
+ * The response uses the header version of the request, up to EMVER_V2.
+ * The header and payload are queued together or not at all.
+ *
+ * @param 	c 		struct emapi_conn*
+ * @param 	req 	struct emapi_hdr* of the request being answered
+ * @param 	rc 		Return code [EMRC]
+ * @param 	a 		Immediate A
+ * @param 	b 		Immediate B
+ * @param 	payload Serialized payload or NULL
+ * @param 	len 	Length of the payload
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_conn_reply(struct emapi_conn *c, struct emapi_hdr *req, __u8 rc, __u16 a, __u32 b, __u8 *payload, __u16 len)
+{
+	__u8 buf[EMLN_HDR];
+
+	if (len > EMLN_PAYLOAD)
+		return 1;
+
+	emtr_reply_hdr(c, req, rc, a, b, len, buf);
+	if (emapi_capture_on)
+		emapi_capture(EMSK_SERVER, c->id, EMCD_TX, buf, payload, len);
+
+	if (emtr_tx_reserve(c, EMLN_HDR + len))
+		return 1;
+
+	memcpy(&c->tx[c->tx_len], buf, EMLN_HDR);
+	if (len > 0)
+		memcpy(&c->tx[c->tx_len + EMLN_HDR], payload, len);
+	c->tx_len += EMLN_HDR + len;
+	emtr_tx_dirty(c);
+
+	return 0;
+}
+
+/**
+ * Arm the timer for the first delayed reply, or disarm it if there is none
+ */
+static void emtr_timer_arm(struct emapi_server *s)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	if (s->delayed != NULL)
+	{
+		its.it_value.tv_sec = s->delayed->due / 1000000000ull;
+		its.it_value.tv_nsec = s->delayed->due % 1000000000ull;
+	}
+	timerfd_settime(s->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/**
+ * Queue a response to a request to be sent after a delay
+ *
+ * The reply is held on the server and sent by the event loop when the
+ * timer fires, so other requests are served in the meantime. Replies on a
+ * connection with the same delay keep their order. The reply is dropped if 
+ * the connection closes first.
+ *
+ * @param 	c 		struct emapi_conn*
+ * @param 	req 	struct emapi_hdr* of the request being answered
+ * @param 	rc 		Return code [EMRC]
+ * @param 	a 		Immediate A
+ * @param 	b 		Immediate B
+ * @param 	payload Serialized payload or NULL
+ * @param 	len 	Length of the payload
+ * @param 	ns 		Delay in nanoseconds, 0 to reply now
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_conn_reply_delay(struct emapi_conn *c, struct emapi_hdr *req, __u8 rc, __u16 a, __u32 b, __u8 *payload, __u16 len, __u64 ns)
+{
+	struct emapi_server *s = c->srv;
+	struct emapi_delayed *d, **pp;
+
+	if (ns == 0)
+		return emapi_conn_reply(c, req, rc, a, b, payload, len);
+
+	// Validate Inputs
+	if (len > EMLN_PAYLOAD || c->fd < 0)
+		return 1;
+
+	d = (struct emapi_delayed*) malloc(sizeof(*d) + EMLN_HDR + len);
+	if (d == NULL)
+		return 1;
+
+	emtr_reply_hdr(c, req, rc, a, b, len, d->buf);
+	if (len > 0)
+		memcpy(&d->buf[EMLN_HDR], payload, len);
+	d->due = emapi_now_ns() + ns;
+	d->fd = c->fd;
+	d->id = c->id;
+	d->len = EMLN_HDR + len;
+	d->next = NULL;
+
+	// With a fixed delay replies become due in the order they are queued
+	if (s->delayed == NULL)
+		s->delayed = s->delayed_tail = d;
+	else if (s->delayed_tail->due <= d->due)
+		s->delayed_tail = s->delayed_tail->next = d;
+	else
+	{
+		for ( pp = &s->delayed ; (*pp)->due <= d->due ; pp = &(*pp)->next )
+			;
+		d->next = *pp;
+		*pp = d;
+	}
+
+	if (s->delayed == d)
+		emtr_timer_arm(s);
+	return 0;
+}
+
+/**
+ * Send the delayed replies that are due
+ *
+ * Called by the event loop backends when the timer fires
+ */
+void emapi_server_timer(struct emapi_server *s)
+{
+	struct emapi_delayed *d;
+	struct emapi_conn *c;
+	__u64 now, v;
+
+	if (read(s->tfd, &v, sizeof(v)) < 0)
+		v = 0;
+
+	now = emapi_now_ns();
+	while ( (d = s->delayed) != NULL && d->due <= now )
+	{
+		s->delayed = d->next;
+
+		// The socket may have been closed and reused by another connection
+		c = (unsigned) d->fd < s->nconns ? s->conns[d->fd] : NULL;
+		if (c != NULL && c->id == d->id)
+		{
+			if (emapi_capture_on)
+				emapi_capture(EMSK_SERVER, c->id, EMCD_TX, d->buf, &d->buf[EMLN_HDR], d->len - EMLN_HDR);
+			emapi_conn_send(c, d->buf, d->len);
+		}
+		free(d);
+	}
+	if (s->delayed == NULL)
+		s->delayed_tail = NULL;
+
+	emtr_timer_arm(s);
+}
+
+/**
+ * Write queued bytes. Registers for EPOLLOUT if the socket is full.
+ */
+static void emtr_conn_flush(struct emapi_conn *c)
+{
+	struct epoll_event ev;
+	ssize_t n;
+
+	while (c->tx_off < c->tx_len)
+	{
+		n = send(c->fd, &c->tx[c->tx_off], c->tx_len - c->tx_off, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == EAGAIN)
+			break;
+		if (n <= 0)
+		{
+			emapi_conn_close(c);
+			return;
+		}
+		c->tx_off += n;
+	}
+
+	if (c->tx_off == c->tx_len)
+		c->tx_off = c->tx_len = 0;
+
+	// Wait for room in the socket
+	if ((c->tx_len > 0) != c->want_out)
+	{
+		c->want_out = c->tx_len > 0;
+		ev.events = EPOLLIN | EPOLLRDHUP | (c->want_out ? EPOLLOUT : 0);
+		ev.data.ptr = c;
+		epoll_ctl(c->srv->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+	}
+}
+
+/**
+ * Flush every connection with queued replies
+ *
+ * Called by the event loop backends once per pass 
+ */
+void emapi_server_flush(struct emapi_server *s)
+{
+	struct emapi_conn *c;
+
+	while ( (c = s->dirty) != NULL )
+	{
+		s->dirty = c->next_dirty;
+		c->next_dirty = NULL;
+		c->dirty = 0;
+		if (c->fd >= 0)
+			s->bflush(c);
+	}
+}
+
+/**
+ * Release connections closed during the last event loop pass
+ *
+ * Connections with backend operations still outstanding are kept until a 
+ * later pass. Called by the event loop backends once per pass.
+ */
+void emapi_server_reap(struct emapi_server *s)
+{
+	struct emapi_conn *c, **pp;
+
+	pp = &s->dead;
+	while ( (c = *pp) != NULL )
+	{
+		if (c->refs > 0)
+		{
+			pp = &c->next;
+			continue;
+		}
+		*pp = c->next;
+		emtr_conn_free(c);
+	}
+}
+
+/**
+ * Call the server handler for one message, timing it when the stats are enabled
+ */
+static inline void emtr_dispatch(struct emapi_conn *c, struct emapi_frame *f)
+{
+	struct emapi_server *s = c->srv;
+	__u64 t0;
+
+	if (!emapi_stats_on)
+	{
+		s->fn(c, f, s->arg);
+		return;
+	}
+
+	c->rc = EMST_RC_NONE;
+	t0 = emapi_now_ns();
+	s->fn(c, f, s->arg);
+	emapi_stats_record(EMSK_SERVER, f->hdr.opcode, c->rc, emapi_now_ns() - t0);
+}
+
+/**
+ * Dispatch each message of an envelope
+ *
+ * @return 0 upon success, non zero if the connection was closed
+ */
+static int emtr_unpack(struct emapi_conn *c, struct emapi_frame *env)
+{
+	struct emapi_env_view v;
+	struct emapi_frame f;
+	int rv;
+
+	if (emapi_env_view_init(&v, env))
+	{
+		emapi_conn_close(c);
+		return 1;
+	}
+
+	while ( (rv = emapi_env_next(&v, &f)) == 1 )
+	{
+		emtr_dispatch(c, &f);
+		if (c->fd < 0)
+			return 1;
+	}
+
+	if (rv < 0)
+	{
+		emapi_conn_close(c);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Hand received bytes to the framer and dispatch each complete message
+ *
+ * @param 	c 		struct emapi_conn* the bytes were received on
+ * @param 	buf 	Received bytes
+ * @param 	len 	Number of bytes
+ * @return 	0 upon success, non zero if the connection was closed
+ */
+int emapi_conn_input(struct emapi_conn *c, __u8 *buf, unsigned len)
+{
+	struct emapi_frame f;
+	int rv;
+
+	emapi_framer_feed(&c->rx, buf, len);
+	while ( (rv = emapi_framer_next(&c->rx, &f)) == 1 )
+	{
+		if (emapi_capture_on)
+			emapi_capture(EMSK_SERVER, c->id, EMCD_RX, f.buf, f.payload, f.hdr.len);
+
+		if (f.hdr.opcode == EMOP_ENVELOPE)
+		{
+			if (emtr_unpack(c, &f))
+				return 1;
+			continue;
+		}
+
+		emtr_dispatch(c, &f);
+		if (c->fd < 0)
+			return 1;
+	}
+
+	// Stream is out of sync
+	if (rv < 0)
+	{
+		emapi_conn_close(c);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Read from a connection until the socket is drained
+ */
+static void emtr_conn_read(struct emapi_conn *c)
+{
+	ssize_t n;
+
+	for (;;)
+	{
+		n = read(c->fd, c->rbuf, EMLN_RX_BUF);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == EAGAIN)
+			return;
+		if (n <= 0)
+		{
+			emapi_conn_close(c);
+			return;
+		}
+		if (emapi_conn_input(c, c->rbuf, n))
+			return;
+		if (n < EMLN_RX_BUF)
+			return;
+	}
+}
+
+/**
+ * Accept all pending connections
+ */
+static void emtr_accept(struct emapi_server *s)
+{
+	struct epoll_event ev;
+	struct emapi_conn *c;
+	int fd, one;
+
+	for (;;)
+	{
+		fd = accept4(s->lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+			return;
+
+		one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		c = emapi_conn_new(s, fd);
+		if (c == NULL)
+		{
+			close(fd);
+			continue;
+		}
+
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = c;
+		if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev))
+		{
+			emapi_conn_close(c);
+			continue;
+		}
+
+		if (s->on_open != NULL)
+			s->on_open(c, s->arg);
+	}
+}
+
+/**
+ * Run the epoll event loop until emapi_server_stop() is called
+ */
+static int emtr_run_epoll(struct emapi_server *s)
+{
+	struct epoll_event ev[EMTR_EVENTS];
+	struct emapi_conn *c;
+	__u64 v;
+	int i, n;
+
+	s->bflush = emtr_conn_flush;
+	s->bclose = NULL;
+
+	while (s->running)
+	{
+		n = epoll_wait(s->epfd, ev, EMTR_EVENTS, -1);
+		if (n < 0 && errno != EINTR)
+			return 1;
+
+		for ( i = 0 ; i < n ; i++ )
+		{
+			if (ev[i].data.ptr == &emtr_listen_tok)
+			{
+				emtr_accept(s);
+				continue;
+			}
+			if (ev[i].data.ptr == &emtr_wake_tok)
+			{
+				if (read(s->wfd, &v, sizeof(v)) < 0)
+					continue;
+				continue;
+			}
+			if (ev[i].data.ptr == &emtr_timer_tok)
+			{
+				emapi_server_timer(s);
+				continue;
+			}
+
+			c = (struct emapi_conn*) ev[i].data.ptr;
+			if (c->fd >= 0 && (ev[i].events & EPOLLIN))
+				emtr_conn_read(c);
+			if (c->fd >= 0 && (ev[i].events & EPOLLOUT))
+				emtr_conn_flush(c);
+			if (c->fd >= 0 && (ev[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) && !(ev[i].events & EPOLLIN))
+				emapi_conn_close(c);
+		}
+
+		emapi_server_flush(s);
+		emapi_server_reap(s);
+	}
+
+	return 0;
+}
+
+/**
+ * Run the server event loop until emapi_server_stop() is called
+ *
+ * @param 	s 		struct emapi_server*
+ * @return 	0 upon a clean stop, non zero upon error
+ */
+int emapi_server_run(struct emapi_server *s)
+{
+	int rv;
+
+	s->running = 1;
+
+	if (s->backend == EMTB_URING)
+	{
+		rv = emapi_uring_run(s);
+		if (rv != EMTB_UNAVAILABLE)
+			return rv;
+
+		// Kernel lacks the io_uring features used, fall back to epoll
+		s->backend = EMTB_EPOLL;
+	}
+
+	return emtr_run_epoll(s);
+}
+
+/**
+ * Select the event loop backend used by emapi_server_run()
+ *
+ * @param 	s 		struct emapi_server*
+ * @param 	backend [EMTB] backend
+ * @return 	0 upon success, non zero otherwise
+ */
+int emapi_server_backend(struct emapi_server *s, unsigned backend)
+{
+	if (backend >= EMTB_MAX || s->running)
+		return 1;
+	s->backend = backend;
+	return 0;
+}
+
+/**
+ * Ask a running server to return from emapi_server_run()
+ *
+ * Safe to call from any thread or from a handler
+ *
+ * @param 	s 		struct emapi_server*
+ */
+void emapi_server_stop(struct emapi_server *s)
+{
+	__u64 v = 1;
+
+	s->running = 0;
+	if (write(s->wfd, &v, sizeof(v)) < 0)
+		return;
+}
+
+/**
+ * Close all connections and release the server resources
+ *
+ * @param 	s 		struct emapi_server*
+ */
+void emapi_server_free(struct emapi_server *s)
+{
+	struct emapi_delayed *d;
+	unsigned i;
+
+	while ( (d = s->delayed) != NULL )
+	{
+		s->delayed = d->next;
+		free(d);
+	}
+	s->delayed_tail = NULL;
+
+	for ( i = 0 ; i < s->nconns ; i++ )
+		if (s->conns[i] != NULL)
+			emapi_conn_close(s->conns[i]);
+	s->dirty = NULL;
+	emapi_server_reap(s);
+
+	free(s->conns);
+	s->conns = NULL;
+	s->nconns = 0;
+
+	if (s->lfd >= 0)
+		close(s->lfd);
+	if (s->wfd >= 0)
+		close(s->wfd);
+	if (s->tfd >= 0)
+		close(s->tfd);
+	if (s->epfd >= 0)
+		close(s->epfd);
+	s->lfd = s->wfd = s->tfd = s->epfd = -1;
+}
@@ -0,0 +1,691 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file 		uring.c
+ *
+ * @brief 		Code file for the EM API io_uring transport backend
+ *
+ * @details 	Drives the server with io_uring instead of epoll. A single
+ *              multishot accept produces every new connection and a single
+ *              multishot recv per connection produces every read, with the
+ *              receive buffers picked by the kernel from a registered buffer
+ *              ring. Replies are queued on the connection as usual and sent
+ *              with one send in flight per connection, so steady state
+ *              traffic needs one io_uring_enter() per pass of the event loop
+ *              and no per read or per write system call.
+ *
+ *              The ring is driven through the raw system calls so there is
+ *              no dependency on liburing. Kernels without the buffer ring
+ *              (before 5.19) make emapi_uring_run() return EMTB_UNAVAILABLE
+ *              and the server falls back to epoll. Kernels without multishot
+ *              accept or recv fall back to re-arming single shot requests.
+ *
+ * @copyright 	Copyright (C) 2024 Jackrabbit Founders LLC. All rights reserved.
+ *
+ * @date 		Oct 2026
+ * @author 		Barrett Edwards <code@jrlabs.io>
+ *
+ */
+/* INCLUDES ==================================================================*/
+
+/* syscall()
+ */
+#define _GNU_SOURCE
+
+/* malloc(), free()
+ */
+#include <stdlib.h>
+
+/* memset()
+ */
+#include <string.h>
+
+/* Return error codes from functions
+ */
+#include <errno.h>
+
+/* read(), syscall()
+ */
+#include <unistd.h>
+
+/* __NR_io_uring_setup, __NR_io_uring_enter, __NR_io_uring_register
+ */
+#include <sys/syscall.h>
+
+/* mmap(), munmap()
+ */
+#include <sys/mman.h>
+
+/* shutdown(), setsockopt(), MSG_NOSIGNAL
+ */
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/* POLLIN
+ */
+#include <poll.h>
+
+/* struct io_uring_params, struct io_uring_sqe, struct io_uring_cqe
+ */
+#include <linux/io_uring.h>
+
+#include "main.h"
+
+/* MACROS ====================================================================*/
+
+#define EMUR_ENTRIES 				256 		//!< Submission queue entries
+#define EMUR_BUF_NUM 				128 		//!< Receive buffers in the buffer ring. Power of 2
+#define EMUR_BUF_SIZE 				16384 		//!< Bytes per receive buffer
+#define EMUR_BGID 					0 			//!< Buffer group id of the buffer ring
+
+/* Kind of request stored in the low bits of io_uring_sqe.user_data */
+#define EMUR_KIND_MASK 				0x7
+#define EMUR_UD(ptr, kind) 			((__u64) (unsigned long) (ptr) | (kind))
+#define EMUR_PTR(ud) 				((void*) (unsigned long) ((ud) & ~(__u64) EMUR_KIND_MASK))
+
+/* ENUMERATIONS ==============================================================*/
+
+/**
+ * Kinds of request submitted to the ring (UK)
+ */
+enum _EMUK
+{
+	EMUK_ACCEPT 	= 0,
+	EMUK_WAKE 		= 1,
+	EMUK_RECV 		= 2,
+	EMUK_SEND 		= 3,
+	EMUK_CANCEL 	= 4,
+	EMUK_TIMER 		= 5
+};
+
+/* STRUCTS ===================================================================*/
+
+/**
+ * io_uring instance and buffer ring owned by a running server
+ */
+struct emur_ring
+{
+	int fd;							//!< io_uring descriptor
+	struct emapi_server *srv;
+
+	void *sq_ptr;					//!< Submission queue ring mapping
+	void *cq_ptr;					//!< Completion queue ring mapping
+	size_t sq_sz;
+	size_t cq_sz;
+	struct io_uring_sqe *sqes;		//!< Submission queue entries
+	size_t sqes_sz;
+
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_array;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	unsigned sq_local;				//!< Tail including entries not yet published
+	unsigned sq_pending;			//!< Entries queued since the last io_uring_enter()
+
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+
+	struct io_uring_buf_ring *br;	//!< Buffer ring shared with the kernel
+	size_t br_sz;
+	__u8 *bufs;						//!< Receive buffers
+	unsigned br_tail;
+
+	unsigned inflight;				//!< Requests that will still post a completion
+	int accept_single;				//!< Multishot accept not supported
+	int recv_single;				//!< Multishot recv not supported
+};
+
+/* GLOBAL VARIABLES ==========================================================*/
+
+/* PROTOTYPES ================================================================*/
+
+static void emur_flush(struct emapi_conn *c);
+
+/* FUNCTIONS =================================================================*/
+
+static int emur_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int emur_enter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+	return (int) syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int emur_register(int fd, unsigned op, void *arg, unsigned num)
+{
+	return (int) syscall(__NR_io_uring_register, fd, op, arg, num);
+}
+
+/**
+ * Publish queued entries and optionally wait for completions
+ *
+ * @return 0 upon success, non zero otherwise
+ */
+static int emur_submit(struct emur_ring *r, unsigned wait)
+{
+	int rv;
+
+	__atomic_store_n(r->sq_tail, r->sq_local, __ATOMIC_RELEASE);
+
+	for (;;)
+	{
+		rv = emur_enter(r->fd, r->sq_pending, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+		if (rv >= 0)
+		{
+			r->sq_pending -= (unsigned) rv < r->sq_pending ? (unsigned) rv : r->sq_pending;
+			return 0;
+		}
+		if (errno == EINTR)
+			continue;
+
+		// Completion queue is full. Let the caller drain it.
+		if (errno == EBUSY || errno == EAGAIN)
+			return 0;
+		return 1;
+	}
+}
+
+/**
+ * Get a cleared submission queue entry, submitting queued entries if full
+ *
+ * @return struct io_uring_sqe*, NULL if the ring failed
+ */
+static struct io_uring_sqe *emur_sqe(struct emur_ring *r, __u64 ud)
+{
+	struct io_uring_sqe *sqe;
+	unsigned i;
+
+	while (r->sq_local - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries)
+		if (emur_submit(r, 0))
+			return NULL;
+
+	i = r->sq_local & r->sq_mask;
+	sqe = &r->sqes[i];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = ud;
+	r->sq_array[i] = i;
+	r->sq_local++;
+	r->sq_pending++;
+	r->inflight++;
+	return sqe;
+}
+
+/**
+ * Give a receive buffer back to the kernel
+ */
+static void emur_buf_put(struct emur_ring *r, unsigned bid)
+{
+	struct io_uring_buf *b;
+
+	b = &r->br->bufs[r->br_tail & (EMUR_BUF_NUM - 1)];
+	b->addr = (__u64) (unsigned long) &r->bufs[bid * EMUR_BUF_SIZE];
+	b->len = EMUR_BUF_SIZE;
+	b->bid = bid;
+	r->br_tail++;
+	__atomic_store_n(&r->br->tail, (__u16) r->br_tail, __ATOMIC_RELEASE);
+}
+
+static void emur_arm_accept(struct emur_ring *r)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = emur_sqe(r, EMUR_UD(r, EMUK_ACCEPT));
+	if (sqe == NULL)
+		return;
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = r->srv->lfd;
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	if (!r->accept_single)
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+}
+
+static void emur_arm_wake(struct emur_ring *r)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = emur_sqe(r, EMUR_UD(r, EMUK_WAKE));
+	if (sqe == NULL)
+		return;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = r->srv->wfd;
+	sqe->poll32_events = POLLIN;
+}
+
+static void emur_arm_timer(struct emur_ring *r)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = emur_sqe(r, EMUR_UD(r, EMUK_TIMER));
+	if (sqe == NULL)
+		return;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = r->srv->tfd;
+	sqe->poll32_events = POLLIN;
+}
+
+static void emur_arm_recv(struct emur_ring *r, struct emapi_conn *c)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = emur_sqe(r, EMUR_UD(c, EMUK_RECV));
+	if (sqe == NULL)
+		return;
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = c->fd;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = EMUR_BGID;
+	if (!r->recv_single)
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+	c->refs++;
+}
+
+static void emur_arm_send(struct emur_ring *r, struct emapi_conn *c)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = emur_sqe(r, EMUR_UD(c, EMUK_SEND));
+	if (sqe == NULL)
+		return;
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = c->fd;
+	sqe->addr = (__u64) (unsigned long) &c->txs[c->txs_off];
+	sqe->len = c->txs_len - c->txs_off;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	c->refs++;
+}
+
+/**
+ * Send queued bytes
+ *
+ * Only one send is in flight per connection so replies stay in order. Bytes
+ * queued while a send is in flight go out when it completes.
+ */
+static void emur_flush(struct emapi_conn *c)
+{
+	struct emur_ring *r = (struct emur_ring*) c->srv->be;
+	unsigned cap;
+	__u8 *p;
+
+	if (c->txs_len > 0 || c->tx_off == c->tx_len)
+		return;
+
+	// Swap the queue with the idle send buffer
+	p = c->txs;
+	cap = c->txs_cap;
+	c->txs = c->tx;
+	c->txs_cap = c->tx_cap;
+	c->txs_off = c->tx_off;
+	c->txs_len = c->tx_len;
+	c->tx = p;
+	c->tx_cap = cap;
+	c->tx_off = c->tx_len = 0;
+
+	emur_arm_send(r, c);
+}
+
+/**
+ * Stop receiving on a connection that is being closed
+ *
+ * The kernel completes the outstanding requests, after which the server
+ * releases the connection.
+ */
+static void emur_close(struct emapi_conn *c)
+{
+	shutdown(c->fd, SHUT_RDWR);
+}
+
+static void emur_on_accept(struct emur_ring *r, struct io_uring_cqe *cqe)
+{
+	struct emapi_server *s = r->srv;
+	struct emapi_conn *c;
+	int one;
+
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+	{
+		r->inflight--;
+
+		// Retry in single shot mode once, then give up on the listener
+		if (cqe->res == -EINVAL && r->accept_single)
+			return;
+		if (cqe->res == -EINVAL)
+			r->accept_single = 1;
+		if (s->running)
+			emur_arm_accept(r);
+	}
+
+	if (cqe->res < 0)
+		return;
+
+	one = 1;
+	setsockopt(cqe->res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	c = emapi_conn_new(s, cqe->res);
+	if (c == NULL)
+	{
+		close(cqe->res);
+		return;
+	}
+
+	emur_arm_recv(r, c);
+
+	if (s->on_open != NULL)
+		s->on_open(c, s->arg);
+}
+
+static void emur_on_recv(struct emur_ring *r, struct emapi_conn *c, struct io_uring_cqe *cqe)
+{
+	struct emapi_server *s = r->srv;
+	unsigned bid;
+	int more;
+
+	more = cqe->flags & IORING_CQE_F_MORE;
+	if (!more)
+	{
+		c->refs--;
+		r->inflight--;
+	}
+
+	if (cqe->res > 0)
+	{
+		bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		if (c->fd >= 0)
+			emapi_conn_input(c, &r->bufs[bid * EMUR_BUF_SIZE], cqe->res);
+		emur_buf_put(r, bid);
+	}
+	else if (cqe->res == -EINVAL && !r->recv_single)
+		r->recv_single = 1;
+	else if (cqe->res != -ENOBUFS && !(cqe->res == -ECANCELED && !s->running))
+	{
+		// Peer closed or the connection failed
+		if (c->fd >= 0)
+			emapi_conn_close(c);
+		return;
+	}
+
+	if (!more && c->fd >= 0 && s->running)
+		emur_arm_recv(r, c);
+}
+
+static void emur_on_send(struct emur_ring *r, struct emapi_conn *c, struct io_uring_cqe *cqe)
+{
+	struct emapi_server *s = r->srv;
+
+	c->refs--;
+	r->inflight--;
+
+	if (cqe->res < 0)
+	{
+		if (c->fd >= 0 && !(cqe->res == -ECANCELED && !s->running))
+			emapi_conn_close(c);
+		return;
+	}
+
+	c->txs_off += cqe->res;
+	if (c->txs_off < c->txs_len)
+	{
+		// Short send, send the rest before anything queued behind it
+		if (c->fd >= 0 && s->running)
+			emur_arm_send(r, c);
+		return;
+	}
+
+	c->txs_off = c->txs_len = 0;
+	if (c->fd >= 0 && s->running)
+		emur_flush(c);
+}
+
+/**
+ * Handle every completion posted so far
+ */
+static void emur_reap(struct emur_ring *r)
+{
+	struct io_uring_cqe *cqe;
+	unsigned head, tail;
+	void *ptr;
+	__u64 v;
+
+	head = *r->cq_head;
+	tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+
+	for ( ; head != tail ; head++ )
+	{
+		cqe = &r->cqes[head & r->cq_mask];
+		ptr = EMUR_PTR(cqe->user_data);
+
+		switch (cqe->user_data & EMUR_KIND_MASK)
+		{
+			case EMUK_ACCEPT:
+				emur_on_accept(r, cqe);
+				break;
+
+			case EMUK_WAKE:
+				r->inflight--;
+				if (read(r->srv->wfd, &v, sizeof(v)) < 0)
+					v = 0;
+				if (r->srv->running)
+					emur_arm_wake(r);
+				break;
+
+			case EMUK_TIMER:
+				r->inflight--;
+				emapi_server_timer(r->srv);
+				if (r->srv->running)
+					emur_arm_timer(r);
+				break;
+
+			case EMUK_RECV:
+				emur_on_recv(r, (struct emapi_conn*) ptr, cqe);
+				break;
+
+			case EMUK_SEND:
+				emur_on_send(r, (struct emapi_conn*) ptr, cqe);
+				break;
+
+			case EMUK_CANCEL:
+				r->inflight--;
+				break;
+		}
+
+		// Handlers may queue more entries, publish the new head as we go
+		__atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+	}
+}
+
+/**
+ * Release the ring and the buffer ring
+ */
+static void emur_free(struct emur_ring *r)
+{
+	if (r->fd >= 0)
+		close(r->fd);
+	if (r->sqes != NULL && r->sqes != MAP_FAILED)
+		munmap(r->sqes, r->sqes_sz);
+	if (r->cq_ptr != NULL && r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr)
+		munmap(r->cq_ptr, r->cq_sz);
+	if (r->sq_ptr != NULL && r->sq_ptr != MAP_FAILED)
+		munmap(r->sq_ptr, r->sq_sz);
+	if (r->br != NULL && (void*) r->br != MAP_FAILED)
+		munmap(r->br, r->br_sz);
+	free(r->bufs);
+	free(r);
+}
+
+/**
+ * Create the ring and register the buffer ring
+ *
+ * @return struct emur_ring*, NULL if the kernel lacks support
+ */
+static struct emur_ring *emur_init(struct emapi_server *s)
+{
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	struct emur_ring *r;
+	unsigned i;
+
+	r = (struct emur_ring*) calloc(1, sizeof(*r));
+	if (r == NULL)
+		return NULL;
+	r->srv = s;
+
+	memset(&p, 0, sizeof(p));
+	r->fd = emur_setup(EMUR_ENTRIES, &p);
+	if (r->fd < 0)
+		goto fail;
+
+	// Map the rings
+	r->sq_sz = p.sq_off.array + p.sq_entries * sizeof(__u32);
+	r->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (r->cq_sz > r->sq_sz)
+			r->sq_sz = r->cq_sz;
+		r->cq_sz = r->sq_sz;
+	}
+
+	r->sq_ptr = mmap(NULL, r->sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ptr == MAP_FAILED)
+		goto fail;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->cq_ptr = r->sq_ptr;
+	else
+	{
+		r->cq_ptr = mmap(NULL, r->cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ptr == MAP_FAILED)
+			goto fail;
+	}
+
+	r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = (struct io_uring_sqe*) mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto fail;
+
+	r->sq_head 		= (unsigned*) ((__u8*) r->sq_ptr + p.sq_off.head);
+	r->sq_tail 		= (unsigned*) ((__u8*) r->sq_ptr + p.sq_off.tail);
+	r->sq_mask 		= *(unsigned*) ((__u8*) r->sq_ptr + p.sq_off.ring_mask);
+	r->sq_array 	= (unsigned*) ((__u8*) r->sq_ptr + p.sq_off.array);
+	r->sq_entries 	= p.sq_entries;
+	r->sq_local 	= *r->sq_tail;
+
+	r->cq_head 		= (unsigned*) ((__u8*) r->cq_ptr + p.cq_off.head);
+	r->cq_tail 		= (unsigned*) ((__u8*) r->cq_ptr + p.cq_off.tail);
+	r->cq_mask 		= *(unsigned*) ((__u8*) r->cq_ptr + p.cq_off.ring_mask);
+	r->cqes 		= (struct io_uring_cqe*) ((__u8*) r->cq_ptr + p.cq_off.cqes);
+
+	// Register the buffer ring the kernel picks receive buffers from
+	r->br_sz = EMUR_BUF_NUM * sizeof(struct io_uring_buf);
+	r->br = (struct io_uring_buf_ring*) mmap(NULL, r->br_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if ((void*) r->br == MAP_FAILED)
+		goto fail;
+
+	r->bufs = (__u8*) malloc(EMUR_BUF_NUM * EMUR_BUF_SIZE);
+	if (r->bufs == NULL)
+		goto fail;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (__u64) (unsigned long) r->br;
+	reg.ring_entries = EMUR_BUF_NUM;
+	reg.bgid = EMUR_BGID;
+	if (emur_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1))
+		goto fail;
+
+	for ( i = 0 ; i < EMUR_BUF_NUM ; i++ )
+		emur_buf_put(r, i);
+
+	return r;
+
+fail:
+
+	emur_free(r);
+	return NULL;
+}
+
+/**
+ * Run the server event loop on io_uring
+ *
+ * Connections accepted by an earlier run of either backend are picked up.
+ *
+ * @param 	s 		struct emapi_server*
+ * @return 	0 upon a clean stop, EMTB_UNAVAILABLE if the kernel lacks support,
+ * 			other non zero values upon error
+ */
+int emapi_uring_run(struct emapi_server *s)
+{
+	struct io_uring_sqe *sqe;
+	struct emur_ring *r;
+	unsigned i;
+	int rv;
+
+	// Initialize variables
+	rv = 0;
+
+	r = emur_init(s);
+	if (r == NULL)
+		return EMTB_UNAVAILABLE;
+
+	s->be = r;
+	s->bflush = emur_flush;
+	s->bclose = emur_close;
+
+	if (s->lfd >= 0)
+		emur_arm_accept(r);
+	emur_arm_wake(r);
+	emur_arm_timer(r);
+
+	for ( i = 0 ; i < s->nconns ; i++ )
+	{
+		if (s->conns[i] == NULL)
+			continue;
+		emur_arm_recv(r, s->conns[i]);
+		if (s->conns[i]->txs_len > 0)
+			emur_arm_send(r, s->conns[i]);
+		else
+			emur_flush(s->conns[i]);
+	}
+
+	while (s->running)
+	{
+		if (emur_submit(r, 1))
+		{
+			rv = 1;
+			break;
+		}
+
+		emur_reap(r);
+		emapi_server_flush(s);
+		emapi_server_reap(s);
+	}
+
+	// Cancel every outstanding request and wait for their completions
+	sqe = emur_sqe(r, EMUR_UD(r, EMUK_CANCEL));
+	if (sqe != NULL)
+	{
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+	}
+	while (r->inflight > 0)
+	{
+		if (emur_submit(r, 1))
+			break;
+		emur_reap(r);
+	}
+
+	// Nothing references the connections once the ring is gone
+	for ( i = 0 ; i < s->nconns ; i++ )
+		if (s->conns[i] != NULL)
+			s->conns[i]->refs = 0;
+	emapi_server_reap(s);
+
+	s->be = NULL;
+	s->bflush = NULL;
+	s->bclose = NULL;
+	emur_free(r);
+
+	return rv;
+}